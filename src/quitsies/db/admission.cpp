@@ -0,0 +1,77 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <quitsies/db/admission.hpp>
+
+using namespace quitsies::db;
+
+admission::admission( size_t                max_reads
+                    , size_t                max_writes
+                    , size_t                max_bytes
+                    , stats::aggregator_ptr stats )
+	: _max_reads(max_reads)
+	, _max_writes(max_writes)
+	, _max_bytes(max_bytes)
+	, _depth(0)
+	, _bytes(0)
+	, _stats(stats)
+{}
+
+admission::ticket
+admission::admit_read() {
+	size_t depth = _depth.fetch_add(1, std::memory_order_relaxed) + 1;
+	if ( _max_reads > 0 && depth > _max_reads ) {
+		_depth.fetch_sub(1, std::memory_order_relaxed);
+		_stats->counter("admission.shed.read", 1);
+		return ticket();
+	}
+	return ticket(this, 0);
+}
+
+admission::ticket
+admission::admit_write(size_t bytes) {
+	size_t depth = _depth.fetch_add(1, std::memory_order_relaxed) + 1;
+	size_t before = _bytes.fetch_add(bytes, std::memory_order_relaxed);
+	if ( (_max_writes > 0 && depth > _max_writes)
+	  || (_max_bytes > 0 && before > 0 && before + bytes > _max_bytes) ) {
+		release(bytes);
+		_stats->counter("admission.shed.write", 1);
+		return ticket();
+	}
+	return ticket(this, bytes);
+}
+
+void
+admission::release(size_t bytes) {
+	_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+	_depth.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void
+admission::ticket::release() {
+	if ( _owner != nullptr ) {
+		_owner->release(_bytes);
+		_owner = nullptr;
+	}
+}
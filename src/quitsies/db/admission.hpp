@@ -0,0 +1,132 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef QUITSIES_DB_ADMISSION
+#define QUITSIES_DB_ADMISSION
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include <quitsies/stats/aggregator.hpp>
+
+namespace quitsies { namespace db {
+
+/*
+ * Admission control for the commands of every API.
+ *
+ * Counts the commands that are queued or running against the store, and the
+ * value bytes of the writes among them. Once the depth reaches the limit for
+ * a kind of command, or a write would take the bytes over their limit, new
+ * commands of that kind are shed so that clients are told to back off rather
+ * than queueing behind a stalled store. Reads are given a higher limit than
+ * writes so that they keep being served for longer under load. A limit of 0
+ * is not enforced.
+ */
+class admission {
+	size_t                _max_reads;
+	size_t                _max_writes;
+	size_t                _max_bytes;
+	std::atomic<size_t>   _depth;
+	std::atomic<size_t>   _bytes;
+	stats::aggregator_ptr _stats;
+
+public:
+	/*
+	 * Holds the place of an admitted command until it is released or
+	 * destroyed. An empty ticket is returned for a shed command.
+	 */
+	class ticket {
+		admission * _owner;
+		size_t      _bytes;
+
+	public:
+		ticket()
+			: _owner(nullptr)
+			, _bytes(0)
+		{}
+
+		ticket(admission * owner, size_t bytes)
+			: _owner(owner)
+			, _bytes(bytes)
+		{}
+
+		ticket(const ticket&) = delete;
+
+		ticket& operator=(const ticket&) = delete;
+
+		ticket(ticket && other)
+			: _owner(other._owner)
+			, _bytes(other._bytes)
+		{
+			other._owner = nullptr;
+		}
+
+		ticket& operator=(ticket && other) {
+			if ( this != &other ) {
+				release();
+				_owner = other._owner;
+				_bytes = other._bytes;
+				other._owner = nullptr;
+			}
+			return *this;
+		}
+
+		~ticket() { release(); }
+
+		explicit operator bool() const { return _owner != nullptr; }
+
+		void release();
+	};
+
+	admission(const admission&) = delete;
+
+	admission& operator=(const admission&) = delete;
+
+	admission( size_t                max_reads
+	         , size_t                max_writes
+	         , size_t                max_bytes
+	         , stats::aggregator_ptr stats );
+
+	// Admits a read, unless max_reads commands are in flight.
+	ticket admit_read();
+
+	// Admits a write of a value, unless max_writes commands are in flight or
+	// the value would take the bytes in flight over max_bytes. A value larger
+	// than max_bytes is still admitted when no other bytes are in flight.
+	ticket admit_write(size_t bytes);
+
+	size_t depth() const { return _depth.load(std::memory_order_relaxed); }
+	size_t bytes() const { return _bytes.load(std::memory_order_relaxed); }
+
+private:
+	void release(size_t bytes);
+};
+
+typedef std::shared_ptr<admission> admission_ptr;
+
+} } // namespace
+
+#endif // QUITSIES_DB_ADMISSION
@@ -0,0 +1,95 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <test/catch.hpp>
+
+#include <quitsies/db/admission.hpp>
+#include <quitsies/stats/null_aggregator.hpp>
+
+#include <utility>
+
+using namespace quitsies::db;
+
+TEST_CASE("admission control", "[admission]")
+{
+	quitsies::stats::aggregator_ptr stats(new quitsies::stats::null_aggregator());
+
+	SECTION("writes are shed before reads")
+	{
+		admission control(3, 1, 0, stats);
+
+		auto write = control.admit_write(10);
+		CHECK(static_cast<bool>(write));
+		CHECK_FALSE(static_cast<bool>(control.admit_write(10)));
+
+		auto first = control.admit_read();
+		auto second = control.admit_read();
+		CHECK(static_cast<bool>(first));
+		CHECK(static_cast<bool>(second));
+		CHECK(control.depth() == 3);
+		CHECK_FALSE(static_cast<bool>(control.admit_read()));
+
+		first.release();
+		CHECK(control.depth() == 2);
+		CHECK(static_cast<bool>(control.admit_read()));
+		CHECK(control.depth() == 2);
+	}
+
+	SECTION("writes are shed over the byte budget")
+	{
+		admission control(0, 0, 100, stats);
+
+		// A value larger than the budget is let through alone.
+		{
+			auto large = control.admit_write(500);
+			CHECK(static_cast<bool>(large));
+			CHECK_FALSE(static_cast<bool>(control.admit_write(1)));
+			CHECK(static_cast<bool>(control.admit_read()));
+		}
+		CHECK(control.bytes() == 0);
+
+		auto first = control.admit_write(60);
+		CHECK(static_cast<bool>(first));
+		CHECK_FALSE(static_cast<bool>(control.admit_write(60)));
+		CHECK(control.bytes() == 60);
+
+		auto second = control.admit_write(40);
+		CHECK(static_cast<bool>(second));
+		CHECK(control.bytes() == 100);
+	}
+
+	SECTION("tickets release their place once")
+	{
+		admission control(1, 1, 0, stats);
+
+		auto ticket = control.admit_read();
+		admission::ticket moved(std::move(ticket));
+		CHECK_FALSE(static_cast<bool>(ticket));
+		ticket.release();
+		CHECK(control.depth() == 1);
+
+		moved = admission::ticket();
+		CHECK(control.depth() == 0);
+	}
+}
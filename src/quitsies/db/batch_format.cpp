@@ -0,0 +1,278 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <quitsies/db/batch_format.hpp>
+
+#include <cstdio>
+#include <stdexcept>
+
+namespace quitsies { namespace db {
+
+namespace {
+
+size_t
+skip_space(std::string const & in, size_t pos)
+{
+	while ( pos < in.size() && (in[pos] == ' ' || in[pos] == '\t' || in[pos] == '\r' || in[pos] == '\n') ) {
+		pos++;
+	}
+	return pos;
+}
+
+uint32_t
+read_hex4(const char * data, size_t length, size_t pos)
+{
+	if ( pos + 4 > length ) {
+		throw std::runtime_error("truncated unicode escape");
+	}
+	uint32_t value = 0;
+	for ( size_t i = pos; i < pos + 4; i++ ) {
+		char c = data[i];
+		value <<= 4;
+		if ( c >= '0' && c <= '9' ) {
+			value |= static_cast<uint32_t>(c - '0');
+		} else if ( c >= 'a' && c <= 'f' ) {
+			value |= static_cast<uint32_t>(c - 'a' + 10);
+		} else if ( c >= 'A' && c <= 'F' ) {
+			value |= static_cast<uint32_t>(c - 'A' + 10);
+		} else {
+			throw std::runtime_error("invalid unicode escape");
+		}
+	}
+	return value;
+}
+
+void
+append_utf8(std::string & out, uint32_t code_point)
+{
+	if ( code_point < 0x80 ) {
+		out += static_cast<char>(code_point);
+	} else if ( code_point < 0x800 ) {
+		out += static_cast<char>(0xc0 | (code_point >> 6));
+		out += static_cast<char>(0x80 | (code_point & 0x3f));
+	} else if ( code_point < 0x10000 ) {
+		out += static_cast<char>(0xe0 | (code_point >> 12));
+		out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+		out += static_cast<char>(0x80 | (code_point & 0x3f));
+	} else {
+		out += static_cast<char>(0xf0 | (code_point >> 18));
+		out += static_cast<char>(0x80 | ((code_point >> 12) & 0x3f));
+		out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+		out += static_cast<char>(0x80 | (code_point & 0x3f));
+	}
+}
+
+} // namespace
+
+std::vector<std::string>
+parse_key_list(std::string const & body, size_t max_keys /* = 0 */)
+{
+	std::vector<std::string> keys;
+	auto check_count = [&keys, max_keys]() {
+		if ( max_keys > 0 && keys.size() >= max_keys ) {
+			throw std::length_error("too many keys, at most " + std::to_string(max_keys) + " are permitted");
+		}
+	};
+
+	size_t pos = skip_space(body, 0);
+	if ( pos < body.size() && body[pos] == '[' ) {
+		pos = skip_space(body, pos + 1);
+		if ( pos < body.size() && body[pos] == ']' ) {
+			pos++;
+		} else {
+			while ( true ) {
+				check_count();
+				std::string key;
+				pos = read_json_string(body, pos, key);
+				keys.push_back(std::move(key));
+				pos = skip_space(body, pos);
+				if ( pos >= body.size() ) {
+					throw std::runtime_error("unterminated array of keys");
+				}
+				if ( body[pos] == ']' ) {
+					pos++;
+					break;
+				}
+				if ( body[pos] != ',' ) {
+					throw std::runtime_error("expected , or ] after a key");
+				}
+				pos = skip_space(body, pos + 1);
+			}
+		}
+		if ( skip_space(body, pos) != body.size() ) {
+			throw std::runtime_error("unexpected data after the array of keys");
+		}
+		return keys;
+	}
+
+	// Otherwise one key per line, blank lines are skipped.
+	size_t start = 0;
+	while ( start < body.size() ) {
+		size_t end = body.find('\n', start);
+		if ( end == std::string::npos ) {
+			end = body.size();
+		}
+		size_t length = end - start;
+		if ( length > 0 && body[end - 1] == '\r' ) {
+			length--;
+		}
+		if ( length > 0 ) {
+			check_count();
+			keys.emplace_back(body, start, length);
+		}
+		start = end + 1;
+	}
+	return keys;
+}
+
+size_t
+read_json_string(const char * data, size_t length, size_t pos, std::string & out)
+{
+	if ( pos >= length || data[pos] != '"' ) {
+		throw std::runtime_error("expected a string");
+	}
+	pos++;
+
+	while ( pos < length ) {
+		// Copy the run of plain characters up to the next quote or escape.
+		size_t run = pos;
+		while ( run < length && data[run] != '"' && data[run] != '\\' ) {
+			run++;
+		}
+		out.append(data + pos, run - pos);
+		pos = run;
+		if ( pos >= length ) {
+			break;
+		}
+		if ( data[pos++] == '"' ) {
+			return pos;
+		}
+		if ( pos >= length ) {
+			break;
+		}
+		switch ( data[pos++] ) {
+		case '"':  out += '"'; break;
+		case '\\': out += '\\'; break;
+		case '/':  out += '/'; break;
+		case 'b':  out += '\b'; break;
+		case 'f':  out += '\f'; break;
+		case 'n':  out += '\n'; break;
+		case 'r':  out += '\r'; break;
+		case 't':  out += '\t'; break;
+		case 'u':
+			{
+				uint32_t code_point = read_hex4(data, length, pos);
+				pos += 4;
+				// Characters beyond the basic plane are escaped as a pair of
+				// surrogates.
+				if ( code_point >= 0xd800 && code_point < 0xdc00
+				  && pos + 6 <= length && data[pos] == '\\' && data[pos + 1] == 'u' ) {
+					uint32_t low = read_hex4(data, length, pos + 2);
+					if ( low >= 0xdc00 && low < 0xe000 ) {
+						code_point = 0x10000 + ((code_point - 0xd800) << 10) + (low - 0xdc00);
+						pos += 6;
+					}
+				}
+				append_utf8(out, code_point);
+			}
+			break;
+		default:
+			throw std::runtime_error("invalid escape in string");
+		}
+	}
+	throw std::runtime_error("unterminated string");
+}
+
+void
+write_json_string(std::string & out, std::string const & value)
+{
+	out += '"';
+	for ( char c : value ) {
+		switch ( c ) {
+		case '"':  out += "\\\""; break;
+		case '\\': out += "\\\\"; break;
+		case '\b': out += "\\b"; break;
+		case '\f': out += "\\f"; break;
+		case '\n': out += "\\n"; break;
+		case '\r': out += "\\r"; break;
+		case '\t': out += "\\t"; break;
+		default:
+			if ( static_cast<unsigned char>(c) < 0x20 ) {
+				char escape[7];
+				std::snprintf(escape, sizeof(escape), "\\u%04x", static_cast<unsigned char>(c));
+				out += escape;
+			} else {
+				out += c;
+			}
+		}
+	}
+	out += '"';
+}
+
+void
+write_ndjson_item(std::string & out, std::string const & key, bool found, std::string const & value)
+{
+	out += "{\"key\":";
+	write_json_string(out, key);
+	if ( found ) {
+		out += ",\"value\":";
+		write_json_string(out, value);
+		out += "}\n";
+	} else {
+		out += ",\"found\":false}\n";
+	}
+}
+
+void
+write_binary_item(std::string & out, bool found, std::string const & value)
+{
+	if ( !found ) {
+		write_u32(out, binary_miss);
+		return;
+	}
+	write_u32(out, static_cast<uint32_t>(value.size()));
+	out += value;
+}
+
+void
+write_u32(std::string & out, uint32_t value)
+{
+	out += static_cast<char>((value >> 24) & 0xff);
+	out += static_cast<char>((value >> 16) & 0xff);
+	out += static_cast<char>((value >> 8) & 0xff);
+	out += static_cast<char>(value & 0xff);
+}
+
+uint32_t
+read_u32(const char * data)
+{
+	auto bytes = reinterpret_cast<const unsigned char *>(data);
+	return (static_cast<uint32_t>(bytes[0]) << 24)
+	     | (static_cast<uint32_t>(bytes[1]) << 16)
+	     | (static_cast<uint32_t>(bytes[2]) << 8)
+	     | static_cast<uint32_t>(bytes[3]);
+}
+
+} } // namespace
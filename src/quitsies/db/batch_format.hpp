@@ -0,0 +1,77 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef QUITSIES_DB_BATCH_FORMAT
+#define QUITSIES_DB_BATCH_FORMAT
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace quitsies { namespace db {
+
+/*
+ * The encodings of the batch endpoints of the REST API.
+ *
+ * Keys are sent as a JSON array of strings or as one key per line. Items are
+ * returned in the order of their keys, either as NDJSON with one object per
+ * line, or as a binary body of length prefixed values. Binary lengths are 4
+ * byte big endian integers, and a missing item has the length binary_miss
+ * and no value.
+ */
+const uint32_t binary_miss = 0xffffffff;
+
+// Parses a list of keys, throwing on a malformed JSON array. Throws
+// std::length_error once more than max_keys are found, 0 is ignored.
+std::vector<std::string> parse_key_list(std::string const & body, size_t max_keys = 0);
+
+/*
+ * Decodes the JSON string literal that opens at pos onto the end of out,
+ * returning the position after its closing quote. Throws if the literal is
+ * malformed or unterminated.
+ */
+size_t read_json_string(const char * data, size_t length, size_t pos, std::string & out);
+
+inline size_t read_json_string(std::string const & in, size_t pos, std::string & out) {
+	return read_json_string(in.data(), in.size(), pos, out);
+}
+
+// Appends a JSON string literal of the bytes, which are passed through as
+// they are apart from the characters JSON requires to be escaped.
+void write_json_string(std::string & out, std::string const & value);
+
+// Appends {"key":...,"value":...} or {"key":...,"found":false} and a newline.
+void write_ndjson_item(std::string & out, std::string const & key, bool found, std::string const & value);
+
+// Appends the length and bytes of the value, or binary_miss.
+void write_binary_item(std::string & out, bool found, std::string const & value);
+
+void     write_u32(std::string & out, uint32_t value);
+uint32_t read_u32(const char * data);
+
+} } // namespace
+
+#endif // QUITSIES_DB_BATCH_FORMAT
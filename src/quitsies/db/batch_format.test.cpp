@@ -0,0 +1,109 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <test/catch.hpp>
+
+#include <quitsies/db/batch_format.hpp>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace quitsies::db;
+
+TEST_CASE("batch endpoints encode keys and items", "[batch_format]")
+{
+	SECTION("keys are read from a JSON array")
+	{
+		auto keys = parse_key_list(" [\"a\", \"b c\",\"q\\\"\\\\\\n\\u00e9\\ud83d\\ude00\"]\n");
+		REQUIRE(keys.size() == 3);
+		CHECK(keys[0] == "a");
+		CHECK(keys[1] == "b c");
+		CHECK(keys[2] == "q\"\\\n\xc3\xa9\xf0\x9f\x98\x80");
+
+		CHECK(parse_key_list("[]").empty());
+		CHECK(parse_key_list("[ ]").empty());
+	}
+
+	SECTION("keys are read one per line")
+	{
+		auto keys = parse_key_list("a\r\nb c\n\nd");
+		REQUIRE(keys.size() == 3);
+		CHECK(keys[0] == "a");
+		CHECK(keys[1] == "b c");
+		CHECK(keys[2] == "d");
+
+		CHECK(parse_key_list("").empty());
+	}
+
+	SECTION("lists with too many keys are rejected")
+	{
+		CHECK(parse_key_list("[\"a\",\"b\"]", 2).size() == 2);
+		CHECK(parse_key_list("a\nb\n", 2).size() == 2);
+		CHECK_THROWS_AS(parse_key_list("[\"a\",\"b\",\"c\"]", 2), std::length_error const &);
+		CHECK_THROWS_AS(parse_key_list("a\nb\nc", 2), std::length_error const &);
+	}
+
+	SECTION("malformed arrays are rejected")
+	{
+		for ( std::string body : {"[", "[\"a\"", "[\"a\" \"b\"]", "[\"a]", "[a]", "[\"a\"] x", "[\"\\x\"]", "[\"\\u12\"]"} ) {
+			INFO("Body: " << body);
+			CHECK_THROWS_AS(parse_key_list(body), std::runtime_error const &);
+		}
+	}
+
+	SECTION("strings round trip through JSON")
+	{
+		std::string value("tab\there \"quoted\" \\ \x01 caf\xc3\xa9");
+		std::string json;
+		write_json_string(json, value);
+		CHECK(json == "\"tab\\there \\\"quoted\\\" \\\\ \\u0001 caf\xc3\xa9\"");
+
+		std::string decoded;
+		CHECK(read_json_string(json, 0, decoded) == json.size());
+		CHECK(decoded == value);
+	}
+
+	SECTION("items are written as NDJSON")
+	{
+		std::string out;
+		write_ndjson_item(out, "k1", true, "v\n1");
+		write_ndjson_item(out, "k2", false, "");
+		CHECK(out == "{\"key\":\"k1\",\"value\":\"v\\n1\"}\n{\"key\":\"k2\",\"found\":false}\n");
+	}
+
+	SECTION("items are written with length prefixes")
+	{
+		std::string out;
+		write_binary_item(out, true, "abc");
+		write_binary_item(out, false, "");
+		write_binary_item(out, true, "");
+		REQUIRE(out.size() == 15);
+		CHECK(read_u32(out.data()) == 3);
+		CHECK(out.substr(4, 3) == "abc");
+		CHECK(read_u32(out.data() + 7) == binary_miss);
+		CHECK(read_u32(out.data() + 11) == 0);
+	}
+}
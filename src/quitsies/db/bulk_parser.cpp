@@ -0,0 +1,236 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <quitsies/db/bulk_parser.hpp>
+#include <quitsies/db/batch_format.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace quitsies { namespace db {
+
+namespace {
+
+size_t
+skip_space(const char * data, size_t length, size_t pos)
+{
+	while ( pos < length && (data[pos] == ' ' || data[pos] == '\t' || data[pos] == '\r') ) {
+		pos++;
+	}
+	return pos;
+}
+
+} // namespace
+
+bulk_parser::bulk_parser(format f, record_handler on_record)
+	: _format(f)
+	, _on_record(on_record)
+	, _state(state::KEY_LENGTH)
+	, _pending()
+	, _key()
+	, _value()
+	, _remaining(0)
+	, _records(0)
+{}
+
+bulk_parser::format
+bulk_parser::format_from_string(std::string const & name)
+{
+	if ( name == "ndjson" ) {
+		return format::NDJSON;
+	} else if ( name == "binary" ) {
+		return format::BINARY;
+	}
+	throw std::runtime_error("Unrecognised format: " + name);
+}
+
+void
+bulk_parser::feed(const char * data, size_t length)
+{
+	if ( _format == format::NDJSON ) {
+		feed_ndjson(data, length);
+	} else {
+		feed_binary(data, length);
+	}
+}
+
+void
+bulk_parser::finish()
+{
+	if ( _format == format::NDJSON ) {
+		// The last line need not end with a newline.
+		if ( !_pending.empty() ) {
+			std::string line;
+			line.swap(_pending);
+			parse_line(line.data(), line.size());
+		}
+		return;
+	}
+	if ( _state != state::KEY_LENGTH || !_pending.empty() ) {
+		throw std::runtime_error("truncated record");
+	}
+}
+
+void
+bulk_parser::feed_ndjson(const char * data, size_t length)
+{
+	const char * pos = data;
+	const char * end = data + length;
+	while ( pos < end ) {
+		const char * eol = static_cast<const char *>(std::memchr(pos, '\n', end - pos));
+		if ( eol == nullptr ) {
+			_pending.append(pos, end - pos);
+			return;
+		}
+		if ( _pending.empty() ) {
+			parse_line(pos, eol - pos);
+		} else {
+			// Complete the line that was split across chunks.
+			_pending.append(pos, eol - pos);
+			parse_line(_pending.data(), _pending.size());
+			_pending.clear();
+		}
+		pos = eol + 1;
+	}
+}
+
+void
+bulk_parser::parse_line(const char * line, size_t length)
+{
+	size_t pos = skip_space(line, length, 0);
+	if ( pos == length ) {
+		// Blank lines are skipped.
+		return;
+	}
+	if ( line[pos] != '{' ) {
+		throw std::runtime_error("expected a record object");
+	}
+
+	_key.clear();
+	_value.clear();
+	bool has_key = false, has_value = false;
+
+	pos = skip_space(line, length, pos + 1);
+	while ( pos < length && line[pos] != '}' ) {
+		std::string name;
+		pos = read_json_string(line, length, pos, name);
+		pos = skip_space(line, length, pos);
+		if ( pos >= length || line[pos] != ':' ) {
+			throw std::runtime_error("expected : after a field name");
+		}
+		pos = skip_space(line, length, pos + 1);
+		if ( name == "key" ) {
+			pos = read_json_string(line, length, pos, _key);
+			has_key = true;
+		} else if ( name == "value" ) {
+			pos = read_json_string(line, length, pos, _value);
+			has_value = true;
+		} else {
+			throw std::runtime_error("unknown record field: " + name);
+		}
+		pos = skip_space(line, length, pos);
+		if ( pos < length && line[pos] == ',' ) {
+			pos = skip_space(line, length, pos + 1);
+		}
+	}
+	if ( pos >= length ) {
+		throw std::runtime_error("unterminated record object");
+	}
+	if ( skip_space(line, length, pos + 1) != length ) {
+		throw std::runtime_error("unexpected data after a record");
+	}
+	if ( !has_key || !has_value ) {
+		throw std::runtime_error("records need a key and a value");
+	}
+	emit();
+}
+
+void
+bulk_parser::feed_binary(const char * data, size_t length)
+{
+	const char * pos = data;
+	const char * end = data + length;
+	while ( pos < end ) {
+		switch ( _state ) {
+		case state::KEY_LENGTH:
+		case state::VALUE_LENGTH:
+			{
+				// Collect the length prefix, which may be split across chunks.
+				size_t n = std::min(static_cast<size_t>(4) - _pending.size(), static_cast<size_t>(end - pos));
+				_pending.append(pos, n);
+				pos += n;
+				if ( _pending.size() < 4 ) {
+					break;
+				}
+				_remaining = read_u32(_pending.data());
+				_pending.clear();
+				if ( _state == state::KEY_LENGTH ) {
+					_key.clear();
+					_state = state::KEY;
+				} else {
+					_value.clear();
+					_state = state::VALUE;
+				}
+				if ( _state == state::VALUE && _remaining == 0 ) {
+					emit();
+					_state = state::KEY_LENGTH;
+				}
+			}
+			break;
+		case state::KEY:
+		case state::VALUE:
+			{
+				std::string & target = _state == state::KEY ? _key : _value;
+				size_t n = std::min(_remaining, static_cast<size_t>(end - pos));
+				target.append(pos, n);
+				pos += n;
+				_remaining -= n;
+				if ( _remaining > 0 ) {
+					break;
+				}
+				if ( _state == state::KEY ) {
+					_state = state::VALUE_LENGTH;
+				} else {
+					emit();
+					_state = state::KEY_LENGTH;
+				}
+			}
+			break;
+		}
+	}
+}
+
+void
+bulk_parser::emit()
+{
+	if ( _key.empty() ) {
+		throw std::runtime_error("records need a non-empty key");
+	}
+	_on_record(_key, _value);
+	_records++;
+}
+
+} } // namespace
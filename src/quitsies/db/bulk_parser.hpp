@@ -0,0 +1,106 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef QUITSIES_DB_BULK_PARSER
+#define QUITSIES_DB_BULK_PARSER
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace quitsies { namespace db {
+
+/*
+ * Parses the key/value records of a bulk load from a stream of bytes.
+ *
+ * NDJSON records are objects of the form {"key":"k","value":"v"}, one per
+ * line. Binary records are a 4 byte big endian key length, the key, a 4 byte
+ * big endian value length and the value.
+ *
+ * Bytes are fed in chunks of any size. Each record is handed to the callback
+ * as soon as it is complete, and only a record that is split across chunks is
+ * carried over to the next, so a body is never held in full. The key and
+ * value buffers are reused between records.
+ */
+class bulk_parser {
+public:
+	enum class format {
+		NDJSON = 0,
+		BINARY
+	};
+
+	typedef std::function<void(std::string const & key, std::string const & value)> record_handler;
+
+private:
+	enum class state {
+		KEY_LENGTH = 0,
+		KEY,
+		VALUE_LENGTH,
+		VALUE
+	};
+
+	format         _format;
+	record_handler _on_record;
+	state          _state;
+	std::string    _pending;
+	std::string    _key;
+	std::string    _value;
+	size_t         _remaining;
+	uint64_t       _records;
+
+public:
+	bulk_parser(const bulk_parser&) = delete;
+
+	bulk_parser& operator=(const bulk_parser&) = delete;
+
+	bulk_parser(format f, record_handler on_record);
+
+	// Parses "ndjson" or "binary", throwing on anything else.
+	static format format_from_string(std::string const & name);
+
+	/*
+	 * Parses the next chunk of the stream, calling the record handler for
+	 * every record it completes. Throws on a malformed record, after which
+	 * the parser must not be fed again.
+	 */
+	void feed(const char * data, size_t length);
+
+	// Ends the stream, throwing if it stops part way through a record.
+	void finish();
+
+	// The number of records parsed so far.
+	uint64_t records() const { return _records; }
+
+private:
+	void feed_ndjson(const char * data, size_t length);
+	void feed_binary(const char * data, size_t length);
+	void parse_line(const char * line, size_t length);
+	void emit();
+};
+
+} } // namespace
+
+#endif // QUITSIES_DB_BULK_PARSER
@@ -0,0 +1,126 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <test/catch.hpp>
+
+#include <quitsies/db/bulk_parser.hpp>
+#include <quitsies/db/batch_format.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace quitsies::db;
+
+namespace {
+
+typedef std::vector<std::pair<std::string, std::string>> record_list;
+
+// Feeds the body to a parser in chunks of the given size.
+record_list
+parse_in_chunks(bulk_parser::format f, std::string const & body, size_t chunk) {
+	record_list records;
+	bulk_parser parser(f, [&records](std::string const & key, std::string const & value) {
+		records.emplace_back(key, value);
+	});
+	for ( size_t pos = 0; pos < body.size(); pos += chunk ) {
+		parser.feed(body.data() + pos, std::min(chunk, body.size() - pos));
+	}
+	parser.finish();
+	CHECK(parser.records() == records.size());
+	return records;
+}
+
+} // namespace
+
+TEST_CASE("bulk parser reads records split at any byte", "[bulk_parser]")
+{
+	record_list expected = {
+		std::make_pair("k1", "v1"),
+		std::make_pair("key \"2\"", std::string("line\nbreak\0", 11)),
+		std::make_pair("k3", "")
+	};
+
+	SECTION("NDJSON records")
+	{
+		std::string body;
+		for ( auto & record : expected ) {
+			body += "{\"key\":";
+			write_json_string(body, record.first);
+			body += ", \"value\" : ";
+			write_json_string(body, record.second);
+			body += "}\r\n\n";
+		}
+		// The last line need not end with a newline.
+		body.resize(body.size() - 3);
+
+		for ( size_t chunk : {1, 2, 7, 4096} ) {
+			INFO("Chunk: " << chunk);
+			CHECK(parse_in_chunks(bulk_parser::format::NDJSON, body, chunk) == expected);
+		}
+	}
+
+	SECTION("binary records")
+	{
+		std::string body;
+		for ( auto & record : expected ) {
+			write_u32(body, static_cast<uint32_t>(record.first.size()));
+			body += record.first;
+			write_u32(body, static_cast<uint32_t>(record.second.size()));
+			body += record.second;
+		}
+
+		for ( size_t chunk : {1, 3, 5, 4096} ) {
+			INFO("Chunk: " << chunk);
+			CHECK(parse_in_chunks(bulk_parser::format::BINARY, body, chunk) == expected);
+		}
+	}
+}
+
+TEST_CASE("bulk parser rejects malformed records", "[bulk_parser]")
+{
+	for ( std::string body : { "{\"key\":\"k\"}"
+	                         , "{\"value\":\"v\"}"
+	                         , "{\"key\":\"\",\"value\":\"v\"}"
+	                         , "{\"key\":\"k\",\"value\":\"v\",\"flags\":\"1\"}"
+	                         , "{\"key\":\"k\",\"value\":\"v\""
+	                         , "{\"key\":\"k\",\"value\":\"v\"} x"
+	                         , "[\"k\",\"v\"]" } ) {
+		INFO("Body: " << body);
+		CHECK_THROWS_AS(parse_in_chunks(bulk_parser::format::NDJSON, body, 4096), std::runtime_error const &);
+	}
+
+	std::string truncated;
+	write_u32(truncated, 2);
+	truncated += "k1";
+	write_u32(truncated, 5);
+	truncated += "abc";
+	CHECK_THROWS_AS(parse_in_chunks(bulk_parser::format::BINARY, truncated, 4096), std::runtime_error const &);
+
+	CHECK(bulk_parser::format_from_string("binary") == bulk_parser::format::BINARY);
+	CHECK_THROWS_AS(bulk_parser::format_from_string("csv"), std::runtime_error const &);
+}
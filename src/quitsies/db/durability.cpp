@@ -0,0 +1,73 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <quitsies/db/durability.hpp>
+
+#include <stdexcept>
+
+namespace quitsies { namespace db {
+
+durability
+durability_from_string(std::string const & name)
+{
+	if ( name == "none" ) {
+		return durability::NO_WAL;
+	} else if ( name == "buffered" ) {
+		return durability::BUFFERED;
+	} else if ( name == "sync" ) {
+		return durability::SYNCED;
+	}
+	throw std::runtime_error("Unrecognised durability level: " + name);
+}
+
+std::string
+durability_to_string(durability level)
+{
+	switch ( level ) {
+	case durability::NO_WAL:
+		return "none";
+	case durability::BUFFERED:
+		return "buffered";
+	case durability::SYNCED:
+		return "sync";
+	default:
+		return "default";
+	}
+}
+
+durability
+durability_from_flags(uint32_t * flags)
+{
+	auto level = durability::DEFAULT;
+	if ( *flags & durability_flag_sync ) {
+		level = durability::SYNCED;
+	} else if ( *flags & durability_flag_no_wal ) {
+		level = durability::NO_WAL;
+	}
+	*flags &= ~(durability_flag_sync | durability_flag_no_wal);
+	return level;
+}
+
+} } // namespace
@@ -0,0 +1,68 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef QUITSIES_DB_DURABILITY
+#define QUITSIES_DB_DURABILITY
+
+#include <cstdint>
+#include <string>
+
+namespace quitsies { namespace db {
+
+/*
+ * How durably a write is committed before it is acknowledged.
+ */
+enum class durability {
+	// Defer to the namespace of the key, and then to the store.
+	DEFAULT = 0,
+
+	// Skip the write ahead log, the write is lost if the process crashes
+	// before the memtable is flushed.
+	NO_WAL,
+
+	// Write to the write ahead log without syncing it, the write survives a
+	// process crash but not a machine crash.
+	BUFFERED,
+
+	// Sync the write ahead log before acknowledging.
+	SYNCED
+};
+
+// Parses "none", "buffered" or "sync", throwing on anything else.
+durability  durability_from_string(std::string const & name);
+std::string durability_to_string(durability level);
+
+/*
+ * Memcached clients select a durability with the two high bits of the flags
+ * of a store, which are removed before the flags are stored.
+ */
+const uint32_t durability_flag_sync   = 0x80000000;
+const uint32_t durability_flag_no_wal = 0x40000000;
+
+durability durability_from_flags(uint32_t * flags);
+
+} } // namespace
+
+#endif // QUITSIES_DB_DURABILITY
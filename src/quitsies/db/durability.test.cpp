@@ -0,0 +1,63 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <test/catch.hpp>
+
+#include <quitsies/db/durability.hpp>
+
+#include <stdexcept>
+
+using namespace quitsies::db;
+
+TEST_CASE("durability levels are parsed from names and flags", "[durability]")
+{
+	SECTION("names round trip")
+	{
+		for ( auto level : {durability::NO_WAL, durability::BUFFERED, durability::SYNCED} ) {
+			CHECK(durability_from_string(durability_to_string(level)) == level);
+		}
+		CHECK_THROWS_AS(durability_from_string("fsync"), std::runtime_error const &);
+		CHECK_THROWS_AS(durability_from_string(""), std::runtime_error const &);
+	}
+
+	SECTION("flag bits are removed from the stored flags")
+	{
+		uint32_t flags = 42;
+		CHECK(durability_from_flags(&flags) == durability::DEFAULT);
+		CHECK(flags == 42);
+
+		flags = 42 | durability_flag_sync;
+		CHECK(durability_from_flags(&flags) == durability::SYNCED);
+		CHECK(flags == 42);
+
+		flags = 42 | durability_flag_no_wal;
+		CHECK(durability_from_flags(&flags) == durability::NO_WAL);
+		CHECK(flags == 42);
+
+		// Sync wins when a client sets both bits.
+		flags = durability_flag_sync | durability_flag_no_wal;
+		CHECK(durability_from_flags(&flags) == durability::SYNCED);
+		CHECK(flags == 0);
+	}
+}
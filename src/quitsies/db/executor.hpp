@@ -0,0 +1,71 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef QUITSIES_DB_EXECUTOR
+#define QUITSIES_DB_EXECUTOR
+
+#include <boost/asio.hpp>
+
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace quitsies { namespace db {
+
+/*
+ * A pool of threads that runs blocking store calls away from the network
+ * threads.
+ *
+ * A cold read or a stalled write then only holds up a storage thread, while
+ * the network threads carry on parsing and writing for other connections.
+ * Tasks that are queued when the executor is destroyed are still run.
+ */
+class executor {
+	boost::asio::io_service                        _service;
+	std::unique_ptr<boost::asio::io_service::work> _work;
+	std::vector<std::thread>                       _threads;
+
+public:
+	executor(const executor&) = delete;
+
+	executor& operator=(const executor&) = delete;
+
+	explicit executor(size_t n_threads);
+
+	~executor();
+
+	size_t size() const { return _threads.size(); }
+
+	// Queues a task to be run on one of the storage threads.
+	void post(std::function<void()> task) {
+		_service.post(std::move(task));
+	}
+};
+
+typedef std::shared_ptr<executor> executor_ptr;
+
+} } // namespace
+
+#endif // QUITSIES_DB_EXECUTOR
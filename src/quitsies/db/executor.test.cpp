@@ -0,0 +1,67 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <test/catch.hpp>
+
+#include <quitsies/db/executor.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <thread>
+
+using namespace quitsies::db;
+
+TEST_CASE("storage executor runs tasks on its own threads", "[executor]")
+{
+	SECTION("queued tasks are run before the executor is destroyed")
+	{
+		std::atomic<int> n_run(0);
+		{
+			executor pool(4);
+			CHECK(pool.size() == 4);
+			for ( int i = 0; i < 1000; i++ ) {
+				pool.post([&n_run]() { n_run++; });
+			}
+		}
+		CHECK(n_run == 1000);
+	}
+
+	SECTION("tasks do not run on the posting thread")
+	{
+		std::mutex mutex;
+		std::set<std::thread::id> ids;
+		{
+			executor pool(2);
+			for ( int i = 0; i < 100; i++ ) {
+				pool.post([&]() {
+					std::lock_guard<std::mutex> lock(mutex);
+					ids.insert(std::this_thread::get_id());
+				});
+			}
+		}
+		CHECK(ids.count(std::this_thread::get_id()) == 0);
+		CHECK(ids.size() <= 2);
+	}
+}
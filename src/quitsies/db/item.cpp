@@ -0,0 +1,152 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <quitsies/db/item.hpp>
+
+#include <ctime>
+
+namespace quitsies { namespace db {
+
+const long long relative_exptime_limit = 60 * 60 * 24 * 30; // 30 days
+
+void
+encode_fixed32(std::string & out, uint32_t value)
+{
+	out.push_back(static_cast<char>(value & 0xff));
+	out.push_back(static_cast<char>((value >> 8) & 0xff));
+	out.push_back(static_cast<char>((value >> 16) & 0xff));
+	out.push_back(static_cast<char>((value >> 24) & 0xff));
+}
+
+void
+encode_fixed64(std::string & out, uint64_t value)
+{
+	encode_fixed32(out, static_cast<uint32_t>(value));
+	encode_fixed32(out, static_cast<uint32_t>(value >> 32));
+}
+
+uint32_t
+decode_fixed32(const char * data)
+{
+	const unsigned char * d = reinterpret_cast<const unsigned char *>(data);
+	return static_cast<uint32_t>(d[0])
+		| (static_cast<uint32_t>(d[1]) << 8)
+		| (static_cast<uint32_t>(d[2]) << 16)
+		| (static_cast<uint32_t>(d[3]) << 24);
+}
+
+uint64_t
+decode_fixed64(const char * data)
+{
+	return static_cast<uint64_t>(decode_fixed32(data))
+		| (static_cast<uint64_t>(decode_fixed32(data + 4)) << 32);
+}
+
+uint32_t
+now_seconds()
+{
+	return static_cast<uint32_t>(std::time(nullptr));
+}
+
+uint32_t
+exp_time_from_memcached(long long exptime, uint32_t now)
+{
+	if ( exptime == 0 ) {
+		return 0;
+	}
+	if ( exptime < 0 ) {
+		return 1;
+	}
+	if ( exptime <= relative_exptime_limit ) {
+		return now + static_cast<uint32_t>(exptime);
+	}
+	return static_cast<uint32_t>(exptime);
+}
+
+long long
+ttl_remaining(item_meta const & meta, uint32_t now)
+{
+	if ( meta.exp_time == 0 ) {
+		return -1;
+	}
+	if ( meta.exp_time <= now ) {
+		return 0;
+	}
+	return meta.exp_time - now;
+}
+
+bool
+parse_counter(const char * data, size_t length, uint64_t * counter)
+{
+	if ( length == 0 || length > 20 ) {
+		return false;
+	}
+	uint64_t n = 0;
+	for ( size_t i = 0; i < length; i++ ) {
+		unsigned char d = static_cast<unsigned char>(data[i] - '0');
+		if ( d > 9 ) {
+			return false;
+		}
+		uint64_t next = n * 10 + d;
+		if ( next / 10 != n ) {
+			return false;
+		}
+		n = next;
+	}
+	*counter = n;
+	return true;
+}
+
+std::string
+encode_item_trailer(item_meta const & meta)
+{
+	std::string trailer;
+	trailer.reserve(item_trailer_size);
+	encode_fixed32(trailer, meta.flags);
+	encode_fixed32(trailer, meta.exp_time);
+	encode_fixed64(trailer, meta.cas);
+	trailer.push_back(static_cast<char>(item_format));
+	encode_fixed32(trailer, item_magic);
+	return trailer;
+}
+
+size_t
+decode_item(const char * data, size_t length, item_meta * meta)
+{
+	*meta = item_meta();
+	if ( length < item_trailer_size
+	  || decode_fixed32(data + length - 4) != item_magic
+	  || static_cast<uint8_t>(data[length - 5]) != item_format ) {
+		return length;
+	}
+
+	const char * trailer = data + length - item_trailer_size;
+	meta->flags = decode_fixed32(trailer);
+	meta->exp_time = decode_fixed32(trailer + 4);
+	meta->cas = decode_fixed64(trailer + 8);
+	return length - item_trailer_size;
+}
+
+} } // namespace
@@ -0,0 +1,100 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef QUITSIES_DB_ITEM
+#define QUITSIES_DB_ITEM
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace quitsies { namespace db {
+
+/*
+ * The memcached metadata stored alongside each value.
+ */
+struct item_meta {
+	uint32_t flags;
+
+	// The unix time in seconds that the item expires at, 0 never expires.
+	uint32_t exp_time;
+
+	// A version that changes each time the item is stored, 0 is never used.
+	uint64_t cas;
+
+	item_meta(uint32_t flags = 0, uint32_t exp_time = 0, uint64_t cas = 0)
+		: flags(flags)
+		, exp_time(exp_time)
+		, cas(cas)
+	{}
+
+	bool expired(uint32_t now) const {
+		return exp_time != 0 && exp_time <= now;
+	}
+};
+
+/*
+ * Stored values carry their metadata in a fixed size trailer, ending with a
+ * format byte and a magic number. Values written before metadata was stored
+ * have no trailer and are read with empty metadata.
+ */
+const size_t   item_trailer_size = 21;
+const uint8_t  item_format       = 1;
+const uint32_t item_magic        = 0x7174739f;
+
+// Little endian encoding of the fixed width fields within stored items.
+void     encode_fixed32(std::string & out, uint32_t value);
+void     encode_fixed64(std::string & out, uint64_t value);
+uint32_t decode_fixed32(const char * data);
+uint64_t decode_fixed64(const char * data);
+
+// Returns the current unix time in seconds.
+uint32_t now_seconds();
+
+/*
+ * Converts a memcached exptime into an absolute expiry time. Values up to 30
+ * days are relative to now, larger values are already a unix time, zero never
+ * expires and negative values expire immediately.
+ */
+uint32_t exp_time_from_memcached(long long exptime, uint32_t now);
+
+// Returns the number of seconds remaining before expiry, or -1 for never.
+long long ttl_remaining(item_meta const & meta, uint32_t now);
+
+// Parses a decimal counter value, returning false if it is not one.
+bool parse_counter(const char * data, size_t length, uint64_t * counter);
+
+// Encodes the trailer that is appended to a stored value.
+std::string encode_item_trailer(item_meta const & meta);
+
+/*
+ * Reads the trailer of a stored value into meta, returning the length of the
+ * value without its trailer.
+ */
+size_t decode_item(const char * data, size_t length, item_meta * meta);
+
+} } // namespace
+
+#endif // QUITSIES_DB_ITEM
@@ -0,0 +1,237 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <test/catch.hpp>
+
+#include <quitsies/db/item.hpp>
+#include <quitsies/db/operators.hpp>
+
+using namespace quitsies::db;
+
+TEST_CASE("items carry their metadata in a trailer", "[item]")
+{
+	SECTION("metadata survives a round trip")
+	{
+		std::string stored = "hello" + encode_item_trailer(item_meta(42, 1500000000, 1ULL << 40));
+
+		item_meta meta;
+		size_t length = decode_item(stored.data(), stored.size(), &meta);
+
+		CHECK(length == 5);
+		CHECK(stored.substr(0, length) == "hello");
+		CHECK(meta.flags == 42);
+		CHECK(meta.exp_time == 1500000000);
+		CHECK(meta.cas == 1ULL << 40);
+	}
+
+	SECTION("trailers hold the fields, format and magic in order")
+	{
+		std::string stored = "hi";
+		encode_fixed32(stored, 42);
+		encode_fixed32(stored, 1500000000);
+		encode_fixed64(stored, 7);
+		stored.push_back(static_cast<char>(item_format));
+		encode_fixed32(stored, item_magic);
+
+		CHECK(stored == "hi" + encode_item_trailer(item_meta(42, 1500000000, 7)));
+
+		item_meta meta;
+		CHECK(decode_item(stored.data(), stored.size(), &meta) == 2);
+		CHECK(meta.flags == 42);
+		CHECK(meta.cas == 7);
+
+		// Trailers of any other format are read as part of the value.
+		stored[stored.size() - 5] = static_cast<char>(item_format + 1);
+		CHECK(decode_item(stored.data(), stored.size(), &meta) == stored.size());
+		CHECK(meta.flags == 0);
+	}
+
+	SECTION("values without a trailer have empty metadata")
+	{
+		std::vector<std::string> test_cases = {{
+			"",
+			"hello",
+			"a value that is longer than the trailer"
+		}};
+
+		for ( auto test_case : test_cases ) {
+			item_meta meta(1, 1);
+			size_t length = decode_item(test_case.data(), test_case.size(), &meta);
+
+			INFO("Test case: " << test_case);
+			CHECK(length == test_case.size());
+			CHECK(meta.flags == 0);
+			CHECK(meta.exp_time == 0);
+		}
+	}
+
+	SECTION("memcached exptimes are converted to unix times")
+	{
+		uint32_t now = 1500000000;
+
+		CHECK(exp_time_from_memcached(0, now) == 0);
+		CHECK(exp_time_from_memcached(100, now) == now + 100);
+		CHECK(exp_time_from_memcached(60 * 60 * 24 * 30, now) == now + 60 * 60 * 24 * 30);
+		CHECK(exp_time_from_memcached(1600000000, now) == 1600000000);
+		CHECK(item_meta(0, exp_time_from_memcached(-1, now)).expired(now));
+
+		CHECK(ttl_remaining(item_meta(0, 0), now) == -1);
+		CHECK(ttl_remaining(item_meta(0, now + 50), now) == 50);
+		CHECK(ttl_remaining(item_meta(0, now - 50), now) == 0);
+	}
+}
+
+TEST_CASE("expired items are dropped and touched", "[item]")
+{
+	uint32_t now = now_seconds();
+	std::string live = "hello" + encode_item_trailer(item_meta(1, now + 100));
+	std::string dead = "hello" + encode_item_trailer(item_meta(1, now - 100));
+
+	SECTION("compaction keeps live items")
+	{
+		expiry_filter filter;
+		std::string new_value;
+		bool changed = false;
+
+		CHECK(filter.Filter(0, "key", live, &new_value, &changed) == false);
+		CHECK(filter.Filter(0, "key", "legacy", &new_value, &changed) == false);
+
+		// Expired items may have touches pending elsewhere, they are only
+		// dropped once the database can be asked.
+		CHECK(filter.Filter(0, "key", dead, &new_value, &changed) == false);
+	}
+
+	SECTION("touches replace the expiry and keep the value")
+	{
+		item_merge_operator op;
+		rocksdb::Slice existing(dead);
+		std::vector<rocksdb::Slice> operands;
+		std::string first = item_merge_operator::touch_operand(now + 10);
+		std::string second = item_merge_operator::touch_operand(0);
+		operands.push_back(first);
+		operands.push_back(second);
+
+		std::string merged;
+		rocksdb::Slice existing_operand;
+		rocksdb::MergeOperator::MergeOperationInput in("key", &existing, operands, nullptr);
+		rocksdb::MergeOperator::MergeOperationOutput out(merged, existing_operand);
+		CHECK(op.FullMergeV2(in, &out));
+
+		item_meta meta;
+		size_t length = decode_item(merged.data(), merged.size(), &meta);
+		CHECK(merged.substr(0, length) == "hello");
+		CHECK(meta.flags == 1);
+		CHECK(meta.exp_time == 0);
+	}
+
+	SECTION("touches leave missing items expired")
+	{
+		item_merge_operator op;
+		std::string encoded = item_merge_operator::touch_operand(now + 100);
+		std::vector<rocksdb::Slice> operands(1, encoded);
+
+		std::string merged;
+		rocksdb::Slice existing_operand;
+		rocksdb::MergeOperator::MergeOperationInput in("key", nullptr, operands, nullptr);
+		rocksdb::MergeOperator::MergeOperationOutput out(merged, existing_operand);
+		CHECK(op.FullMergeV2(in, &out));
+
+		item_meta meta;
+		size_t length = decode_item(merged.data(), merged.size(), &meta);
+		CHECK(length == 0);
+		CHECK(meta.exp_time == 1);
+		CHECK(meta.expired(now));
+	}
+
+	SECTION("counters and appends are merged into the value")
+	{
+		item_merge_operator op;
+		std::string counter = "10" + encode_item_trailer(item_meta(3, 0, 1));
+		rocksdb::Slice existing(counter);
+
+		std::vector<std::string> encoded = {{
+			item_merge_operator::incr_operand(5, false, 2),
+			item_merge_operator::incr_operand(20, true, 3),
+			item_merge_operator::incr_operand(7, false, 4),
+			item_merge_operator::append_operand("1", false, 5),
+			item_merge_operator::append_operand("9", true, 6)
+		}};
+		std::vector<rocksdb::Slice> operands(encoded.begin(), encoded.end());
+
+		std::string merged;
+		rocksdb::Slice existing_operand;
+		rocksdb::MergeOperator::MergeOperationInput in("key", &existing, operands, nullptr);
+		rocksdb::MergeOperator::MergeOperationOutput out(merged, existing_operand);
+		CHECK(op.FullMergeV2(in, &out));
+
+		item_meta meta;
+		size_t length = decode_item(merged.data(), merged.size(), &meta);
+		CHECK(merged.substr(0, length) == "971");
+		CHECK(meta.flags == 3);
+		CHECK(meta.cas == 6);
+	}
+
+	SECTION("counters leave values that are not numbers unchanged")
+	{
+		item_merge_operator op;
+		rocksdb::Slice existing(live);
+		std::string encoded = item_merge_operator::incr_operand(1, false, 9);
+		std::vector<rocksdb::Slice> operands(1, encoded);
+
+		std::string merged;
+		rocksdb::Slice existing_operand;
+		rocksdb::MergeOperator::MergeOperationInput in("key", &existing, operands, nullptr);
+		rocksdb::MergeOperator::MergeOperationOutput out(merged, existing_operand);
+		CHECK(op.FullMergeV2(in, &out));
+		CHECK(merged == live);
+	}
+
+	SECTION("runs of the same operation are collapsed")
+	{
+		item_merge_operator op;
+		std::string collapsed;
+
+		std::deque<rocksdb::Slice> incrs;
+		std::string a = item_merge_operator::incr_operand(2, false, 1);
+		std::string b = item_merge_operator::incr_operand(3, false, 2);
+		incrs.push_back(a);
+		incrs.push_back(b);
+		CHECK(op.PartialMergeMulti("key", incrs, &collapsed, nullptr));
+		CHECK(collapsed == item_merge_operator::incr_operand(5, false, 2));
+
+		std::deque<rocksdb::Slice> prepends;
+		std::string c = item_merge_operator::append_operand("a", true, 1);
+		std::string d = item_merge_operator::append_operand("b", true, 2);
+		prepends.push_back(c);
+		prepends.push_back(d);
+		CHECK(op.PartialMergeMulti("key", prepends, &collapsed, nullptr));
+		CHECK(collapsed == item_merge_operator::append_operand("ba", true, 2));
+
+		std::deque<rocksdb::Slice> mixed;
+		mixed.push_back(a);
+		mixed.push_back(c);
+		CHECK_FALSE(op.PartialMergeMulti("key", mixed, &collapsed, nullptr));
+	}
+}
@@ -0,0 +1,112 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef QUITSIES_DB_KEY_LOCKS
+#define QUITSIES_DB_KEY_LOCKS
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+
+namespace quitsies { namespace db {
+
+/*
+ * A table of mutexes that keys are hashed onto, so that read-modify-write
+ * operations on one key are serialised without blocking unrelated keys.
+ *
+ * Each stripe sits on its own cache line so that threads locking neighbouring
+ * stripes do not contend on the same line.
+ */
+class key_locks {
+public:
+	static const size_t cache_line = 64;
+
+private:
+	struct stripe {
+		std::mutex mutex;
+		char       pad[cache_line - sizeof(std::mutex) % cache_line];
+	};
+
+	size_t                  _mask;
+	std::unique_ptr<char[]> _storage;
+	stripe                * _stripes;
+	std::hash<std::string>  _hash;
+
+public:
+	key_locks(const key_locks&) = delete;
+
+	key_locks& operator=(const key_locks&) = delete;
+
+	// The number of stripes is rounded up to a power of two.
+	explicit key_locks(size_t n_stripes)
+		: _mask(0)
+		, _storage()
+		, _stripes(nullptr)
+	{
+		size_t n = 1;
+		while ( n < n_stripes ) {
+			n <<= 1;
+		}
+		_mask = n - 1;
+
+		// Over-allocate so that the first stripe can start on a line boundary.
+		_storage.reset(new char[n * sizeof(stripe) + cache_line]);
+		auto offset = reinterpret_cast<uintptr_t>(_storage.get()) % cache_line;
+		char * aligned = _storage.get() + (offset == 0 ? 0 : cache_line - offset);
+
+		_stripes = reinterpret_cast<stripe *>(aligned);
+		for ( size_t i = 0; i < n; i++ ) {
+			new (&_stripes[i]) stripe();
+		}
+	}
+
+	~key_locks() {
+		for ( size_t i = 0; i <= _mask; i++ ) {
+			_stripes[i].~stripe();
+		}
+	}
+
+	size_t size() const { return _mask + 1; }
+
+	// The stripe that a key is hashed onto, for state kept beside the locks.
+	size_t index(std::string const & key) const {
+		return _hash(key) & _mask;
+	}
+
+	std::mutex & at(size_t index) {
+		return _stripes[index].mutex;
+	}
+
+	std::mutex & for_key(std::string const & key) {
+		return at(index(key));
+	}
+};
+
+} } // namespace
+
+#endif // QUITSIES_DB_KEY_LOCKS
@@ -0,0 +1,60 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <test/catch.hpp>
+
+#include <quitsies/db/key_locks.hpp>
+
+using namespace quitsies::db;
+
+TEST_CASE("key locks are striped by key hash", "[key_locks]")
+{
+	SECTION("stripe counts are rounded up to a power of two")
+	{
+		CHECK(key_locks(1).size() == 1);
+		CHECK(key_locks(3).size() == 4);
+		CHECK(key_locks(1024).size() == 1024);
+	}
+
+	SECTION("stripes sit on separate cache lines")
+	{
+		key_locks locks(1024);
+		auto first = reinterpret_cast<uintptr_t>(&locks.for_key("a"));
+		CHECK((first % key_locks::cache_line) == 0);
+
+		for ( int i = 0; i < 100; i++ ) {
+			auto addr = reinterpret_cast<uintptr_t>(&locks.for_key("key" + std::to_string(i)));
+			CHECK((addr % key_locks::cache_line) == 0);
+		}
+	}
+
+	SECTION("a key always maps to the same stripe")
+	{
+		key_locks locks(16);
+		CHECK(&locks.for_key("key1") == &locks.for_key("key1"));
+		CHECK(locks.index("key1") < locks.size());
+		CHECK(&locks.at(locks.index("key1")) == &locks.for_key("key1"));
+	}
+}
@@ -0,0 +1,231 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <quitsies/db/operators.hpp>
+
+namespace quitsies { namespace db {
+
+bool
+expiry_filter::Filter( int level
+                     , rocksdb::Slice const & key
+                     , rocksdb::Slice const & existing_value
+                     , std::string * new_value
+                     , bool * value_changed ) const
+{
+	item_meta meta;
+	decode_item(existing_value.data(), existing_value.size(), &meta);
+	auto now = now_seconds();
+	if ( !meta.expired(now) ) {
+		return false;
+	}
+
+	rocksdb::DB * db = _db;
+	if ( db == nullptr ) {
+		return false;
+	}
+	std::string current;
+	auto s = db->Get(rocksdb::ReadOptions(), key, &current);
+	if ( s.IsNotFound() ) {
+		return true;
+	}
+	if ( !s.ok() ) {
+		// Keep the item for a later compaction.
+		return false;
+	}
+	decode_item(current.data(), current.size(), &meta);
+	return meta.expired(now);
+}
+
+// Operations that change the value carry the cas unique after the op byte.
+const size_t value_operand_header = 9;
+
+std::string
+item_merge_operator::touch_operand(uint32_t exp_time)
+{
+	std::string operand(1, operation_type::TOUCH);
+	encode_fixed32(operand, exp_time);
+	return operand;
+}
+
+std::string
+item_merge_operator::incr_operand(uint64_t delta, bool decr, uint64_t cas)
+{
+	std::string operand(1, decr ? operation_type::DECR : operation_type::INCR);
+	encode_fixed64(operand, cas);
+	encode_fixed64(operand, delta);
+	return operand;
+}
+
+uint64_t
+item_merge_operator::apply_incr(uint64_t counter, uint64_t delta, bool decr)
+{
+	if ( decr ) {
+		return delta > counter ? 0 : counter - delta;
+	}
+	return counter + delta;
+}
+
+std::string
+item_merge_operator::append_operand(std::string const & data, bool prepend, uint64_t cas)
+{
+	std::string operand(1, prepend ? operation_type::PREPEND : operation_type::APPEND);
+	operand.reserve(value_operand_header + data.size());
+	encode_fixed64(operand, cas);
+	operand.append(data);
+	return operand;
+}
+
+bool
+is_valid_operand(rocksdb::Slice const & operand)
+{
+	if ( operand.size() < 1 ) {
+		return false;
+	}
+	switch ( operand[0] ) {
+	case item_merge_operator::operation_type::TOUCH:
+		return operand.size() == 5;
+	case item_merge_operator::operation_type::INCR:
+	case item_merge_operator::operation_type::DECR:
+		return operand.size() == value_operand_header + 8;
+	case item_merge_operator::operation_type::APPEND:
+	case item_merge_operator::operation_type::PREPEND:
+		return operand.size() >= value_operand_header;
+	}
+	return false;
+}
+
+bool
+item_merge_operator::FullMergeV2( MergeOperationInput const & merge_in
+                                , MergeOperationOutput * merge_out ) const
+{
+	item_meta meta;
+	auto & value = merge_out->new_value;
+
+	bool missing = merge_in.existing_value == nullptr;
+	if ( !missing ) {
+		auto existing = merge_in.existing_value;
+		value.assign(existing->data(), decode_item(existing->data(), existing->size(), &meta));
+	} else {
+		// The update raced with a delete, leave an expired placeholder behind
+		// for compaction to remove.
+		value.clear();
+		meta.exp_time = 1;
+	}
+
+	for ( auto const & operand : merge_in.operand_list ) {
+		if ( !is_valid_operand(operand) ) {
+			return false;
+		}
+
+		const char * args = operand.data() + value_operand_header;
+		switch ( operand[0] ) {
+		case operation_type::TOUCH:
+			// A touch never revives the placeholder of a missing item.
+			if ( !missing ) {
+				meta.exp_time = decode_fixed32(operand.data() + 1);
+			}
+			break;
+		case operation_type::INCR:
+		case operation_type::DECR:
+			{
+				uint64_t counter;
+				if ( !parse_counter(value.data(), value.size(), &counter) ) {
+					break;
+				}
+				counter = apply_incr(counter, decode_fixed64(args), operand[0] == operation_type::DECR);
+				value = std::to_string(counter);
+				meta.cas = decode_fixed64(operand.data() + 1);
+			}
+			break;
+		case operation_type::APPEND:
+			value.append(args, operand.size() - value_operand_header);
+			meta.cas = decode_fixed64(operand.data() + 1);
+			break;
+		case operation_type::PREPEND:
+			value.insert(0, args, operand.size() - value_operand_header);
+			meta.cas = decode_fixed64(operand.data() + 1);
+			break;
+		}
+	}
+
+	value.append(encode_item_trailer(meta));
+	return true;
+}
+
+bool
+item_merge_operator::PartialMergeMulti( rocksdb::Slice const & key
+                                      , std::deque<rocksdb::Slice> const & operand_list
+                                      , std::string * new_value
+                                      , rocksdb::Logger * logger ) const
+{
+	// Runs of the same operation collapse into one operand, mixed runs are
+	// left for a full merge since counters stop at zero.
+	char op = operand_list.front().size() > 0 ? operand_list.front()[0] : 0;
+	for ( auto const & operand : operand_list ) {
+		if ( !is_valid_operand(operand) || operand[0] != op ) {
+			return false;
+		}
+	}
+
+	auto const & last = operand_list.back();
+	switch ( op ) {
+	case operation_type::TOUCH:
+		new_value->assign(last.data(), last.size());
+		return true;
+	case operation_type::INCR:
+	case operation_type::DECR:
+		{
+			uint64_t delta = 0;
+			for ( auto const & operand : operand_list ) {
+				uint64_t next = decode_fixed64(operand.data() + value_operand_header);
+				// Decrements saturate rather than wrap.
+				delta = op == operation_type::DECR && delta + next < delta ? UINT64_MAX : delta + next;
+			}
+			new_value->assign(last.data(), value_operand_header);
+			encode_fixed64(*new_value, delta);
+		}
+		return true;
+	case operation_type::APPEND:
+	case operation_type::PREPEND:
+		{
+			new_value->assign(last.data(), value_operand_header);
+			std::string data;
+			for ( auto const & operand : operand_list ) {
+				const char * args = operand.data() + value_operand_header;
+				size_t length = operand.size() - value_operand_header;
+				if ( op == operation_type::APPEND ) {
+					data.append(args, length);
+				} else {
+					data.insert(0, args, length);
+				}
+			}
+			new_value->append(data);
+		}
+		return true;
+	}
+	return false;
+}
+
+} } // namespace
@@ -0,0 +1,114 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef QUITSIES_DB_OPERATORS
+#define QUITSIES_DB_OPERATORS
+
+#include <rocksdb/compaction_filter.h>
+#include <rocksdb/merge_operator.h>
+
+#include <quitsies/db/item.hpp>
+
+#include <atomic>
+#include <deque>
+#include <string>
+
+namespace quitsies { namespace db {
+
+/*
+ * Drops items whose expiry time has passed during compaction.
+ *
+ * A stored item only carries the expiry it was written with, while touches
+ * merged on top of it may sit in other levels that the compaction does not
+ * see. An expired item is therefore looked up in the database, and only
+ * dropped if its merged expiry has passed too. Expired items are kept until
+ * the database is set.
+ */
+class expiry_filter : public rocksdb::CompactionFilter {
+	std::atomic<rocksdb::DB *> _db;
+
+public:
+	expiry_filter() : _db(nullptr) {}
+
+	void set_db(rocksdb::DB * db) { _db = db; }
+
+	bool Filter( int level
+	           , rocksdb::Slice const & key
+	           , rocksdb::Slice const & existing_value
+	           , std::string * new_value
+	           , bool * value_changed ) const override;
+
+	const char * Name() const override {
+		return "quitsies.expiry_filter";
+	}
+};
+
+/*
+ * Applies updates to stored items without the caller reading and rewriting
+ * the value. Each operand is an operation byte followed by its arguments,
+ * operations that change the value also carry the new cas unique of the item.
+ *
+ * Updates to missing items leave an expired placeholder behind, and counter
+ * updates to values that are not a decimal number leave them unchanged.
+ */
+class item_merge_operator : public rocksdb::MergeOperator {
+public:
+	enum operation_type : char {
+		TOUCH   = 't',
+		INCR    = '+',
+		DECR    = '-',
+		APPEND  = 'a',
+		PREPEND = 'p'
+	};
+
+	// Encodes an operand that replaces the expiry time of an item.
+	static std::string touch_operand(uint32_t exp_time);
+
+	// Encodes an operand that adds to, or subtracts from, a decimal value.
+	// Increments wrap at 64 bits and decrements stop at zero.
+	static std::string incr_operand(uint64_t delta, bool decr, uint64_t cas);
+
+	// Applies an increment or decrement to a counter as a merge does.
+	static uint64_t apply_incr(uint64_t counter, uint64_t delta, bool decr);
+
+	// Encodes an operand that adds data to the end or start of a value.
+	static std::string append_operand(std::string const & data, bool prepend, uint64_t cas);
+
+	bool FullMergeV2( MergeOperationInput const & merge_in
+	                , MergeOperationOutput * merge_out ) const override;
+
+	bool PartialMergeMulti( rocksdb::Slice const & key
+	                      , std::deque<rocksdb::Slice> const & operand_list
+	                      , std::string * new_value
+	                      , rocksdb::Logger * logger ) const override;
+
+	const char * Name() const override {
+		return "quitsies.item_merge_operator";
+	}
+};
+
+} } // namespace
+
+#endif // QUITSIES_DB_OPERATORS
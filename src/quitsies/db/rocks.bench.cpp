@@ -0,0 +1,113 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+ * Measures add throughput against a real store as the number of writing
+ * threads grows. Each thread adds its own keys, so any lack of scaling comes
+ * from contention inside the store. Run with --db_lock_stripes 1 to compare
+ * against every add sharing one lock.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <quitsies/options.hpp>
+#include <quitsies/db/rocks.hpp>
+#include <quitsies/stats/null_aggregator.hpp>
+#include <quitsies/log/logger.hpp>
+
+using namespace quitsies;
+
+int main(int argc, char* argv[]) {
+	long long max_threads = 16, n_adds = 20000, value_bytes = 100;
+
+	db::store_ptr db(new db::rocks());
+
+	{
+		option_list options = {{
+			std::make_tuple("BENCH", option_array({
+				option_ptr(new int_option('?', "bench_threads", "Maximum number of adding threads.", &max_threads)),
+				option_ptr(new int_option('?', "bench_adds", "Number of adds per thread per round.", &n_adds)),
+				option_ptr(new int_option('?', "bench_value_bytes", "Size of each added value.", &value_bytes))
+			}))
+		}};
+
+		db->register_options(options);
+
+		// Keep benchmark keys out of the default DB path.
+		std::vector<char *> args(argv, argv + argc);
+		bool has_path = false;
+		for ( auto arg : args ) {
+			has_path = has_path || std::string(arg) == "--db_path";
+		}
+		std::string path_flag = "--db_path", path = "/tmp/quitsies_bench";
+		if ( !has_path ) {
+			args.push_back(&path_flag[0]);
+			args.push_back(&path[0]);
+		}
+
+		if ( !parse_arg_options(static_cast<int>(args.size()), args.data(), options) ) {
+			return 1;
+		}
+	}
+
+	auto logger = log::create("quitsies_bench", "warn");
+	db->open(logger, stats::aggregator_ptr(new stats::null_aggregator()));
+
+	std::string value(static_cast<size_t>(value_bytes), 'x');
+	auto run_id = std::to_string(std::chrono::system_clock::now().time_since_epoch().count());
+
+	std::cout << "threads\tadds/s\tfailed" << std::endl;
+	for ( long long n_threads = 1; n_threads <= max_threads; n_threads *= 2 ) {
+		std::atomic<long long> failed(0);
+		std::vector<std::thread> threads;
+
+		auto start = std::chrono::steady_clock::now();
+		for ( long long t = 0; t < n_threads; t++ ) {
+			threads.emplace_back([&, t]() {
+				std::string prefix = run_id + ":" + std::to_string(n_threads) + ":" + std::to_string(t) + ":";
+				for ( long long i = 0; i < n_adds; i++ ) {
+					if ( !db->add(prefix + std::to_string(i), value, db::item_meta()).ok() ) {
+						failed++;
+					}
+				}
+			});
+		}
+		for ( auto & thread : threads ) {
+			thread.join();
+		}
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		std::cout << n_threads << "\t"
+			<< static_cast<long long>(n_threads * n_adds / elapsed.count()) << "\t"
+			<< failed << std::endl;
+	}
+
+	return 0;
+}
@@ -23,14 +23,48 @@ SOFTWARE.
 */
 
 #include <rocksdb/table.h>
+#include <rocksdb/write_batch.h>
 #include <rocksdb/utilities/backupable_db.h>
 
 #include <boost/filesystem.hpp>
 
 #include <quitsies/db/rocks.hpp>
+#include <quitsies/db/batch_format.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
 
 namespace quitsies { namespace db {
 
+namespace {
+
+// Counter names of each durability level, indexed by the level so that
+// writes do not build them.
+const std::string durability_counters[] = {
+	"rocksdb.durability.default",
+	"rocksdb.durability.none",
+	"rocksdb.durability.buffered",
+	"rocksdb.durability.sync"
+};
+
+double
+seconds_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double
+per_second(uint64_t n, double seconds)
+{
+	return seconds > 0 ? n / seconds : 0;
+}
+
+} // namespace
+
 void
 rocks::register_options(option_list & options)
 {
@@ -41,12 +75,60 @@ rocks::register_options(option_list & options)
 		option_ptr(new int_option('?', "db_memtable", "Set the memtable size. Higher == faster writes.", &_memtable)),
 		option_ptr(new int_option('?', "db_shard_bits", "Set the block cache shard bits. 4 == 16 shards.", &_shard_bits)),
 		option_ptr(new int_option('?', "db_block_cap", "Set the cap to the block_cache. Higher == faster reads.", &_block_cap)),
+		option_ptr(new int_option('?', "db_bloom_bits", "Bloom filter bits per key, 0 disables. Speeds up misses.", &_bloom_bits)),
+		option_ptr(new str_option('?', "db_durability", "Default durability of writes (none, buffered, sync).", &_durability_name)),
+		option_ptr(new str_option('?', "db_durability_prefixes", "Durability of key prefixes, e.g. \"session:=none,order:=sync\".", &_durability_prefixes)),
+		option_ptr(new int_option('?', "db_group_commit_us", "Batch writes from all connections over this many microseconds, 0 disables.", &_group_commit_us)),
+		option_ptr(new int_option('?', "db_group_commit_bytes", "Commit a batch of writes early once it reaches this size.", &_group_commit_bytes)),
+		option_ptr(new int_option('?', "db_bulk_batch_bytes", "Size of the write batches committed by a bulk load.", &_bulk_batch_bytes)),
+		option_ptr(new int_option('?', "db_max_batch_keys", "Reject HTTP batch gets for more keys than this, 0 disables.", &_max_batch_keys)),
+		option_ptr(new int_option('?', "db_lock_stripes", "Number of key lock stripes for add and cas, rounded up to a power of 2.", &_lock_stripes)),
 		option_ptr(new bool_option('d', "db_debug", "Collect more granular RocksDB metrics at a small cost to performance.", &_debug)),
 		option_ptr(new bool_option('?', "db_write_mode", "Optimize RocksDB compaction for write amp.", &_write_mode)),
-		option_ptr(new bool_option('?', "db_restore_backup", "Restore DB from a backup.", &_restore))
+		option_ptr(new bool_option('?', "db_restore_backup", "Restore DB from a backup.", &_restore)),
+		option_ptr(new bool_option('?', "db_blind_delete", "Delete without checking the key exists, every delete reports success.", &_blind_delete))
 	})));
 }
 
+std::vector<std::pair<std::string, std::string>>
+rocks::properties()
+{
+	std::vector<std::pair<std::string, std::string>> props;
+
+	uint64_t num_keys = 0;
+	_db->GetAggregatedIntProperty("rocksdb.estimate-num-keys", &num_keys);
+	props.emplace_back("rocksdb.estimate-num-keys", std::to_string(num_keys));
+
+	if ( !_rocks_stats ) {
+		return props;
+	}
+
+	// Lines are either "name COUNT : n" for a ticker, or a histogram of the
+	// form "name P50 : a P95 : b ... COUNT : n SUM : m".
+	std::istringstream lines(_rocks_stats->ToString());
+	std::string line;
+	while ( std::getline(lines, line) ) {
+		std::istringstream tokens(line);
+		std::string name, field, colon, value;
+		if ( !(tokens >> name) ) {
+			continue;
+		}
+		std::vector<std::pair<std::string, std::string>> fields;
+		while ( tokens >> field >> colon >> value ) {
+			std::transform(field.begin(), field.end(), field.begin(), ::tolower);
+			fields.emplace_back(field, value);
+		}
+		if ( fields.size() == 1 && fields[0].first == "count" ) {
+			props.emplace_back(name, fields[0].second);
+			continue;
+		}
+		for ( auto & f : fields ) {
+			props.emplace_back(name + "." + f.first, f.second);
+		}
+	}
+	return props;
+}
+
 void
 rocks::register_endpoints(served::multiplexer & mux)
 {
@@ -60,8 +142,40 @@ rocks::register_endpoints(served::multiplexer & mux)
 		}
 	});
 
+	// Writes take an optional durability level, e.g. ?durability=sync.
+	auto set_handler = [this](served::response & res, const served::request & req) {
+		durability level = durability::DEFAULT;
+		std::string level_name = req.query["durability"];
+		if ( !level_name.empty() ) {
+			try {
+				level = durability_from_string(level_name);
+			} catch ( std::exception & e ) {
+				res.set_status(served::status_4XX::BAD_REQUEST);
+				res << e.what();
+				return;
+			}
+		}
+
+		admission::ticket ticket;
+		if ( !admit(res, true, req.body().size(), ticket) ) {
+			return;
+		}
+
+		auto status = put(req.params["key"], req.body(), item_meta(), nullptr, level);
+		if ( !status.ok() ) {
+			res.set_status(served::status_5XX::INTERNAL_SERVER_ERROR);
+			res << status.to_string();
+			_log->error("failed to set key {}: {}", req.params["key"], status.to_string());
+		}
+	};
+
 	mux.handle("/key/{key}")
 		.get([this](served::response & res, const served::request & req) {
+			admission::ticket ticket;
+			if ( !admit(res, false, 0, ticket) ) {
+				return;
+			}
+
 			std::string value;
 			auto status = get(req.params["key"], &value);
 			if ( status.ok() ) {
@@ -74,21 +188,123 @@ rocks::register_endpoints(served::multiplexer & mux)
 				_log->error("failed to obtain key {}: {}", req.params["key"], status.to_string());
 			}
 		})
-		.put([this](served::response & res, const served::request & req) {
-			auto status = put(req.params["key"], req.body());
-			if ( !status.ok() ) {
-				res.set_status(served::status_5XX::INTERNAL_SERVER_ERROR);
-				res << status.to_string();
-				_log->error("failed to set key {}: {}", req.params["key"], status.to_string());
+		.put(set_handler)
+		.post(set_handler);
+
+	// Gets a batch of keys, given as a JSON array or one per line, with a
+	// single MultiGet. Items are returned in the order of their keys, as
+	// NDJSON or with ?format=binary as length prefixed values, which are
+	// written straight into the response.
+	mux.handle("/keys")
+		.post([this](served::response & res, const served::request & req) {
+			std::string format = req.query["format"];
+			bool binary = format == "binary";
+			if ( !binary && !format.empty() && format != "ndjson" ) {
+				res.set_status(served::status_4XX::BAD_REQUEST);
+				res << "Unrecognised format: " << format;
+				return;
 			}
-		})
+
+			std::vector<std::string> keys;
+			try {
+				keys = parse_key_list(req.body(), static_cast<size_t>(std::max(_max_batch_keys, 0LL)));
+			} catch ( std::length_error & e ) {
+				res.set_status(served::status_4XX::REQUEST_ENTITY_TOO_LARGE);
+				res << e.what();
+				return;
+			} catch ( std::exception & e ) {
+				res.set_status(served::status_4XX::BAD_REQUEST);
+				res << e.what();
+				return;
+			}
+
+			admission::ticket ticket;
+			if ( !admit(res, false, 0, ticket) ) {
+				return;
+			}
+
+			std::vector<std::string> values;
+			auto statuses = multi_get(keys, &values);
+
+			for ( size_t i = 0; i < keys.size(); i++ ) {
+				if ( !statuses[i].ok() && !statuses[i].is_not_found() ) {
+					res.set_status(served::status_5XX::INTERNAL_SERVER_ERROR);
+					res << statuses[i].to_string();
+					_log->error("failed to obtain key {}: {}", keys[i], statuses[i].to_string());
+					return;
+				}
+			}
+			_local_stats->counter("rocksdb.http.multi_get.keys", keys.size());
+
+			// Each item is encoded into a scratch string that is reused, and its
+			// value freed once it is written.
+			res.set_header("Content-Type", binary ? "application/octet-stream" : "application/x-ndjson");
+			std::string item;
+			for ( size_t i = 0; i < keys.size(); i++ ) {
+				item.clear();
+				if ( binary ) {
+					write_binary_item(item, statuses[i].ok(), values[i]);
+				} else {
+					write_ndjson_item(item, keys[i], statuses[i].ok(), values[i]);
+				}
+				std::string().swap(values[i]);
+				res << item;
+			}
+		});
+
+	// Loads a stream of NDJSON, or with ?format=binary length prefixed,
+	// records in large write batches. Takes the durability of a set, where
+	// none skips the write ahead log.
+	mux.handle("/bulk")
 		.post([this](served::response & res, const served::request & req) {
-			auto status = put(req.params["key"], req.body());
-			if ( !status.ok() ) {
+			durability level = durability::DEFAULT;
+			auto format = bulk_parser::format::NDJSON;
+			try {
+				if ( !req.query["durability"].empty() ) {
+					level = durability_from_string(req.query["durability"]);
+				}
+				if ( !req.query["format"].empty() ) {
+					format = bulk_parser::format_from_string(req.query["format"]);
+				}
+			} catch ( std::exception & e ) {
+				res.set_status(served::status_4XX::BAD_REQUEST);
+				res << e.what();
+				return;
+			}
+
+			// A load takes a single place, as its batches are bounded in size.
+			admission::ticket ticket;
+			if ( !admit(res, true, 0, ticket) ) {
+				return;
+			}
+
+			uint64_t records = 0, bytes = 0;
+			auto started = std::chrono::steady_clock::now();
+			status result(true);
+			try {
+				result = bulk_load(req.body(), format, level, &records, &bytes);
+			} catch ( std::exception & e ) {
+				res.set_status(served::status_4XX::BAD_REQUEST);
+				res << e.what() << ", " << records << " records were loaded before it";
+				return;
+			}
+			if ( !result.ok() ) {
 				res.set_status(served::status_5XX::INTERNAL_SERVER_ERROR);
-				res << status.to_string();
-				_log->error("failed to set key {}: {}", req.params["key"], status.to_string());
+				res << result.to_string() << ", " << records << " records were loaded before it";
+				_log->error("failed bulk load: {}", result.to_string());
+				return;
 			}
+
+			double seconds = seconds_since(started);
+			std::stringstream ss;
+			ss << "{\"records\":" << records
+			   << ", \"bytes\":" << bytes
+			   << ", \"seconds\":" << seconds
+			   << ", \"records_per_second\":" << static_cast<uint64_t>(per_second(records, seconds))
+			   << ", \"bytes_per_second\":" << static_cast<uint64_t>(per_second(bytes, seconds))
+			   << "}";
+			res.set_header("Content-Type", "application/json");
+			res << ss.str();
 		});
 
 	mux.handle("/backup_create")
@@ -201,6 +417,8 @@ rocks::open(log::logger log, stats::aggregator_ptr stats)
 
 	_log->info("setting up DB at {}", _path);
 
+	parse_durability();
+
 	// If we are restoring a backup.
 	if ( _restore ) {
 		std::cout << "Warning: restoring a backup over a populated DB will"
@@ -242,6 +460,10 @@ rocks::open(log::logger log, stats::aggregator_ptr stats)
 
 	rocksdb::BlockBasedTableOptions table_options;
 	table_options.block_cache = rocksdb::NewLRUCache(_block_cap, _shard_bits);
+	if ( _bloom_bits > 0 ) {
+		// Lets existence checks skip table files that cannot hold the key.
+		table_options.filter_policy.reset(rocksdb::NewBloomFilterPolicy(static_cast<int>(_bloom_bits), false));
+	}
 
 	rocksdb::Options db_options(rocksdb::DBOptions(), cf_options);
 	db_options.IncreaseParallelism();
@@ -249,6 +471,11 @@ rocks::open(log::logger log, stats::aggregator_ptr stats)
 	db_options.table_factory.reset(rocksdb::NewBlockBasedTableFactory(table_options));
 	db_options.max_open_files = _max_files;
 
+	// Per item expiry and metadata updates, DBWithTTL wraps both to strip its
+	// own timestamps before they see the value.
+	db_options.compaction_filter = &_expiry_filter;
+	db_options.merge_operator.reset(new item_merge_operator());
+
 	if ( _debug ) {
 		_log->info("DEBUG MODE: Collecting granular rocksdb metrics. This will have a small impact on performance.");
 		_rocks_stats = rocksdb::CreateDBStatistics();
@@ -262,6 +489,25 @@ rocks::open(log::logger log, stats::aggregator_ptr stats)
 		throw std::runtime_error("Database failed to open at " + _path + ": "
 			+ db_status.ToString());
 	}
+	_expiry_filter.set_db(_db);
+
+	if ( _lock_stripes < 1 ) {
+		throw std::runtime_error("db_lock_stripes must be at least 1");
+	}
+	_key_locks.reset(new key_locks(static_cast<size_t>(_lock_stripes)));
+
+	if ( _group_commit_us > 0 ) {
+		_log->info("grouping writes into batches every {}us", _group_commit_us);
+		_batcher.reset(new write_batcher( _db
+		                                , std::chrono::microseconds(_group_commit_us)
+		                                , static_cast<size_t>(_group_commit_bytes)
+		                                , _local_stats ));
+		_pending_writes.reset(new uint64_t[_key_locks->size()]());
+	}
+
+	// Cas uniques must keep increasing across restarts, so start them from the
+	// clock with room for four billion stores per second.
+	_next_cas = static_cast<uint64_t>(now_seconds()) << 32;
 
 	if ( _local_stats ) {
 		_local_stats->on_epoch([this](){
@@ -309,9 +555,23 @@ rocks::get_folder_size(std::string root, stats::uvalue_t & file_size)
 }
 
 status
-rocks::del(std::string const & key)
+rocks::del(std::string const & key, durability level, bool no_reply)
 {
-	auto s = _db->Delete(rocksdb::WriteOptions(), key);
+	auto guard = lock_key(key);
+
+	if ( !_blind_delete ) {
+		auto found = exists(key);
+		if ( found.is_not_found() ) {
+			_local_stats->counter("rocksdb.delete.not_found", 1);
+		}
+		if ( !found.ok() ) {
+			return found;
+		}
+	}
+
+	auto s = commit([&key](rocksdb::WriteBatch & batch) {
+		batch.Delete(key);
+	}, write_options(key, level), guard, no_reply);
 	bool isNotFound = s.IsNotFound();
 	if ( isNotFound ) {
 		_local_stats->counter("rocksdb.delete.not_found", 1);
@@ -324,10 +584,27 @@ rocks::del(std::string const & key)
 }
 
 status
-rocks::get(std::string const & key, std::string * value)
+rocks::get(std::string const & key, std::string * value, item_meta * meta)
+{
+	wait_for_writes(key);
+	return read(key, value, meta);
+}
+
+status
+rocks::read(std::string const & key, std::string * value, item_meta * meta)
 {
 	auto s = _db->Get(rocksdb::ReadOptions(), key, value);
 	if ( s.ok() ) {
+		item_meta stored;
+		value->resize(decode_item(value->data(), value->size(), &stored));
+		if ( stored.expired(now_seconds()) ) {
+			value->clear();
+			_local_stats->counter("rocksdb.get.expired", 1);
+			return status(false, true);
+		}
+		if ( meta != nullptr ) {
+			*meta = stored;
+		}
 		_local_stats->counter("rocksdb.get.success", 1);
 		return status(true);
 	}
@@ -340,17 +617,515 @@ rocks::get(std::string const & key, std::string * value)
 	return status(s.ok(), isNotFound);
 }
 
+std::vector<status>
+rocks::multi_get( std::vector<std::string> const & keys
+                , std::vector<std::string> * values
+                , std::vector<item_meta> * metas )
+{
+	// Look the keys up in sorted order, which lets rocksdb walk each memtable
+	// and table file once.
+	std::vector<size_t> order(keys.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&keys](size_t a, size_t b) {
+		return keys[a] < keys[b];
+	});
+
+	std::vector<rocksdb::Slice> sorted_keys;
+	sorted_keys.reserve(keys.size());
+	for ( auto i : order ) {
+		wait_for_writes(keys[i]);
+		sorted_keys.push_back(keys[i]);
+	}
+
+	rocksdb::ReadOptions read_options;
+	read_options.snapshot = _db->GetSnapshot();
+
+	std::vector<std::string> sorted_values;
+	auto statuses = _db->MultiGet(read_options, sorted_keys, &sorted_values);
+
+	_db->ReleaseSnapshot(read_options.snapshot);
+
+	std::vector<status> results(keys.size(), status(false));
+	values->resize(keys.size());
+	if ( metas != nullptr ) {
+		metas->assign(keys.size(), item_meta());
+	}
+
+	auto now = now_seconds();
+
+	stats::value_t n_found = 0, n_not_found = 0, n_expired = 0, n_errors = 0;
+	for ( size_t i = 0; i < order.size(); i++ ) {
+		auto & s = statuses[i];
+		if ( s.ok() ) {
+			auto & value = sorted_values[i];
+			item_meta stored;
+			value.resize(decode_item(value.data(), value.size(), &stored));
+			if ( stored.expired(now) ) {
+				n_expired++;
+				results[order[i]] = status(false, true);
+				continue;
+			}
+			n_found++;
+			(*values)[order[i]].swap(value);
+			if ( metas != nullptr ) {
+				(*metas)[order[i]] = stored;
+			}
+			results[order[i]] = status(true);
+		} else if ( s.IsNotFound() ) {
+			n_not_found++;
+			results[order[i]] = status(false, true);
+		} else {
+			n_errors++;
+			results[order[i]] = status(false, false, s.ToString());
+		}
+	}
+
+	_local_stats->counter("rocksdb.multi_get.calls", 1);
+	if ( n_found > 0 ) {
+		_local_stats->counter("rocksdb.get.success", n_found);
+	}
+	if ( n_not_found > 0 ) {
+		_local_stats->counter("rocksdb.get.not_found", n_not_found);
+	}
+	if ( n_expired > 0 ) {
+		_local_stats->counter("rocksdb.get.expired", n_expired);
+	}
+	if ( n_errors > 0 ) {
+		_local_stats->counter("rocksdb.get.error", n_errors);
+	}
+	return results;
+}
+
+bool
+rocks::admit(served::response & res, bool write, size_t bytes, admission::ticket & ticket)
+{
+	if ( !_admission ) {
+		return true;
+	}
+	ticket = write ? _admission->admit_write(bytes) : _admission->admit_read();
+	if ( !ticket ) {
+		res.set_status(served::status_5XX::SERVICE_UNAVAILABLE);
+		res << "busy";
+		return false;
+	}
+	return true;
+}
+
+void
+rocks::parse_durability()
+{
+	_durability = durability_from_string(_durability_name);
+	if ( _durability_prefixes.empty() ) {
+		return;
+	}
+
+	std::stringstream ss(_durability_prefixes);
+	std::string entry;
+	while ( std::getline(ss, entry, ',') ) {
+		auto split = entry.rfind('=');
+		if ( split == std::string::npos || split == 0 ) {
+			throw std::runtime_error("Invalid durability prefix: " + entry);
+		}
+		_namespaces.push_back(std::make_pair(entry.substr(0, split), durability_from_string(entry.substr(split + 1))));
+	}
+
+	// Longer prefixes are checked first so the most specific namespace wins.
+	std::sort(_namespaces.begin(), _namespaces.end(), [](
+		std::pair<std::string, durability> const & a,
+		std::pair<std::string, durability> const & b
+	) {
+		return a.first.size() > b.first.size();
+	});
+}
+
+rocksdb::WriteOptions
+rocks::write_options(std::string const & key, durability level)
+{
+	if ( level == durability::DEFAULT ) {
+		level = _durability;
+		for ( auto const & ns : _namespaces ) {
+			if ( key.compare(0, ns.first.size(), ns.first) == 0 ) {
+				level = ns.second;
+				break;
+			}
+		}
+	}
+
+	rocksdb::WriteOptions options;
+	options.disableWAL = level == durability::NO_WAL;
+	options.sync = level == durability::SYNCED;
+	_local_stats->counter(durability_counters[static_cast<size_t>(level)], 1);
+	return options;
+}
+
+status
+rocks::bulk_load( std::string const & body
+                , bulk_parser::format format
+                , durability          level
+                , uint64_t *          records
+                , uint64_t *          bytes )
+{
+	// Batches span many keys, so the durability of key namespaces is not
+	// applied to them.
+	auto options = write_options(std::string(), level == durability::DEFAULT ? _durability : level);
+
+	auto started = std::chrono::steady_clock::now();
+	auto last_report = started;
+
+	rocksdb::WriteBatch batch;
+	uint64_t batch_records = 0, batch_bytes = 0;
+	rocksdb::Status s;
+	item_meta meta;
+
+	// The stripes of the keys in the batch, locked around its write so that
+	// it orders with other writes to the same keys.
+	std::vector<size_t> stripes;
+
+	auto flush = [&]() {
+		s = write_locked(batch, options, stripes);
+		stripes.clear();
+		if ( !s.ok() ) {
+			_local_stats->counter("rocksdb.bulk.error", 1);
+			throw std::runtime_error(s.ToString());
+		}
+		batch.Clear();
+		*records += batch_records;
+		*bytes += batch_bytes;
+		_local_stats->counter("rocksdb.bulk.records", batch_records);
+		_local_stats->counter("rocksdb.bulk.bytes", batch_bytes);
+		batch_records = 0;
+		batch_bytes = 0;
+
+		// Report the progress of long loads every few seconds.
+		if ( seconds_since(last_report) >= 5 ) {
+			last_report = std::chrono::steady_clock::now();
+			double seconds = seconds_since(started);
+			_log->info("bulk load at {} records, {} records/s and {} bytes/s", *records,
+				static_cast<uint64_t>(per_second(*records, seconds)),
+				static_cast<uint64_t>(per_second(*bytes, seconds)));
+		}
+	};
+
+	bulk_parser parser(format, [&](std::string const & key, std::string const & value) {
+		// Every item is stamped with a new cas unique, as by a set.
+		meta.cas = ++_next_cas;
+		auto trailer = encode_item_trailer(meta);
+		rocksdb::Slice key_slice(key);
+		rocksdb::Slice value_slices[2] = { value, trailer };
+		batch.Put(rocksdb::SliceParts(&key_slice, 1), rocksdb::SliceParts(value_slices, 2));
+		stripes.push_back(_key_locks->index(key));
+
+		batch_records++;
+		batch_bytes += key.size() + value.size();
+		if ( batch.GetDataSize() >= static_cast<size_t>(_bulk_batch_bytes) ) {
+			flush();
+		}
+	});
+
+	try {
+		parser.feed(body.data(), body.size());
+		parser.finish();
+		if ( batch_records > 0 ) {
+			flush();
+		}
+	} catch ( std::exception & e ) {
+		if ( !s.ok() ) {
+			return status(false, false, s.ToString());
+		}
+		throw;
+	}
+	return status(true);
+}
+
+rocksdb::Status
+rocks::write_locked( rocksdb::WriteBatch &         batch
+                   , rocksdb::WriteOptions const & options
+                   , std::vector<size_t> &         stripes )
+{
+	// Locking in stripe order cannot deadlock with another batch, and every
+	// other writer holds a single stripe at a time.
+	std::sort(stripes.begin(), stripes.end());
+	stripes.erase(std::unique(stripes.begin(), stripes.end()), stripes.end());
+
+	std::vector<std::unique_lock<std::mutex>> locks;
+	locks.reserve(stripes.size());
+	for ( auto stripe : stripes ) {
+		locks.emplace_back(_key_locks->at(stripe));
+		if ( _batcher && _pending_writes[stripe] != 0 ) {
+			// An earlier write to the stripe that is still in an open batch
+			// must not commit over this one. The commit thread takes no stripe
+			// locks, so waiting with them held is safe.
+			_batcher->wait_for(_pending_writes[stripe]);
+			_pending_writes[stripe] = 0;
+		}
+	}
+	return _db->Write(options, &batch);
+}
+
+rocks::key_guard
+rocks::lock_key(std::string const & key)
+{
+	size_t stripe = _key_locks->index(key);
+	key_guard guard = { std::unique_lock<std::mutex>(_key_locks->at(stripe)), nullptr };
+	if ( !_batcher ) {
+		return guard;
+	}
+
+	// Wait for the batch without the lock, a later write to the stripe may
+	// have joined another batch by the time it is taken again.
+	guard.pending = &_pending_writes[stripe];
+	while ( *guard.pending != 0 ) {
+		uint64_t sequence = *guard.pending;
+		guard.lock.unlock();
+		_batcher->wait_for(sequence);
+		guard.lock.lock();
+		if ( *guard.pending == sequence ) {
+			*guard.pending = 0;
+		}
+	}
+	return guard;
+}
+
+void
+rocks::wait_for_writes(std::string const & key)
+{
+	if ( _batcher ) {
+		lock_key(key);
+	}
+}
+
+rocksdb::Status
+rocks::commit( std::function<void(rocksdb::WriteBatch &)> const & add
+             , rocksdb::WriteOptions const &                     options
+             , key_guard &                                       guard
+             , bool                                              no_reply )
+{
+	if ( _batcher && no_reply ) {
+		// Later reads and writes of the stripe wait for the batch, so the
+		// write is seen in order without the writer waiting for it.
+		*guard.pending = _batcher->queue(add, options);
+		guard.lock.unlock();
+		return rocksdb::Status::OK();
+	}
+	if ( _batcher ) {
+		return _batcher->write(add, options, [&guard](uint64_t sequence) {
+			*guard.pending = sequence;
+			guard.lock.unlock();
+		});
+	}
+	rocksdb::WriteBatch batch;
+	add(batch);
+	return _db->Write(options, &batch);
+}
+
 status
-rocks::put(std::string const & key, std::string const & value)
+rocks::write_item( std::string const & key
+                 , std::string const & value
+                 , item_meta const &   meta
+                 , uint64_t *          new_cas
+                 , durability          level
+                 , bool                no_reply
+                 , key_guard &         guard )
 {
-	auto s = _db->Put(rocksdb::WriteOptions(), key, value);
+	item_meta stamped = meta;
+	stamped.cas = ++_next_cas;
+
+	// Write the trailer as a separate slice rather than copying the value to
+	// append it.
+	auto trailer = encode_item_trailer(stamped);
+	rocksdb::Slice key_slice(key);
+	rocksdb::Slice value_slices[2] = { value, trailer };
+
+	auto s = commit([&](rocksdb::WriteBatch & batch) {
+		batch.Put(rocksdb::SliceParts(&key_slice, 1), rocksdb::SliceParts(value_slices, 2));
+	}, write_options(key, level), guard, no_reply);
 	if ( s.ok() ) {
 		_local_stats->counter("rocksdb.put.success", 1);
+		if ( new_cas != nullptr ) {
+			*new_cas = stamped.cas;
+		}
 		return status(true);
 	}
 	_local_stats->counter("rocksdb.put.error", 1);
 	return status(false, false, s.ToString());
 }
 
+status
+rocks::put( std::string const & key
+          , std::string const & value
+          , item_meta const &   meta
+          , uint64_t *          new_cas
+          , durability          level
+          , bool                no_reply )
+{
+	auto guard = lock_key(key);
+	return write_item(key, value, meta, new_cas, level, no_reply, guard);
+}
+
+status
+rocks::add( std::string const & key
+          , std::string const & value
+          , item_meta const &   meta
+          , uint64_t *          new_cas
+          , durability          level
+          , bool                no_reply )
+{
+	auto guard = lock_key(key);
+
+	std::string existing;
+	auto found = read(key, &existing);
+	if ( found.ok() ) {
+		_local_stats->counter("rocksdb.add.exists", 1);
+		return status(false, false, "", true);
+	}
+	if ( !found.is_not_found() ) {
+		return found;
+	}
+	return write_item(key, value, meta, new_cas, level, no_reply, guard);
+}
+
+status
+rocks::cas( std::string const & key
+          , std::string const & value
+          , item_meta const &   meta
+          , uint64_t *          new_cas
+          , durability          level
+          , bool                no_reply )
+{
+	auto guard = lock_key(key);
+
+	std::string existing;
+	item_meta stored;
+	auto found = read(key, &existing, &stored);
+	if ( !found.ok() ) {
+		return found;
+	}
+	if ( stored.cas != meta.cas ) {
+		_local_stats->counter("rocksdb.cas.exists", 1);
+		return status(false, false, "", true);
+	}
+	return write_item(key, value, meta, new_cas, level, no_reply, guard);
+}
+
+status
+rocks::exists(std::string const & key)
+{
+	// The pinned value points into the memtable or block cache, so only the
+	// trailer is decoded and the value is never copied. Bloom filters still
+	// let the lookup skip table files that cannot hold a missing key.
+	rocksdb::PinnableSlice pinned;
+	auto s = _db->Get(rocksdb::ReadOptions(), _db->DefaultColumnFamily(), key, &pinned);
+	if ( s.IsNotFound() ) {
+		return status(false, true);
+	}
+	if ( !s.ok() ) {
+		return status(false, false, s.ToString());
+	}
+
+	item_meta meta;
+	decode_item(pinned.data(), pinned.size(), &meta);
+	if ( meta.expired(now_seconds()) ) {
+		return status(false, true);
+	}
+	return status(true);
+}
+
+status
+rocks::incr( std::string const & key
+           , uint64_t            delta
+           , bool                decr
+           , std::string *       value )
+{
+	auto guard = lock_key(key);
+
+	// The result is worked out under the key lock, from the value that the
+	// update applies to, since the lock is released before the update is
+	// committed when writes are batched.
+	std::string result;
+	if ( value != nullptr ) {
+		auto found = read(key, &result);
+		if ( !found.ok() ) {
+			return found;
+		}
+		uint64_t counter;
+		if ( !parse_counter(result.data(), result.size(), &counter) ) {
+			// The update leaves values that are not counters unchanged.
+			value->swap(result);
+			return status(true);
+		}
+		result = std::to_string(item_merge_operator::apply_incr(counter, delta, decr));
+	}
+
+	auto operand = item_merge_operator::incr_operand(delta, decr, ++_next_cas);
+	auto s = commit([&](rocksdb::WriteBatch & batch) {
+		batch.Merge(key, operand);
+	}, write_options(key, durability::DEFAULT), guard);
+	if ( !s.ok() ) {
+		_local_stats->counter("rocksdb.incr.error", 1);
+		return status(false, false, s.ToString());
+	}
+	_local_stats->counter("rocksdb.incr.success", 1);
+
+	if ( value != nullptr ) {
+		value->swap(result);
+	}
+	return status(true);
+}
+
+status
+rocks::append( std::string const & key
+             , std::string const & data
+             , bool                prepend )
+{
+	auto guard = lock_key(key);
+
+	auto found = exists(key);
+	if ( !found.ok() ) {
+		return found;
+	}
+
+	auto operand = item_merge_operator::append_operand(data, prepend, ++_next_cas);
+	auto s = commit([&](rocksdb::WriteBatch & batch) {
+		batch.Merge(key, operand);
+	}, write_options(key, durability::DEFAULT), guard);
+	if ( s.ok() ) {
+		_local_stats->counter("rocksdb.append.success", 1);
+		return status(true);
+	}
+	_local_stats->counter("rocksdb.append.error", 1);
+	return status(false, false, s.ToString());
+}
+
+status
+rocks::touch( std::string const & key
+            , uint32_t            exp_time
+            , std::string *       value
+            , item_meta *         meta )
+{
+	auto guard = lock_key(key);
+
+	std::string existing;
+	item_meta stored;
+	auto found = read(key, value != nullptr ? value : &existing, &stored);
+	if ( !found.ok() ) {
+		return found;
+	}
+	if ( meta != nullptr ) {
+		*meta = stored;
+		meta->exp_time = exp_time;
+	}
+
+	auto operand = item_merge_operator::touch_operand(exp_time);
+	auto s = commit([&](rocksdb::WriteBatch & batch) {
+		batch.Merge(key, operand);
+	}, write_options(key, durability::DEFAULT), guard);
+	if ( s.ok() ) {
+		_local_stats->counter("rocksdb.touch.success", 1);
+		return status(true);
+	}
+	_local_stats->counter("rocksdb.touch.error", 1);
+	return status(false, false, s.ToString());
+}
+
 } } // namespace
 
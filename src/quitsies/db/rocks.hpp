@@ -34,53 +34,108 @@ SOFTWARE.
 #include <quitsies/stats/null_aggregator.hpp>
 
 #include <quitsies/db/store.hpp>
+#include <quitsies/db/operators.hpp>
+#include <quitsies/db/key_locks.hpp>
+#include <quitsies/db/write_batcher.hpp>
+#include <quitsies/db/bulk_parser.hpp>
 
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <utility>
+#include <vector>
 
 namespace quitsies { namespace db {
 
 class rocks : public store {
 	std::string _path;
+	std::string _durability_name;
+	std::string _durability_prefixes;
 
 	long long _ttl;
 	long long _memtable;
 	long long _shard_bits;
 	long long _block_cap;
 	long long _max_files;
+	long long _lock_stripes;
+	long long _bloom_bits;
+	long long _group_commit_us;
+	long long _group_commit_bytes;
+	long long _bulk_batch_bytes;
+	long long _max_batch_keys;
 
 	bool _debug;
 	bool _write_mode;
 	bool _restore;
+	bool _blind_delete;
+
+	// The default durability of writes, and overrides for key prefixes.
+	durability                                     _durability;
+	std::vector<std::pair<std::string, durability>> _namespaces;
 
 	rocksdb::DBWithTTL * _db;
 
+	expiry_filter _expiry_filter;
+
 	stats::aggregator_ptr                _local_stats;
 	std::shared_ptr<rocksdb::Statistics> _rocks_stats;
 
 	log::logger _log;
 
-	std::mutex _db_mutex;
+	// Serialises the writes to each key so conditional stores are atomic.
+	std::unique_ptr<key_locks> _key_locks;
+
+	// The batch holding the last write made under each key lock, 0 once it is
+	// known to be committed. Guarded by the lock of the stripe.
+	std::unique_ptr<uint64_t[]> _pending_writes;
+
+	std::atomic<uint64_t> _next_cas;
+
+	// Coalesces writes across threads when group commit is enabled.
+	std::unique_ptr<write_batcher> _batcher;
+
+	// Sheds endpoint requests under load when set.
+	admission_ptr _admission;
 
 public:
 	rocks()
 	     : _path("/tmp/quitsies")
+	     , _durability_name("buffered")
+	     , _durability_prefixes()
 	     , _ttl(0)
 	     , _memtable(128 << 20) // 128MB
 	     , _shard_bits(4)
 	     , _block_cap(8 << 20) // 8MB
 	     , _max_files(-1)
+	     , _lock_stripes(1024)
+	     , _bloom_bits(10)
+	     , _group_commit_us(0)
+	     , _group_commit_bytes(1 << 20) // 1MB
+	     , _bulk_batch_bytes(4 << 20) // 4MB
+	     , _max_batch_keys(10000)
 	     , _debug(false)
 	     , _write_mode(false)
 	     , _restore(false)
+	     , _blind_delete(false)
+	     , _durability(durability::BUFFERED)
+	     , _namespaces()
 	     , _local_stats(new stats::null_aggregator())
 	     , _log()
+	     , _next_cas(0)
 	{}
 
 	~rocks() {
+		// Pending writes must be committed before the DB closes.
+		_batcher.reset();
 		if ( _rocks_stats ) {
 			_rocks_stats.reset();
 		}
 		if ( _db != nullptr ) {
+			// Compactions look items up through the filter, so let them finish
+			// before the DB goes.
+			_expiry_filter.set_db(nullptr);
+			_db->PauseBackgroundWork();
 			delete _db;
 			_db = nullptr;
 		}
@@ -89,27 +144,146 @@ public:
 	void register_options(option_list & options);
 	void register_endpoints(served::multiplexer & mux);
 
+	void set_admission(admission_ptr admission) { _admission = admission; }
+
+	// The estimated key count and the RocksDB statistics, one pair per
+	// ticker and one per field of each histogram.
+	std::vector<std::pair<std::string, std::string>> properties();
+
 	// open the database.
 	void open(log::logger log, stats::aggregator_ptr stats);
 
 	// Get the value of a key.
-	status get(std::string const & key, std::string * value);
+	status get(std::string const & key, std::string * value, item_meta * meta = nullptr);
+
+	// Get the values of a batch of keys with a single MultiGet.
+	std::vector<status> multi_get( std::vector<std::string> const & keys
+	                             , std::vector<std::string> * values
+	                             , std::vector<item_meta> * metas = nullptr );
 
 	// Delete a key/value pair.
-	status del(std::string const & key);
+	status del( std::string const & key
+	          , durability          level = durability::DEFAULT
+	          , bool                no_reply = false );
 
-	// Store a key value pair.
-	status put(std::string const & key, std::string const & value);
+	// Store a key value pair along with its metadata.
+	status put( std::string const & key
+	          , std::string const & value
+	          , item_meta const &   meta = item_meta()
+	          , uint64_t *          new_cas = nullptr
+	          , durability          level = durability::DEFAULT
+	          , bool                no_reply = false );
 
-	void lock() {
-		_db_mutex.lock();
-	}
+	// Store a key value pair if the key is absent.
+	status add( std::string const & key
+	          , std::string const & value
+	          , item_meta const &   meta
+	          , uint64_t *          new_cas = nullptr
+	          , durability          level = durability::DEFAULT
+	          , bool                no_reply = false );
 
-	void unlock() {
-		_db_mutex.unlock();
-	}
+	// Store a key value pair if its cas unique is unchanged.
+	status cas( std::string const & key
+	          , std::string const & value
+	          , item_meta const &   meta
+	          , uint64_t *          new_cas = nullptr
+	          , durability          level = durability::DEFAULT
+	          , bool                no_reply = false );
+
+	// Merge a counter update into an item.
+	status incr( std::string const & key
+	           , uint64_t            delta
+	           , bool                decr
+	           , std::string *       value = nullptr );
+
+	// Merge data onto the end or start of an existing item.
+	status append( std::string const & key
+	             , std::string const & data
+	             , bool                prepend );
+
+	// Merge a new expiry time into an existing item.
+	status touch( std::string const & key
+	            , uint32_t            exp_time
+	            , std::string *       value = nullptr
+	            , item_meta *         meta = nullptr );
 
 private:
+	// Gets the value of a key without waiting on batched writes, for callers
+	// that hold its key lock.
+	status read(std::string const & key, std::string * value, item_meta * meta = nullptr);
+
+	// Waits for any batch holding a write to the stripe of a key to commit,
+	// so that reads see writes that returned before they were committed.
+	void wait_for_writes(std::string const & key);
+
+	// Checks that a key is stored and unexpired without copying its value.
+	status exists(std::string const & key);
+
+	// The lock of the stripe of a key, and the pending write of the stripe
+	// when writes are batched.
+	struct key_guard {
+		std::unique_lock<std::mutex> lock;
+		uint64_t *                   pending;
+	};
+
+	/*
+	 * Locks the stripe of a key once any batch holding an earlier write to
+	 * the stripe is committed, so that reads made under the lock see it.
+	 */
+	key_guard lock_key(std::string const & key);
+
+	/*
+	 * Commits the updates added by the function, through the write batcher
+	 * when group commit is enabled. A batched write releases the key lock
+	 * once it is in the batch rather than holding it through the commit, and
+	 * returns there without waiting for the commit when no_reply is set.
+	 */
+	rocksdb::Status commit( std::function<void(rocksdb::WriteBatch &)> const & add
+	                      , rocksdb::WriteOptions const &                     options
+	                      , key_guard &                                       guard
+	                      , bool                                              no_reply = false );
+
+	// Resolves the write options for a key from the requested level, its
+	// namespace or the store default.
+	rocksdb::WriteOptions write_options(std::string const & key, durability level);
+
+	// Admits an endpoint request, or answers it with 503 and returns false
+	// when shed. The ticket holds its place until the request is done.
+	bool admit(served::response & res, bool write, size_t bytes, admission::ticket & ticket);
+
+	/*
+	 * Writes a batch while holding the lock of every stripe that its keys
+	 * hash onto, once earlier batched writes to those stripes are committed.
+	 * The stripes are sorted and made unique in place.
+	 */
+	rocksdb::Status write_locked( rocksdb::WriteBatch &         batch
+	                            , rocksdb::WriteOptions const & options
+	                            , std::vector<size_t> &         stripes );
+
+	/*
+	 * Writes the records of a bulk load in write batches of about
+	 * _bulk_batch_bytes, all at the given level. The records and bytes of
+	 * the batches committed so far are written out as they are committed.
+	 * Throws if a record is malformed, the batches before it stay written.
+	 */
+	status bulk_load( std::string const & body
+	                , bulk_parser::format format
+	                , durability          level
+	                , uint64_t *          records
+	                , uint64_t *          bytes );
+
+	// Parses the durability options.
+	void parse_durability();
+
+	// Writes an item with a new cas unique under the key lock.
+	status write_item( std::string const & key
+	                 , std::string const & value
+	                 , item_meta const &   meta
+	                 , uint64_t *          new_cas
+	                 , durability          level
+	                 , bool                no_reply
+	                 , key_guard &         guard );
+
 	void get_folder_size(std::string path, stats::uvalue_t & size);
 };
 
@@ -27,12 +27,17 @@ SOFTWARE.
 
 #include <string>
 #include <memory>
+#include <utility>
+#include <vector>
 
 #include <served/multiplexer.hpp>
 
 #include <quitsies/options.hpp>
 #include <quitsies/stats/aggregator.hpp>
 #include <quitsies/log/logger.hpp>
+#include <quitsies/db/item.hpp>
+#include <quitsies/db/durability.hpp>
+#include <quitsies/db/admission.hpp>
 
 namespace quitsies { namespace db {
 
@@ -40,15 +45,18 @@ class status {
 	bool        _ok;
 	bool        _is_not_found;
 	std::string _msg;
+	bool        _is_exists;
 
 public:
-	status(bool ok, bool is_not_found = false, std::string msg = "")
+	status(bool ok, bool is_not_found = false, std::string msg = "", bool is_exists = false)
 	      : _ok(ok)
 	      , _is_not_found(is_not_found)
-	      , _msg(msg) {}
+	      , _msg(msg)
+	      , _is_exists(is_exists) {}
 
 	bool        ok()           { return _ok; }
 	bool        is_not_found() { return _is_not_found; }
+	bool        is_exists()    { return _is_exists; }
 	std::string to_string()    { return _msg; }
 };
 
@@ -59,17 +67,82 @@ public:
 
 	virtual void open(log::logger, stats::aggregator_ptr) = 0;
 
-	// Get the value of a key, returns true if the key was found.
-	virtual status get(std::string const & key, std::string * value) = 0;
-
-	// Delete a key/value pair, returns true if the key was found and removed.
-	virtual status del(std::string const & key) = 0;
-
-	// Store a key value pair.
-	virtual status put(std::string const & key, std::string const & value) = 0;
-
-	virtual void lock() = 0;
-	virtual void unlock() = 0;
+	// Sheds the requests of the store endpoints that admission control turns
+	// away. Stores without endpoints of their own may ignore it.
+	virtual void set_admission(admission_ptr admission) {}
+
+	// Named statistics of the underlying storage engine, as served by the
+	// stats endpoint. Stores without any return none.
+	virtual std::vector<std::pair<std::string, std::string>> properties() { return {}; }
+
+	// Get the value of a key, returns true if the key was found. Expired items
+	// are not found. The item metadata is written to meta when given.
+	virtual status get(std::string const & key, std::string * value, item_meta * meta = nullptr) = 0;
+
+	// Get the values of a batch of keys from a single consistent view of the
+	// store. A status and value is returned for each key in the order given.
+	virtual std::vector<status> multi_get( std::vector<std::string> const & keys
+	                                     , std::vector<std::string> * values
+	                                     , std::vector<item_meta> * metas = nullptr ) = 0;
+
+	// Delete a key/value pair, returns true if the key was found and removed
+	// and not found otherwise.
+	virtual status del( std::string const & key
+	                  , durability          level = durability::DEFAULT
+	                  , bool                no_reply = false ) = 0;
+
+	// Store a key value pair along with its metadata. Every store gives the
+	// item a new cas unique, which is written to new_cas when given. Writes
+	// that take a durability level override the namespace and store default.
+	// Writes whose result nobody waits on are marked no_reply, and may return
+	// before they are committed as long as later reads of the key see them.
+	virtual status put( std::string const & key
+	                  , std::string const & value
+	                  , item_meta const &   meta = item_meta()
+	                  , uint64_t *          new_cas = nullptr
+	                  , durability          level = durability::DEFAULT
+	                  , bool                no_reply = false ) = 0;
+
+	// Store a key value pair only if the key is missing or expired, returns
+	// exists otherwise.
+	virtual status add( std::string const & key
+	                  , std::string const & value
+	                  , item_meta const &   meta
+	                  , uint64_t *          new_cas = nullptr
+	                  , durability          level = durability::DEFAULT
+	                  , bool                no_reply = false ) = 0;
+
+	// Store a key value pair only if the stored cas unique still matches
+	// meta.cas, returns exists if it has changed and not found if the key is
+	// missing.
+	virtual status cas( std::string const & key
+	                  , std::string const & value
+	                  , item_meta const &   meta
+	                  , uint64_t *          new_cas = nullptr
+	                  , durability          level = durability::DEFAULT
+	                  , bool                no_reply = false ) = 0;
+
+	// Add delta to a decimal value, or subtract it when decr is set. The
+	// update is merged blind, the value is only read to work out the result
+	// when value is given. Values that are not a number are left unchanged.
+	virtual status incr( std::string const & key
+	                   , uint64_t            delta
+	                   , bool                decr
+	                   , std::string *       value = nullptr ) = 0;
+
+	// Add data to the end of a value, or the start when prepend is set.
+	// Returns not found if the key is missing or expired.
+	virtual status append( std::string const & key
+	                     , std::string const & data
+	                     , bool                prepend ) = 0;
+
+	// Replace the expiry time of an item without rewriting its value, returns
+	// not found if the key is missing or expired. The value and its updated
+	// metadata are written out when given.
+	virtual status touch( std::string const & key
+	                    , uint32_t            exp_time
+	                    , std::string *       value = nullptr
+	                    , item_meta *         meta = nullptr ) = 0;
 };
 
 typedef std::shared_ptr<store> store_ptr;
@@ -0,0 +1,143 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <quitsies/db/write_batcher.hpp>
+
+namespace quitsies { namespace db {
+
+write_batcher::write_batcher( rocksdb::DB *               db
+                            , std::chrono::microseconds   window
+                            , size_t                      max_bytes
+                            , stats::aggregator_ptr       stats )
+	: _db(db)
+	, _window(window)
+	, _max_bytes(max_bytes)
+	, _stats(stats)
+	, _open(new group(1))
+	, _last_committed(0)
+	, _stopping(false)
+	, _thread()
+{
+	_thread = std::thread([this]() { run(); });
+}
+
+write_batcher::~write_batcher()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_queued.notify_all();
+	_thread.join();
+}
+
+std::shared_ptr<write_batcher::group>
+write_batcher::join( std::function<void(rocksdb::WriteBatch &)> const & add
+                   , rocksdb::WriteOptions const &                     options )
+{
+	auto joined = _open;
+	add(joined->batch);
+	joined->n_writes++;
+
+	if ( joined->n_writes == 1 ) {
+		joined->options = options;
+	} else {
+		joined->options.disableWAL = joined->options.disableWAL && options.disableWAL;
+		joined->options.sync = joined->options.sync || options.sync;
+	}
+
+	if ( joined->n_writes == 1 || joined->batch.GetDataSize() >= _max_bytes ) {
+		_queued.notify_one();
+	}
+	return joined;
+}
+
+rocksdb::Status
+write_batcher::write( std::function<void(rocksdb::WriteBatch &)> const & add
+                    , rocksdb::WriteOptions const &                     options
+                    , std::function<void(uint64_t)> const &              added )
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	auto joined = join(add, options);
+	if ( added ) {
+		added(joined->sequence);
+	}
+
+	_committed.wait(lock, [&joined]() { return joined->done; });
+	return joined->status;
+}
+
+uint64_t
+write_batcher::queue( std::function<void(rocksdb::WriteBatch &)> const & add
+                    , rocksdb::WriteOptions const &                     options )
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return join(add, options)->sequence;
+}
+
+void
+write_batcher::wait_for(uint64_t sequence)
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_committed.wait(lock, [this, sequence]() { return _last_committed >= sequence; });
+}
+
+void
+write_batcher::run()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	while ( true ) {
+		_queued.wait(lock, [this]() { return _stopping || _open->n_writes > 0; });
+		if ( _open->n_writes == 0 ) {
+			return;
+		}
+
+		// Give other writers until the end of the window to join.
+		auto deadline = std::chrono::steady_clock::now() + _window;
+		_queued.wait_until(lock, deadline, [this]() {
+			return _stopping || _open->batch.GetDataSize() >= _max_bytes;
+		});
+
+		std::shared_ptr<group> closed(new group(_open->sequence + 1));
+		closed.swap(_open);
+
+		lock.unlock();
+		auto status = _db->Write(closed->options, &closed->batch);
+		_stats->counter("rocksdb.group_commit.commits", 1);
+		_stats->counter("rocksdb.group_commit.writes", closed->n_writes);
+		if ( !status.ok() ) {
+			_stats->counter("rocksdb.group_commit.errors", 1);
+		}
+		lock.lock();
+
+		closed->status = status;
+		closed->done = true;
+		_last_committed = closed->sequence;
+		_committed.notify_all();
+	}
+}
+
+} } // namespace
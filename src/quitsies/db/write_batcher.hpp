@@ -0,0 +1,130 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef QUITSIES_DB_WRITE_BATCHER
+#define QUITSIES_DB_WRITE_BATCHER
+
+#include <rocksdb/db.h>
+#include <rocksdb/write_batch.h>
+
+#include <quitsies/stats/aggregator.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace quitsies { namespace db {
+
+/*
+ * Coalesces writes from every thread into a single WriteBatch per flush
+ * window, so that many small writes cost one trip through the RocksDB write
+ * path and WAL.
+ *
+ * Writers add their updates to the open batch and wait, or queue them and
+ * return at once when nobody waits on the result. A commit thread
+ * closes the batch once the window has passed since it was opened, or sooner
+ * if it grows beyond the byte limit, writes it and wakes every writer that
+ * was part of it. Updates that arrive during a commit go into the next batch.
+ */
+class write_batcher {
+	struct group {
+		rocksdb::WriteBatch   batch;
+		rocksdb::WriteOptions options;
+		uint64_t              sequence;
+		size_t                n_writes;
+		bool                  done;
+		rocksdb::Status       status;
+
+		explicit group(uint64_t sequence)
+			: batch(), options(), sequence(sequence), n_writes(0), done(false), status() {}
+	};
+
+	rocksdb::DB *              _db;
+	std::chrono::microseconds  _window;
+	size_t                     _max_bytes;
+	stats::aggregator_ptr      _stats;
+
+	std::mutex                 _mutex;
+	std::condition_variable    _queued;
+	std::condition_variable    _committed;
+	std::shared_ptr<group>     _open;
+	uint64_t                   _last_committed;
+	bool                       _stopping;
+	std::thread                _thread;
+
+public:
+	write_batcher(const write_batcher&) = delete;
+
+	write_batcher& operator=(const write_batcher&) = delete;
+
+	write_batcher( rocksdb::DB *               db
+	             , std::chrono::microseconds   window
+	             , size_t                      max_bytes
+	             , stats::aggregator_ptr       stats );
+
+	// Commits anything still pending before returning.
+	~write_batcher();
+
+	/*
+	 * Adds updates to the open batch with the given function and blocks until
+	 * that batch is committed, returning the status of the commit.
+	 *
+	 * A batch is committed with the strongest durability of its writes, it
+	 * skips the WAL only if every write asked to and syncs if any write did.
+	 *
+	 * Once the updates are in the batch, and before blocking, added is called
+	 * with the sequence number of the batch so that the caller can release
+	 * locks it only needed to prepare them.
+	 */
+	rocksdb::Status write( std::function<void(rocksdb::WriteBatch &)> const & add
+	                     , rocksdb::WriteOptions const &                     options
+	                     , std::function<void(uint64_t)> const &              added = nullptr );
+
+	/*
+	 * Adds updates to the open batch like write, but returns the sequence
+	 * number of the batch without waiting for it to commit. A failed commit
+	 * is only counted in the stats.
+	 */
+	uint64_t queue( std::function<void(rocksdb::WriteBatch &)> const & add
+	              , rocksdb::WriteOptions const &                     options );
+
+	// Blocks until the batch with the given sequence number is committed.
+	void wait_for(uint64_t sequence);
+
+private:
+	// Adds updates to the open batch, called with the mutex held.
+	std::shared_ptr<group> join( std::function<void(rocksdb::WriteBatch &)> const & add
+	                           , rocksdb::WriteOptions const &                     options );
+
+	void run();
+};
+
+} } // namespace
+
+#endif // QUITSIES_DB_WRITE_BATCHER
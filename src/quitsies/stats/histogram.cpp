@@ -0,0 +1,91 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <quitsies/stats/histogram.hpp>
+
+#include <cmath>
+#include <limits>
+
+using namespace quitsies::stats;
+
+const size_t histogram::sub_buckets;
+const size_t histogram::n_buckets;
+
+histogram::histogram()
+	: _count(0)
+{
+	for ( auto & bucket : _buckets ) {
+		bucket.store(0, std::memory_order_relaxed);
+	}
+}
+
+size_t
+histogram::bucket_of(uint64_t value) {
+	if ( value < 16 ) {
+		return static_cast<size_t>(value);
+	}
+	// The top bit picks the power of two, and the three bits below it the
+	// bucket within it.
+	size_t top = 63 - static_cast<size_t>(__builtin_clzll(value));
+	size_t sub = static_cast<size_t>(value >> (top - 3)) & (sub_buckets - 1);
+	return 16 + (top - 4) * sub_buckets + sub;
+}
+
+uint64_t
+histogram::bucket_max(size_t bucket) {
+	if ( bucket < 16 ) {
+		return bucket;
+	}
+	size_t top = (bucket - 16) / sub_buckets + 4;
+	uint64_t sub = (bucket - 16) % sub_buckets;
+	uint64_t width = uint64_t(1) << (top - 3);
+	uint64_t base = (uint64_t(1) << top) + sub * width;
+	if ( base > std::numeric_limits<uint64_t>::max() - (width - 1) ) {
+		return std::numeric_limits<uint64_t>::max();
+	}
+	return base + (width - 1);
+}
+
+uint64_t
+histogram::percentile(double percent) const {
+	uint64_t total = count();
+	if ( total == 0 ) {
+		return 0;
+	}
+
+	uint64_t rank = static_cast<uint64_t>(std::ceil(total * percent / 100.0));
+	if ( rank == 0 ) {
+		rank = 1;
+	}
+
+	uint64_t seen = 0;
+	for ( size_t i = 0; i < n_buckets; i++ ) {
+		seen += _buckets[i].load(std::memory_order_relaxed);
+		if ( seen >= rank ) {
+			return bucket_max(i);
+		}
+	}
+	// Values recorded while scanning may leave the rank out of reach.
+	return bucket_max(n_buckets - 1);
+}
@@ -0,0 +1,78 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef QUITSIES_STATS_HISTOGRAM
+#define QUITSIES_STATS_HISTOGRAM
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace quitsies { namespace stats {
+
+/*
+ * A histogram of values, such as latencies in microseconds, that threads can
+ * record into concurrently without locking.
+ *
+ * Values below 16 have buckets of their own. Above that every power of two is
+ * split into 8 buckets, so percentiles are reported within 12.5% of the true
+ * value. Recording a value is a single relaxed atomic increment.
+ */
+class histogram {
+public:
+	static const size_t sub_buckets = 8;
+	static const size_t n_buckets = 16 + (64 - 4) * sub_buckets;
+
+private:
+	std::array<std::atomic<uint64_t>, n_buckets> _buckets;
+	std::atomic<uint64_t>                        _count;
+
+public:
+	histogram(const histogram&) = delete;
+
+	histogram& operator=(const histogram&) = delete;
+
+	histogram();
+
+	void record(uint64_t value) {
+		_buckets[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+		_count.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	uint64_t count() const { return _count.load(std::memory_order_relaxed); }
+
+	/*
+	 * Returns the largest value of the bucket holding the given percentile,
+	 * e.g. 99.9, of the recorded values, or 0 if nothing is recorded.
+	 */
+	uint64_t percentile(double percent) const;
+
+	static size_t   bucket_of(uint64_t value);
+	static uint64_t bucket_max(size_t bucket);
+};
+
+} } // namespace
+
+#endif // QUITSIES_STATS_HISTOGRAM
@@ -0,0 +1,75 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <test/catch.hpp>
+
+#include <quitsies/stats/histogram.hpp>
+
+using namespace quitsies::stats;
+
+TEST_CASE("histogram buckets and percentiles", "[histogram]")
+{
+	SECTION("every value falls within its bucket")
+	{
+		for ( uint64_t value : { 0ull, 1ull, 15ull, 16ull, 17ull, 31ull, 32ull, 100ull, 1000ull, 123456789ull, ~0ull } ) {
+			size_t bucket = histogram::bucket_of(value);
+			INFO("value " << value);
+			REQUIRE(bucket < histogram::n_buckets);
+			CHECK(histogram::bucket_max(bucket) >= value);
+			if ( bucket > 0 ) {
+				CHECK(histogram::bucket_max(bucket - 1) < value);
+			}
+		}
+	}
+
+	SECTION("buckets are within an eighth of their values")
+	{
+		for ( uint64_t value = 16; value < 100000; value = value * 3 / 2 ) {
+			uint64_t error = histogram::bucket_max(histogram::bucket_of(value)) - value;
+			CHECK(error <= value / 8);
+		}
+	}
+
+	SECTION("percentiles of recorded values")
+	{
+		histogram h;
+		CHECK(h.percentile(50) == 0);
+
+		for ( uint64_t i = 1; i <= 1000; i++ ) {
+			h.record(i);
+		}
+		CHECK(h.count() == 1000);
+
+		uint64_t p50 = h.percentile(50);
+		CHECK(p50 >= 500);
+		CHECK(p50 <= 500 + 500 / 8);
+
+		uint64_t p99 = h.percentile(99);
+		CHECK(p99 >= 990);
+		CHECK(p99 <= 990 + 990 / 8);
+
+		CHECK(h.percentile(100) >= 1000);
+		CHECK(h.percentile(0) == 1);
+	}
+}
@@ -0,0 +1,545 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <quitsies/tcp/binary_request.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace quitsies::tcp;
+
+const uint8_t binary_request::request_magic;
+const uint8_t binary_request::response_magic;
+const size_t  binary_request::header_size;
+const size_t  binary_request::max_retained_bytes;
+
+uint16_t
+read_u16(const char * data) {
+	const unsigned char * d = reinterpret_cast<const unsigned char *>(data);
+	return static_cast<uint16_t>((d[0] << 8) | d[1]);
+}
+
+uint32_t
+read_u32(const char * data) {
+	const unsigned char * d = reinterpret_cast<const unsigned char *>(data);
+	return (static_cast<uint32_t>(d[0]) << 24)
+		| (static_cast<uint32_t>(d[1]) << 16)
+		| (static_cast<uint32_t>(d[2]) << 8)
+		| static_cast<uint32_t>(d[3]);
+}
+
+uint64_t
+read_u64(const char * data) {
+	return (static_cast<uint64_t>(read_u32(data)) << 32) | read_u32(data + 4);
+}
+
+void
+write_u16(std::string & out, uint16_t value) {
+	out.push_back(static_cast<char>(value >> 8));
+	out.push_back(static_cast<char>(value));
+}
+
+void
+write_u32(std::string & out, uint32_t value) {
+	write_u16(out, static_cast<uint16_t>(value >> 16));
+	write_u16(out, static_cast<uint16_t>(value));
+}
+
+void
+write_u64(std::string & out, uint64_t value) {
+	write_u32(out, static_cast<uint32_t>(value >> 32));
+	write_u32(out, static_cast<uint32_t>(value));
+}
+
+bool
+is_quiet(uint8_t opcode) {
+	switch ( opcode ) {
+	case binary_request::opcode_type::GETQ:
+	case binary_request::opcode_type::GETKQ:
+	case binary_request::opcode_type::SETQ:
+	case binary_request::opcode_type::ADDQ:
+	case binary_request::opcode_type::DELETEQ:
+	case binary_request::opcode_type::QUITQ:
+	case binary_request::opcode_type::GATQ:
+		return true;
+	}
+	return false;
+}
+
+void
+binary_request::respond( uint16_t            status
+                       , std::string const & extras
+                       , std::string const & key
+                       , std::string         value
+                       , uint64_t            cas )
+{
+	std::string head;
+	head.reserve(header_size + extras.size() + key.size());
+	head.push_back(static_cast<char>(response_magic));
+	head.push_back(static_cast<char>(_opcode));
+	write_u16(head, static_cast<uint16_t>(key.size()));
+	head.push_back(static_cast<char>(extras.size()));
+	head.push_back(0); // Data type
+	write_u16(head, status);
+	write_u32(head, static_cast<uint32_t>(extras.size() + key.size() + value.size()));
+	write_u32(head, _opaque);
+	write_u64(head, cas);
+	head.append(extras);
+	head.append(key);
+
+	_response.append(head);
+	_response.append_value(std::move(value));
+}
+
+void
+binary_request::parse_header() {
+	if ( static_cast<uint8_t>(_head[0]) != request_magic ) {
+		throw std::runtime_error("invalid magic");
+	}
+	_opcode = static_cast<uint8_t>(_head[1]);
+	_key_length = read_u16(&_head[2]);
+	_extras_length = static_cast<uint8_t>(_head[4]);
+	_body_length = read_u32(&_head[8]);
+	_opaque = read_u32(&_head[12]);
+	_cas = read_u64(&_head[16]);
+
+	if ( static_cast<size_t>(_key_length) + _extras_length > _body_length ) {
+		throw std::runtime_error("invalid body length");
+	}
+}
+
+void
+binary_request::parse_preamble() {
+	const char * extras = &_head[header_size];
+	_key.assign(extras + _extras_length, _key_length);
+	_remaining = _body_length - _extras_length - _key_length;
+
+	switch ( _opcode ) {
+	case opcode_type::SET:
+	case opcode_type::SETQ:
+	case opcode_type::ADD:
+	case opcode_type::ADDQ:
+		if ( _extras_length != 8 ) {
+			respond(response_status::INVALID_ARGUMENTS, "", "", "Invalid arguments");
+			_status = status_type::SWALLOW;
+			return;
+		}
+		_flags = read_u32(extras);
+		_exp_time = read_u32(extras + 4);
+		break;
+	case opcode_type::TOUCH:
+	case opcode_type::GAT:
+	case opcode_type::GATQ:
+		if ( _extras_length != 4 ) {
+			respond(response_status::INVALID_ARGUMENTS, "", "", "Invalid arguments");
+			_status = status_type::SWALLOW;
+			return;
+		}
+		_exp_time = read_u32(extras);
+		break;
+	}
+
+	if ( _max_bytes > 0 && _remaining > _max_bytes ) {
+		respond(response_status::VALUE_TOO_LARGE, "", "", "Too large.");
+		_status = status_type::SWALLOW;
+		return;
+	}
+
+	// Only reserve a bounded amount up front, the value grows as it arrives.
+	_value.reserve(std::min(static_cast<size_t>(_remaining), max_retained_bytes));
+	_status = status_type::DATA;
+}
+
+quitsies::db::item_meta
+binary_request::meta_to_store(db::durability * level) {
+	uint32_t flags = _flags;
+	auto requested = db::durability::DEFAULT;
+	if ( _durability_flags ) {
+		requested = db::durability_from_flags(&flags);
+	}
+	if ( level != nullptr ) {
+		*level = requested;
+	}
+	return db::item_meta(flags, db::exp_time_from_memcached(_exp_time, db::now_seconds()), _cas);
+}
+
+void
+binary_request::prepare_response() {
+	_status = status_type::FINISHED;
+
+	bool quiet = is_quiet(_opcode);
+	switch ( _opcode ) {
+	case opcode_type::NOOP:
+		respond(response_status::NO_ERROR);
+		return;
+	case opcode_type::QUIT:
+		respond(response_status::NO_ERROR);
+		_status = status_type::QUITTING;
+		return;
+	case opcode_type::QUITQ:
+		_status = status_type::QUITTING;
+		return;
+	}
+
+	if ( !_db ) {
+		respond(response_status::INTERNAL_ERROR, "", "", "The server isn't configured with a database");
+		return;
+	}
+
+	try {
+		switch ( _opcode ) {
+		case opcode_type::GET:
+		case opcode_type::GETQ:
+		case opcode_type::GETK:
+		case opcode_type::GETKQ:
+			{
+				bool with_key = _opcode == opcode_type::GETK || _opcode == opcode_type::GETKQ;
+
+				std::string value;
+				db::item_meta meta;
+				auto status = _db->get(_key, &value, &meta);
+				count_key(status);
+				if ( status.ok() ) {
+					std::string extras;
+					write_u32(extras, meta.flags);
+					respond(response_status::NO_ERROR, extras, with_key ? _key : "", std::move(value), meta.cas);
+				} else if ( status.is_not_found() ) {
+					// Quiet gets only respond on a hit.
+					if ( !quiet ) {
+						respond(response_status::KEY_NOT_FOUND, "", with_key ? _key : "", "Not found");
+					}
+				} else {
+					respond(response_status::INTERNAL_ERROR, "", "", status.to_string());
+				}
+			}
+			break;
+		case opcode_type::SET:
+		case opcode_type::SETQ:
+		case opcode_type::ADD:
+		case opcode_type::ADDQ:
+			{
+				bool is_add = _opcode == opcode_type::ADD || _opcode == opcode_type::ADDQ;
+
+				// A set that carries a cas unique is only applied if the item
+				// is unchanged.
+				uint64_t new_cas = 0;
+				db::durability level;
+				auto meta = meta_to_store(&level);
+				db::status status(false);
+				if ( is_add ) {
+					status = _db->add(_key, _value, meta, &new_cas, level);
+				} else if ( _cas != 0 ) {
+					status = _db->cas(_key, _value, meta, &new_cas, level);
+					count_key(status);
+				} else {
+					status = _db->put(_key, _value, meta, &new_cas, level);
+				}
+
+				if ( status.ok() ) {
+					if ( !quiet ) {
+						respond(response_status::NO_ERROR, "", "", "", new_cas);
+					}
+				} else if ( status.is_exists() ) {
+					respond(response_status::KEY_EXISTS, "", "", "Data exists for key.");
+				} else if ( status.is_not_found() ) {
+					respond(response_status::KEY_NOT_FOUND, "", "", "Not found");
+				} else {
+					respond(response_status::INTERNAL_ERROR, "", "", status.to_string());
+				}
+			}
+			break;
+		case opcode_type::DELETE:
+		case opcode_type::DELETEQ:
+			{
+				auto status = _db->del(_key);
+				count_key(status);
+				if ( status.is_not_found() ) {
+					respond(response_status::KEY_NOT_FOUND, "", "", "Not found");
+				} else if ( !status.ok() ) {
+					respond(response_status::INTERNAL_ERROR, "", "", status.to_string());
+				} else if ( !quiet ) {
+					respond(response_status::NO_ERROR);
+				}
+			}
+			break;
+		case opcode_type::TOUCH:
+		case opcode_type::GAT:
+		case opcode_type::GATQ:
+			{
+				bool with_value = _opcode != opcode_type::TOUCH;
+
+				std::string value;
+				db::item_meta meta;
+				auto status = _db->touch(_key, meta_to_store().exp_time, &value, &meta);
+				count_key(status);
+				if ( status.ok() ) {
+					std::string extras;
+					if ( with_value ) {
+						write_u32(extras, meta.flags);
+					} else {
+						value.clear();
+					}
+					respond(response_status::NO_ERROR, extras, "", std::move(value), meta.cas);
+				} else if ( status.is_not_found() ) {
+					if ( !quiet ) {
+						respond(response_status::KEY_NOT_FOUND, "", "", "Not found");
+					}
+				} else {
+					respond(response_status::INTERNAL_ERROR, "", "", status.to_string());
+				}
+			}
+			break;
+		default:
+			respond(response_status::UNKNOWN_COMMAND, "", "", "Unknown command");
+		}
+	} catch (std::exception & e) {
+		_response.clear();
+		respond(response_status::INTERNAL_ERROR, "", "", e.what());
+	}
+}
+
+size_t
+binary_request::process(const char * data, size_t length) {
+	const char * pos = data;
+	const char * end = data + length;
+	try {
+		while ( pos < end ) {
+			switch ( _status ) {
+			case status_type::COMMAND:
+				{
+					// Collect the header, and then the extras and key it describes.
+					size_t target = header_size;
+					if ( _head.size() >= header_size ) {
+						target += _extras_length + _key_length;
+					}
+					size_t n = std::min(target - _head.size(), static_cast<size_t>(end - pos));
+					_head.append(pos, n);
+					pos += n;
+
+					if ( _head.size() == header_size ) {
+						parse_header();
+					}
+					if ( _head.size() == header_size + _extras_length + _key_length ) {
+						parse_preamble();
+						if ( _status == status_type::DATA && _remaining == 0 ) {
+							command_ready();
+						}
+					}
+				}
+				break;
+			case status_type::DATA:
+				{
+					size_t n = std::min(_remaining, static_cast<size_t>(end - pos));
+					_value.append(pos, n);
+					_remaining -= n;
+					pos += n;
+					if ( _remaining == 0 ) {
+						command_ready();
+					}
+				}
+				break;
+			case status_type::SWALLOW:
+				{
+					size_t n = std::min(_remaining, static_cast<size_t>(end - pos));
+					_remaining -= n;
+					pos += n;
+					if ( _remaining == 0 ) {
+						_status = status_type::FINISHED;
+					}
+				}
+				break;
+			case status_type::DATA_END:
+			case status_type::FINISHED:
+			case status_type::QUITTING:
+			default:
+				// Anything following a complete command is left for the next
+				// request.
+				return pos - data;
+			}
+
+			if ( _status == status_type::SWALLOW && _remaining == 0 ) {
+				_status = status_type::FINISHED;
+			}
+		}
+	} catch (std::exception & e) {
+		// A malformed header leaves no way to find the next command.
+		_log->warn("closing binary protocol connection: {}", e.what());
+		_status = status_type::QUITTING;
+	}
+	return pos - data;
+}
+
+boost::asio::mutable_buffer
+binary_request::value_tail(size_t min_bytes) {
+	if ( _status != status_type::DATA || _remaining == 0 || _remaining < min_bytes ) {
+		return boost::asio::mutable_buffer();
+	}
+	size_t filled = _value.size();
+	_tail = std::min(_remaining, std::max(min_bytes, filled));
+	_value.resize(filled + _tail);
+	return boost::asio::buffer(&_value[filled], _tail);
+}
+
+void
+binary_request::fill_value(size_t length) {
+	// Drop the part of the tail that was not read.
+	_value.resize(_value.size() - (_tail - length));
+	_tail = 0;
+	_remaining -= length;
+	if ( _remaining == 0 ) {
+		command_ready();
+	}
+}
+
+bool
+binary_request::admit() {
+	if ( !_admission ) {
+		return true;
+	}
+
+	switch ( _opcode ) {
+	case opcode_type::GET:
+	case opcode_type::GETQ:
+	case opcode_type::GETK:
+	case opcode_type::GETKQ:
+		_ticket = _admission->admit_read();
+		break;
+	case opcode_type::SET:
+	case opcode_type::SETQ:
+	case opcode_type::ADD:
+	case opcode_type::ADDQ:
+	case opcode_type::DELETE:
+	case opcode_type::DELETEQ:
+	case opcode_type::TOUCH:
+	case opcode_type::GAT:
+	case opcode_type::GATQ:
+		_ticket = _admission->admit_write(_value.size());
+		break;
+	default:
+		// Commands that never reach the store are always answered.
+		return true;
+	}
+
+	if ( !_ticket ) {
+		// Even quiet commands are answered, so the client knows to retry.
+		respond(response_status::BUSY, "", "", "busy");
+		_status = status_type::FINISHED;
+		return false;
+	}
+	return true;
+}
+
+void
+binary_request::command_ready() {
+	if ( !admit() ) {
+		return;
+	}
+	if ( _command_stats && stats_command() != command_stats::N_COMMANDS ) {
+		_started = std::chrono::steady_clock::now();
+	}
+	if ( _deferred ) {
+		_status = status_type::EXECUTING;
+	} else {
+		prepare_response();
+		// The store is done with the command, whatever is left to write.
+		_ticket.release();
+	}
+}
+
+void
+binary_request::execute() {
+	prepare_response();
+	_ticket.release();
+}
+
+command_stats::command_type
+binary_request::stats_command() {
+	switch ( _opcode ) {
+	case opcode_type::GET:
+	case opcode_type::GETQ:
+	case opcode_type::GETK:
+	case opcode_type::GETKQ:
+		return command_stats::GET;
+	case opcode_type::SET:
+	case opcode_type::SETQ:
+		// Sets that carry a cas unique are counted as cas.
+		return _cas != 0 ? command_stats::CAS : command_stats::SET;
+	case opcode_type::ADD:
+	case opcode_type::ADDQ:
+		return command_stats::ADD;
+	case opcode_type::DELETE:
+	case opcode_type::DELETEQ:
+		return command_stats::DELETE;
+	case opcode_type::TOUCH:
+		return command_stats::TOUCH;
+	case opcode_type::GAT:
+	case opcode_type::GATQ:
+		return command_stats::GAT;
+	default:
+		return command_stats::N_COMMANDS;
+	}
+}
+
+void
+binary_request::count_key(db::status & status) {
+	if ( !_command_stats ) {
+		return;
+	}
+	auto command = stats_command();
+	if ( command == command_stats::N_COMMANDS ) {
+		return;
+	}
+	_command_stats->key(command);
+	if ( status.ok() || status.is_not_found() ) {
+		_command_stats->hit(command, status.ok());
+	}
+}
+
+void
+binary_request::record_latency() {
+	if ( _started == std::chrono::steady_clock::time_point() ) {
+		return;
+	}
+	if ( _status == status_type::EXECUTING ) {
+		// A deferred command that was dropped without being run.
+		_started = std::chrono::steady_clock::time_point();
+		return;
+	}
+	_command_stats->record(stats_command(), std::chrono::steady_clock::now() - _started);
+	_started = std::chrono::steady_clock::time_point();
+}
+
+std::string
+binary_request::get_response() {
+	if ( _status != status_type::FINISHED && _status != status_type::QUITTING ) {
+		throw std::runtime_error("request not fully parsed");
+	}
+	return _response.str();
+}
+
+void
+binary_request::take_response(response & out) {
+	out.splice(_response);
+}
@@ -0,0 +1,247 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef QUITSIES_BINARY_REQUEST_HPP
+#define QUITSIES_BINARY_REQUEST_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include <quitsies/tcp/protocol.hpp>
+#include <quitsies/tcp/command_stats.hpp>
+#include <quitsies/db/store.hpp>
+#include <quitsies/log/logger.hpp>
+#include <quitsies/stats/aggregator.hpp>
+
+namespace quitsies { namespace tcp {
+
+/*
+ * Parses and responds to commands of the memcached binary protocol.
+ *
+ * Every binary command begins with a fixed size header describing the length
+ * of its extras, key and value, so no tokenising is required. The header and
+ * the key are collected into a small buffer and the value is appended straight
+ * into the string handed to the store.
+ */
+class binary_request : public protocol {
+public:
+	// The first byte of every binary protocol request.
+	static const uint8_t request_magic = 0x80;
+	static const uint8_t response_magic = 0x81;
+
+	static const size_t header_size = 24;
+
+	enum opcode_type {
+		GET    = 0x00,
+		SET    = 0x01,
+		ADD    = 0x02,
+		DELETE = 0x04,
+		QUIT   = 0x07,
+		GETQ   = 0x09,
+		NOOP   = 0x0a,
+		GETK   = 0x0c,
+		GETKQ  = 0x0d,
+		SETQ   = 0x11,
+		ADDQ   = 0x12,
+		DELETEQ = 0x14,
+		QUITQ  = 0x17,
+		TOUCH  = 0x1c,
+		GAT    = 0x1d,
+		GATQ   = 0x1e
+	};
+
+	enum response_status {
+		NO_ERROR          = 0x0000,
+		KEY_NOT_FOUND     = 0x0001,
+		KEY_EXISTS        = 0x0002,
+		VALUE_TOO_LARGE   = 0x0003,
+		INVALID_ARGUMENTS = 0x0004,
+		ITEM_NOT_STORED   = 0x0005,
+		UNKNOWN_COMMAND   = 0x0081,
+		INTERNAL_ERROR    = 0x0084,
+		BUSY              = 0x0085
+	};
+
+private:
+	db::store_ptr         _db;
+	log::logger           _log;
+	stats::aggregator_ptr _stats;
+	size_t                _max_bytes;
+	status_type           _status;
+	bool                  _deferred;
+	bool                  _durability_flags;
+	db::admission_ptr     _admission;
+	db::admission::ticket _ticket;
+	command_stats_ptr     _command_stats;
+	std::string           _head;
+	std::string           _value;
+	response              _response;
+
+	uint8_t     _opcode;
+	uint16_t    _key_length;
+	uint8_t     _extras_length;
+	uint32_t    _body_length;
+	uint32_t    _opaque;
+	uint64_t    _cas;
+	std::string _key;
+	uint32_t    _flags;
+	uint32_t    _exp_time;
+	size_t      _remaining;
+	size_t      _tail;
+
+	// When the command was ready, while its latency is being timed.
+	std::chrono::steady_clock::time_point _started;
+
+public:
+	binary_request(const binary_request&) = delete;
+
+	binary_request& operator=(const binary_request&) = delete;
+
+	explicit binary_request( db::store_ptr         db
+	                       , log::logger           log
+	                       , stats::aggregator_ptr stats
+	                       , size_t                max_bytes )
+		: _db(db)
+		, _log(log)
+		, _stats(stats)
+		, _max_bytes(max_bytes)
+		, _status(status_type::COMMAND)
+		, _deferred(false)
+		, _durability_flags(false)
+		, _admission()
+		, _ticket()
+		, _command_stats()
+		, _head()
+		, _value()
+		, _response()
+		, _opcode(0)
+		, _key_length(0)
+		, _extras_length(0)
+		, _body_length(0)
+		, _opaque(0)
+		, _cas(0)
+		, _key()
+		, _flags(0)
+		, _exp_time(0)
+		, _remaining(0)
+		, _tail(0)
+		, _started()
+	{}
+
+	status_type get_status()   { return _status; }
+	uint8_t     get_opcode()   { return _opcode; }
+	uint32_t    get_opaque()   { return _opaque; }
+	std::string get_key()      { return _key; }
+	uint32_t    get_flags()    { return _flags; }
+	uint32_t    get_exp_time() { return _exp_time; }
+	std::string copy_buffer()  { return _value; }
+
+	// Quiet commands that succeed produce no response at all.
+	bool get_no_reply() { return _response.empty(); }
+
+	size_t process(const char * data, size_t length);
+
+	boost::asio::mutable_buffer value_tail(size_t min_bytes);
+	void fill_value(size_t length);
+
+	bool idle() { return _status == status_type::COMMAND && _head.empty(); }
+
+	void set_deferred(bool deferred) { _deferred = deferred; }
+	void execute();
+
+	void set_admission(db::admission_ptr admission) { _admission = admission; }
+
+	void set_command_stats(command_stats_ptr command_stats) { _command_stats = command_stats; }
+
+	void set_durability_flags(bool enabled) { _durability_flags = enabled; }
+
+	void reset() {
+		record_latency();
+		_status = status_type::COMMAND;
+		// Commands that ran have already released their place.
+		_ticket.release();
+		_head.clear();
+		if ( _value.capacity() > max_retained_bytes ) {
+			std::string().swap(_value);
+		} else {
+			_value.clear();
+		}
+		_response.clear();
+		_opcode = 0;
+		_key_length = 0;
+		_extras_length = 0;
+		_body_length = 0;
+		_opaque = 0;
+		_cas = 0;
+		_key.clear();
+		_flags = 0;
+		_exp_time = 0;
+		_remaining = 0;
+		_tail = 0;
+	}
+
+	std::string get_response();
+	void take_response(response & out);
+
+	// Binary responses are always prepared in full.
+	void resume() {}
+
+private:
+	// Value buffers larger than this are released between requests.
+	static const size_t max_retained_bytes = 1 << 16;
+
+	void parse_header();
+	void parse_preamble();
+	// Prepares the response now, or leaves it to execute when deferred.
+	void command_ready();
+	// Takes a place for the command, or answers it as busy when shed.
+	bool admit();
+	void prepare_response();
+
+	// The kind of the command as counted by the command stats, or N_COMMANDS
+	// for commands that are not counted.
+	command_stats::command_type stats_command();
+	// Counts the key looked up by the command, and whether it was a hit or a
+	// miss unless the lookup failed.
+	void count_key(db::status & status);
+	// Records the latency of a timed command once it is answered.
+	void record_latency();
+
+	// The metadata to store with the value of a set. When durability flags are
+	// enabled their bits are removed and the level they select is written to
+	// level when given.
+	db::item_meta meta_to_store(db::durability * level = nullptr);
+
+	void respond( uint16_t            status
+	            , std::string const & extras = ""
+	            , std::string const & key = ""
+	            , std::string         value = ""
+	            , uint64_t            cas = 0 );
+};
+
+} } // tcp, quitsies
+
+#endif // QUITSIES_BINARY_REQUEST_HPP
@@ -0,0 +1,396 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <test/catch.hpp>
+
+#include <quitsies/tcp/binary_request.hpp>
+#include <quitsies/stats/aggregator.hpp>
+#include <quitsies/stats/null_aggregator.hpp>
+
+#include <quitsies/tcp/connection.hpp>
+#include <quitsies/tcp/connection_manager.hpp>
+#include <quitsies/db/executor.hpp>
+
+#include <poll.h>
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+using namespace quitsies::tcp;
+using namespace quitsies::stats;
+
+auto mock_stats = aggregator_ptr(new null_aggregator());
+auto mock_logger = quitsies::log::create("quitsies_binary_test", "off");
+
+std::string
+make_packet( uint8_t             opcode
+           , std::string const & extras
+           , std::string const & key
+           , std::string const & value
+           , uint32_t            opaque = 0 )
+{
+	uint32_t body = extras.size() + key.size() + value.size();
+	std::string packet = {{
+		static_cast<char>(0x80),
+		static_cast<char>(opcode),
+		static_cast<char>(key.size() >> 8),
+		static_cast<char>(key.size()),
+		static_cast<char>(extras.size()),
+		0, 0, 0,
+		static_cast<char>(body >> 24),
+		static_cast<char>(body >> 16),
+		static_cast<char>(body >> 8),
+		static_cast<char>(body),
+		static_cast<char>(opaque >> 24),
+		static_cast<char>(opaque >> 16),
+		static_cast<char>(opaque >> 8),
+		static_cast<char>(opaque),
+		0, 0, 0, 0, 0, 0, 0, 0
+	}};
+	return packet + extras + key + value;
+}
+
+TEST_CASE("binary request parser can parse memcached binary requests", "[binary_request_parser]")
+{
+	std::string set_extras = {{ 0, 0, 0, 7, 0, 0, 0, 30 }};
+
+	SECTION("check parse set command")
+	{
+		std::string cmd = make_packet(binary_request::opcode_type::SET, set_extras, "key1", "hello");
+
+		binary_request req(NULL, mock_logger, mock_stats, 0);
+		CHECK(req.process(cmd.c_str(), cmd.length()) == cmd.length());
+
+		CHECK(req.get_status() == binary_request::status_type::FINISHED);
+		CHECK(req.get_opcode() == binary_request::opcode_type::SET);
+		CHECK(req.get_key() == "key1");
+		CHECK(req.get_flags() == 7);
+		CHECK(req.get_exp_time() == 30);
+		CHECK(req.copy_buffer() == "hello");
+	}
+
+	SECTION("check command split at every byte")
+	{
+		std::string cmd = make_packet(binary_request::opcode_type::SETQ, set_extras, "key1", "hello world");
+
+		binary_request req(NULL, mock_logger, mock_stats, 0);
+		CHECK(req.idle());
+		for ( size_t i = 0; i < cmd.length(); i++ ) {
+			INFO("Offset: " << i);
+			CHECK(req.get_status() != binary_request::status_type::FINISHED);
+			req.process(cmd.c_str() + i, 1);
+			CHECK_FALSE(req.idle());
+		}
+
+		CHECK(req.get_status() == binary_request::status_type::FINISHED);
+		CHECK(req.get_key() == "key1");
+		CHECK(req.copy_buffer() == "hello world");
+
+		req.reset();
+		CHECK(req.idle());
+	}
+
+	SECTION("check noop response")
+	{
+		std::string cmd = make_packet(binary_request::opcode_type::NOOP, "", "", "", 0x01020304);
+
+		binary_request req(NULL, mock_logger, mock_stats, 0);
+		req.process(cmd.c_str(), cmd.length());
+
+		CHECK(req.get_status() == binary_request::status_type::FINISHED);
+		CHECK(req.get_no_reply() == false);
+
+		auto res = req.get_response();
+		REQUIRE(res.length() == binary_request::header_size);
+		CHECK(static_cast<uint8_t>(res[0]) == binary_request::response_magic);
+		CHECK(res[1] == binary_request::opcode_type::NOOP);
+		CHECK(res.substr(12, 4) == std::string("\x01\x02\x03\x04"));
+	}
+
+	SECTION("check pipelined commands")
+	{
+		std::string cmd = make_packet(binary_request::opcode_type::GETKQ, "", "key1", "")
+			+ make_packet(binary_request::opcode_type::GETKQ, "", "key2", "")
+			+ make_packet(binary_request::opcode_type::NOOP, "", "", "");
+
+		binary_request req(NULL, mock_logger, mock_stats, 0);
+		const char * data = cmd.c_str();
+		size_t length = cmd.length();
+		for ( int i = 0; i < 3; i++ ) {
+			size_t consumed = req.process(data, length);
+			data += consumed;
+			length -= consumed;
+
+			CHECK(req.get_status() == binary_request::status_type::FINISHED);
+			req.reset();
+		}
+		CHECK(length == 0);
+	}
+
+	SECTION("check deferred commands wait to be executed")
+	{
+		std::string cmd = make_packet(binary_request::opcode_type::SET, set_extras, "key1", "hello")
+			+ make_packet(binary_request::opcode_type::NOOP, "", "", "");
+
+		binary_request req(NULL, mock_logger, mock_stats, 0);
+		req.set_deferred(true);
+		size_t consumed = req.process(cmd.c_str(), cmd.length());
+		CHECK(req.get_status() == binary_request::status_type::EXECUTING);
+		req.execute();
+		CHECK(req.get_status() == binary_request::status_type::FINISHED);
+		req.reset();
+
+		req.process(cmd.c_str() + consumed, cmd.length() - consumed);
+		CHECK(req.get_status() == binary_request::status_type::EXECUTING);
+		req.execute();
+		CHECK(req.get_status() == binary_request::status_type::FINISHED);
+		CHECK(req.get_opcode() == binary_request::opcode_type::NOOP);
+	}
+
+	SECTION("check dropped deferred commands record no latency")
+	{
+		std::string cmd = make_packet(binary_request::opcode_type::SET, set_extras, "key1", "hello");
+		auto counters = command_stats_ptr(new command_stats());
+
+		binary_request req(NULL, mock_logger, mock_stats, 0);
+		req.set_deferred(true);
+		req.set_command_stats(counters);
+
+		req.process(cmd.c_str(), cmd.length());
+		CHECK(req.get_status() == binary_request::status_type::EXECUTING);
+		req.reset();
+		CHECK(counters->count(command_stats::SET) == 0);
+
+		req.process(cmd.c_str(), cmd.length());
+		req.execute();
+		req.reset();
+		CHECK(counters->count(command_stats::SET) == 1);
+	}
+
+	SECTION("check commands over the admission limits are shed")
+	{
+		auto admission = std::make_shared<quitsies::db::admission>(1, 1, 0, mock_stats);
+		auto held = admission->admit_read();
+
+		std::string cmd = make_packet(binary_request::opcode_type::SETQ, set_extras, "key1", "hello", 9);
+
+		binary_request req(NULL, mock_logger, mock_stats, 0);
+		req.set_admission(admission);
+		req.process(cmd.c_str(), cmd.length());
+		CHECK(req.get_status() == binary_request::status_type::FINISHED);
+		CHECK(req.get_no_reply() == false);
+
+		std::string res = req.get_response();
+		REQUIRE(res.length() == binary_request::header_size + 4);
+		CHECK(static_cast<uint8_t>(res[7]) == binary_request::response_status::BUSY);
+		CHECK(res.substr(binary_request::header_size) == "busy");
+		req.reset();
+
+		// No-ops never reach the store.
+		cmd = make_packet(binary_request::opcode_type::NOOP, "", "", "");
+		req.process(cmd.c_str(), cmd.length());
+		CHECK(req.get_status() == binary_request::status_type::FINISHED);
+		CHECK(static_cast<uint8_t>(req.get_response()[7]) == binary_request::response_status::NO_ERROR);
+	}
+
+	SECTION("check quit commands")
+	{
+		std::string cmd = make_packet(binary_request::opcode_type::QUIT, "", "", "");
+
+		binary_request req(NULL, mock_logger, mock_stats, 0);
+		req.process(cmd.c_str(), cmd.length());
+		CHECK(req.get_status() == binary_request::status_type::QUITTING);
+		CHECK(req.get_no_reply() == false);
+
+		cmd = make_packet(binary_request::opcode_type::QUITQ, "", "", "");
+
+		binary_request quiet(NULL, mock_logger, mock_stats, 0);
+		quiet.process(cmd.c_str(), cmd.length());
+		CHECK(quiet.get_status() == binary_request::status_type::QUITTING);
+		CHECK(quiet.get_no_reply() == true);
+	}
+
+	SECTION("check value read directly into the request")
+	{
+		std::string value(1000, 'x');
+		std::string cmd = make_packet(binary_request::opcode_type::SET, set_extras, "key1", value);
+		size_t head = cmd.length() - value.length() + 10;
+
+		binary_request req(NULL, mock_logger, mock_stats, 0);
+		CHECK(req.process(cmd.c_str(), head) == head);
+		CHECK(boost::asio::buffer_size(req.value_tail(1000)) == 0);
+
+		// Each step is as large as the value received so far.
+		std::vector<size_t> steps = {{ 300, 310, 380 }};
+		size_t filled = 10;
+		for ( auto step : steps ) {
+			auto tail = req.value_tail(300);
+			REQUIRE(boost::asio::buffer_size(tail) == step);
+			std::memcpy(boost::asio::buffer_cast<char *>(tail), value.c_str() + filled, step);
+			req.fill_value(step);
+			filled += step;
+		}
+
+		CHECK(req.get_status() == binary_request::status_type::FINISHED);
+		CHECK(req.copy_buffer() == value);
+	}
+
+	SECTION("check deferred value read directly waits to be executed")
+	{
+		std::string value(1000, 'x');
+		std::string cmd = make_packet(binary_request::opcode_type::SET, set_extras, "key1", value);
+		size_t head = cmd.length() - value.length();
+
+		binary_request req(NULL, mock_logger, mock_stats, 0);
+		req.set_deferred(true);
+		CHECK(req.process(cmd.c_str(), head) == head);
+
+		size_t filled = 0;
+		while ( filled < 1000 ) {
+			auto tail = req.value_tail(100);
+			size_t step = boost::asio::buffer_size(tail);
+			REQUIRE(step > 0);
+			std::memcpy(boost::asio::buffer_cast<char *>(tail), value.c_str() + filled, step);
+			req.fill_value(step);
+			filled += step;
+		}
+
+		CHECK(req.get_status() == binary_request::status_type::EXECUTING);
+		req.execute();
+		CHECK(req.get_status() == binary_request::status_type::FINISHED);
+		CHECK(req.copy_buffer() == value);
+	}
+
+	SECTION("check oversized value is skipped")
+	{
+		std::string cmd = make_packet(binary_request::opcode_type::SET, set_extras, "key1", "hello world")
+			+ make_packet(binary_request::opcode_type::NOOP, "", "", "");
+
+		binary_request req(NULL, mock_logger, mock_stats, 10);
+		size_t consumed = req.process(cmd.c_str(), cmd.length());
+		CHECK(req.get_status() == binary_request::status_type::FINISHED);
+		CHECK(req.get_response()[7] == binary_request::response_status::VALUE_TOO_LARGE);
+		req.reset();
+
+		req.process(cmd.c_str() + consumed, cmd.length() - consumed);
+		CHECK(req.get_status() == binary_request::status_type::FINISHED);
+		CHECK(req.get_opcode() == binary_request::opcode_type::NOOP);
+	}
+
+	SECTION("check oversized value header is rejected")
+	{
+		std::string cmd = make_packet(binary_request::opcode_type::SET, set_extras, "key1", "");
+		// Declare a body of just under 4GB without sending any of it.
+		cmd[8] = static_cast<char>(0xee);
+
+		binary_request req(NULL, mock_logger, mock_stats, 1 << 20);
+		req.process(cmd.c_str(), cmd.length());
+		CHECK(req.get_status() != binary_request::status_type::DATA);
+		CHECK(boost::asio::buffer_size(req.value_tail(1024)) == 0);
+	}
+
+	SECTION("check declared value length is not allocated up front")
+	{
+		std::string cmd = make_packet(binary_request::opcode_type::SET, set_extras, "key1", "");
+		// Declare a body of just under 4GB without sending any of it.
+		cmd[8] = static_cast<char>(0xee);
+
+		binary_request req(NULL, mock_logger, mock_stats, 0);
+		CHECK(req.process(cmd.c_str(), cmd.length()) == cmd.length());
+		CHECK(req.get_status() == binary_request::status_type::DATA);
+
+		auto tail = req.value_tail(1024);
+		CHECK(boost::asio::buffer_size(tail) == 1024);
+		req.fill_value(0);
+		CHECK(req.copy_buffer().empty());
+	}
+
+	SECTION("check invalid magic closes the connection")
+	{
+		std::string cmd = make_packet(binary_request::opcode_type::NOOP, "", "", "");
+		cmd[0] = 0x42;
+
+		binary_request req(NULL, mock_logger, mock_stats, 0);
+		req.process(cmd.c_str(), cmd.length());
+		CHECK(req.get_status() == binary_request::status_type::QUITTING);
+	}
+}
+
+TEST_CASE("connections execute deferred binary values read directly", "[binary_request_parser]")
+{
+	boost::asio::io_service io_service;
+	timer_wheel wheel(50, 8);
+	connection_manager manager;
+	buffer_pool_ptr buffers(new buffer_pool(1024, 4096, 4));
+	auto executor = quitsies::db::executor_ptr(new quitsies::db::executor(1));
+
+	boost::asio::local::stream_protocol::socket server_side(io_service);
+	boost::asio::local::stream_protocol::socket client(io_service);
+	boost::asio::local::connect_pair(server_side, client);
+
+	manager.start(std::make_shared<connection>( io_service
+	                                          , stream_socket(std::move(server_side))
+	                                          , manager
+	                                          , wheel
+	                                          , quitsies::db::store_ptr()
+	                                          , mock_logger
+	                                          , mock_stats
+	                                          , buffers
+	                                          , executor
+	                                          , quitsies::db::admission_ptr()
+	                                          , command_stats_ptr()
+	                                          , connection_limiter::slot()
+	                                          , 0, 0, 0, 0 ));
+	// Nothing is pending on the io_service while a command is executed.
+	boost::asio::io_service::work work(io_service);
+	std::thread runner([&io_service]() { io_service.run(); });
+
+	// The value is sent after the header has been read, and is larger than
+	// the read buffer, so it is read straight into the request.
+	std::string value(8192, 'x');
+	std::string extras(8, '\0');
+	std::string cmd = make_packet(binary_request::opcode_type::SET, extras, "key1", value);
+	size_t head = cmd.length() - value.length();
+	boost::asio::write(client, boost::asio::buffer(cmd.data(), head));
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	boost::asio::write(client, boost::asio::buffer(cmd.data() + head, value.length()));
+
+	// Fail rather than hang if the response never comes.
+	pollfd readable = {client.native_handle(), POLLIN, 0};
+	bool responded = ::poll(&readable, 1, 5000) == 1;
+	CHECK(responded);
+	if ( responded ) {
+		char response[binary_request::header_size];
+		boost::system::error_code ec;
+		boost::asio::read(client, boost::asio::buffer(response), ec);
+		CHECK_FALSE(ec);
+		CHECK(static_cast<uint8_t>(response[0]) == binary_request::response_magic);
+	}
+
+	io_service.stop();
+	runner.join();
+	manager.stop_all();
+}
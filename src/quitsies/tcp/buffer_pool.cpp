@@ -0,0 +1,113 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <quitsies/tcp/buffer_pool.hpp>
+
+using namespace quitsies::tcp;
+
+namespace quitsies { namespace tcp {
+
+size_t
+round_up_pow2(size_t size)
+{
+	size_t rounded = 1;
+	while ( rounded < size ) {
+		rounded <<= 1;
+	}
+	return rounded;
+}
+
+} } // tcp, quitsies
+
+buffer_pool::buffer_pool(size_t min_size, size_t max_size, size_t max_free)
+	: _min_size(round_up_pow2(min_size))
+	, _max_size(round_up_pow2(max_size))
+	, _max_free(max_free)
+	, _mutex()
+	, _free()
+{
+	if ( _max_size < _min_size ) {
+		_max_size = _min_size;
+	}
+	_free.resize(class_of(_max_size) + 1);
+}
+
+buffer_pool::~buffer_pool()
+{
+	for ( auto & list : _free ) {
+		for ( auto data : list ) {
+			delete[] data;
+		}
+	}
+}
+
+size_t
+buffer_pool::class_of(size_t size) const
+{
+	size_t index = 0;
+	for ( size_t class_size = _min_size; class_size < size; class_size <<= 1 ) {
+		index++;
+	}
+	return index;
+}
+
+char *
+buffer_pool::acquire(size_t size, size_t * capacity)
+{
+	if ( size < _min_size ) {
+		size = _min_size;
+	} else if ( size > _max_size ) {
+		size = _max_size;
+	}
+
+	size_t index = class_of(size);
+	*capacity = _min_size << index;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto & list = _free[index];
+		if ( !list.empty() ) {
+			char * data = list.back();
+			list.pop_back();
+			return data;
+		}
+	}
+	return new char[*capacity];
+}
+
+void
+buffer_pool::release(char * data, size_t capacity)
+{
+	if ( data == nullptr ) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto & list = _free[class_of(capacity)];
+		if ( list.size() < _max_free ) {
+			list.push_back(data);
+			return;
+		}
+	}
+	delete[] data;
+}
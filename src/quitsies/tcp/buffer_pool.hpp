@@ -0,0 +1,126 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef QUITSIES_BUFFER_POOL_HPP
+#define QUITSIES_BUFFER_POOL_HPP
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace quitsies { namespace tcp {
+
+/*
+ * A pool of read buffers shared by the connections of a server.
+ *
+ * Buffers come in power of two size classes between a minimum and maximum
+ * size. Released buffers are kept on a free list for their class, so that
+ * connections growing and shrinking their buffers reuse memory rather than
+ * going back to the heap for every change.
+ */
+class buffer_pool {
+	size_t                          _min_size;
+	size_t                          _max_size;
+	size_t                          _max_free;
+	std::mutex                      _mutex;
+	std::vector<std::vector<char*>> _free;
+
+public:
+	buffer_pool(const buffer_pool&) = delete;
+
+	buffer_pool& operator=(const buffer_pool&) = delete;
+
+	/*
+	 * Constructs a pool of buffers from min_size to max_size bytes, both are
+	 * rounded up to a power of two. At most max_free released buffers are kept
+	 * for each size class.
+	 */
+	buffer_pool(size_t min_size, size_t max_size, size_t max_free);
+
+	~buffer_pool();
+
+	size_t min_size() const { return _min_size; }
+	size_t max_size() const { return _max_size; }
+
+	/*
+	 * Takes a buffer of at least size bytes, clamped to the sizes of the pool.
+	 * The real size of the buffer is written to capacity.
+	 */
+	char * acquire(size_t size, size_t * capacity);
+
+	// Returns a buffer taken from this pool with its capacity.
+	void release(char * data, size_t capacity);
+
+private:
+	size_t class_of(size_t size) const;
+};
+
+typedef std::shared_ptr<buffer_pool> buffer_pool_ptr;
+
+/*
+ * A buffer taken from a pool, and returned to it when destroyed.
+ */
+class pooled_buffer {
+	buffer_pool_ptr _pool;
+	char *          _data;
+	size_t          _size;
+
+public:
+	pooled_buffer(const pooled_buffer&) = delete;
+
+	pooled_buffer& operator=(const pooled_buffer&) = delete;
+
+	pooled_buffer(buffer_pool_ptr pool, size_t size)
+		: _pool(pool)
+		, _data(nullptr)
+		, _size(0)
+	{
+		_data = _pool->acquire(size, &_size);
+	}
+
+	~pooled_buffer() {
+		_pool->release(_data, _size);
+	}
+
+	char *        data()       { return _data; }
+	size_t        size() const { return _size; }
+	buffer_pool & pool()       { return *_pool; }
+
+	/*
+	 * Swaps the buffer for one of a different size class, the contents are not
+	 * kept.
+	 */
+	void resize(size_t size) {
+		size_t capacity = 0;
+		char * data = _pool->acquire(size, &capacity);
+		_pool->release(_data, _size);
+		_data = data;
+		_size = capacity;
+	}
+};
+
+} } // tcp, quitsies
+
+#endif // QUITSIES_BUFFER_POOL_HPP
@@ -0,0 +1,66 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <test/catch.hpp>
+
+#include <quitsies/tcp/buffer_pool.hpp>
+
+using namespace quitsies::tcp;
+
+TEST_CASE("buffer pool hands out size classes and reuses them", "[buffer_pool]")
+{
+	auto pool = std::make_shared<buffer_pool>(8 << 10, 256 << 10, 2);
+
+	SECTION("sizes are rounded up to a class and clamped to the pool")
+	{
+		CHECK(pooled_buffer(pool, 1).size() == (8 << 10));
+		CHECK(pooled_buffer(pool, (8 << 10) + 1).size() == (16 << 10));
+		CHECK(pooled_buffer(pool, 64 << 10).size() == (64 << 10));
+		CHECK(pooled_buffer(pool, 1 << 20).size() == (256 << 10));
+	}
+
+	SECTION("released buffers are reused")
+	{
+		char * first = nullptr;
+		{
+			pooled_buffer buffer(pool, 16 << 10);
+			first = buffer.data();
+		}
+		pooled_buffer buffer(pool, 16 << 10);
+		CHECK(buffer.data() == first);
+	}
+
+	SECTION("resizing swaps the buffer for another class")
+	{
+		pooled_buffer buffer(pool, 8 << 10);
+		char * small = buffer.data();
+
+		buffer.resize(buffer.size() * 2);
+		CHECK(buffer.size() == (16 << 10));
+
+		buffer.resize(buffer.size() / 2);
+		CHECK(buffer.size() == (8 << 10));
+		CHECK(buffer.data() == small);
+	}
+}
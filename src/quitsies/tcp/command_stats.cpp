@@ -0,0 +1,124 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <quitsies/tcp/command_stats.hpp>
+
+#include <string>
+
+#include <unistd.h>
+
+namespace quitsies { namespace tcp {
+
+namespace {
+
+void
+stat(std::ostream & out, const char * name, uint64_t value) {
+	out << "STAT " << name << " " << value << "\r\n";
+}
+
+} // namespace
+
+command_stats::command_stats()
+	: _commands()
+	, _bytes_read(0)
+	, _bytes_written(0)
+	, _curr_connections(0)
+	, _total_connections(0)
+	, _started(std::chrono::steady_clock::now())
+{}
+
+const char *
+command_stats::name(command_type command) {
+	switch ( command ) {
+	case GET:     return "get";
+	case GETS:    return "gets";
+	case GAT:     return "gat";
+	case GATS:    return "gats";
+	case TOUCH:   return "touch";
+	case SET:     return "set";
+	case ADD:     return "add";
+	case CAS:     return "cas";
+	case APPEND:  return "append";
+	case PREPEND: return "prepend";
+	case INCR:    return "incr";
+	case DECR:    return "decr";
+	case DELETE:  return "delete";
+	case MG:      return "mg";
+	case MS:      return "ms";
+	case MD:      return "md";
+	default:      return "unknown";
+	}
+}
+
+void
+command_stats::report(std::ostream & out) const {
+	auto uptime = std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::steady_clock::now() - _started).count();
+
+	// Like memcached, gat and gats count as both gets and touches.
+	uint64_t get_hits = hits(GET) + hits(GETS) + hits(GAT) + hits(GATS) + hits(MG);
+	uint64_t get_misses = misses(GET) + misses(GETS) + misses(GAT) + misses(GATS) + misses(MG);
+
+	stat(out, "pid", static_cast<uint64_t>(::getpid()));
+	stat(out, "uptime", static_cast<uint64_t>(uptime));
+	stat(out, "time", static_cast<uint64_t>(std::time(nullptr)));
+	stat(out, "curr_connections", _curr_connections.load(std::memory_order_relaxed));
+	stat(out, "total_connections", _total_connections.load(std::memory_order_relaxed));
+	// As in memcached, gets and touches are counted per key.
+	stat(out, "cmd_get", keys(GET) + keys(GETS) + keys(GAT) + keys(GATS) + keys(MG));
+	stat(out, "cmd_set", count(SET) + count(ADD) + count(CAS) + count(APPEND) + count(PREPEND) + count(MS));
+	stat(out, "cmd_touch", keys(TOUCH) + keys(GAT) + keys(GATS));
+	stat(out, "get_hits", get_hits);
+	stat(out, "get_misses", get_misses);
+	stat(out, "delete_hits", hits(DELETE) + hits(MD));
+	stat(out, "delete_misses", misses(DELETE) + misses(MD));
+	stat(out, "incr_hits", hits(INCR));
+	stat(out, "incr_misses", misses(INCR));
+	stat(out, "decr_hits", hits(DECR));
+	stat(out, "decr_misses", misses(DECR));
+	stat(out, "cas_hits", hits(CAS));
+	stat(out, "cas_misses", misses(CAS));
+	stat(out, "touch_hits", hits(TOUCH) + hits(GAT) + hits(GATS));
+	stat(out, "touch_misses", misses(TOUCH) + misses(GAT) + misses(GATS));
+	stat(out, "bytes_read", _bytes_read.load(std::memory_order_relaxed));
+	stat(out, "bytes_written", _bytes_written.load(std::memory_order_relaxed));
+}
+
+void
+command_stats::report_latency(std::ostream & out) const {
+	for ( size_t i = 0; i < N_COMMANDS; i++ ) {
+		auto & latency = _commands[i].latency;
+		if ( latency.count() == 0 ) {
+			continue;
+		}
+		std::string prefix = std::string("STAT ") + name(static_cast<command_type>(i)) + ":";
+		out << prefix << "count " << latency.count() << "\r\n"
+		    << prefix << "p50_us " << latency.percentile(50) << "\r\n"
+		    << prefix << "p99_us " << latency.percentile(99) << "\r\n"
+		    << prefix << "p999_us " << latency.percentile(99.9) << "\r\n";
+	}
+}
+
+} } // tcp, quitsies
@@ -0,0 +1,158 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef QUITSIES_COMMAND_STATS_HPP
+#define QUITSIES_COMMAND_STATS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <ostream>
+
+#include <quitsies/stats/histogram.hpp>
+
+namespace quitsies { namespace tcp {
+
+/*
+ * Counts the commands served by the memcached API, as reported by the stats
+ * command.
+ *
+ * Each kind of command has a latency histogram, which also gives its count,
+ * and counts of the keys it found and missed. The bytes read and written and
+ * the connections opened are counted for the whole server. Every counter is
+ * a relaxed atomic, so that all the threads of a server can share one
+ * instance.
+ */
+class command_stats {
+public:
+	enum command_type {
+		GET = 0,
+		GETS,
+		GAT,
+		GATS,
+		TOUCH,
+		SET,
+		ADD,
+		CAS,
+		APPEND,
+		PREPEND,
+		INCR,
+		DECR,
+		DELETE,
+		MG,
+		MS,
+		MD,
+		N_COMMANDS
+	};
+
+private:
+	struct command_counters {
+		stats::histogram      latency;
+		std::atomic<uint64_t> keys;
+		std::atomic<uint64_t> hits;
+		std::atomic<uint64_t> misses;
+
+		command_counters()
+			: latency()
+			, keys(0)
+			, hits(0)
+			, misses(0)
+		{}
+	};
+
+	std::array<command_counters, N_COMMANDS> _commands;
+
+	std::atomic<uint64_t> _bytes_read;
+	std::atomic<uint64_t> _bytes_written;
+	std::atomic<uint64_t> _curr_connections;
+	std::atomic<uint64_t> _total_connections;
+
+	std::chrono::steady_clock::time_point _started;
+
+public:
+	command_stats(const command_stats&) = delete;
+
+	command_stats& operator=(const command_stats&) = delete;
+
+	command_stats();
+
+	static const char * name(command_type command);
+
+	// Records a finished command and how long it took to answer.
+	void record(command_type command, std::chrono::steady_clock::duration latency) {
+		auto micros = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+		_commands[command].latency.record(micros > 0 ? static_cast<uint64_t>(micros) : 0);
+	}
+
+	// Records a key that a command looked up, whatever the outcome.
+	void key(command_type command) {
+		_commands[command].keys.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Records whether a key of a command was found.
+	void hit(command_type command, bool found) {
+		auto & counter = found ? _commands[command].hits : _commands[command].misses;
+		counter.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void add_bytes_read(size_t n)    { _bytes_read.fetch_add(n, std::memory_order_relaxed); }
+	void add_bytes_written(size_t n) { _bytes_written.fetch_add(n, std::memory_order_relaxed); }
+
+	void connection_opened() {
+		_curr_connections.fetch_add(1, std::memory_order_relaxed);
+		_total_connections.fetch_add(1, std::memory_order_relaxed);
+	}
+	void connection_closed() {
+		_curr_connections.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	uint64_t count(command_type command) const { return _commands[command].latency.count(); }
+	uint64_t keys(command_type command) const { return _commands[command].keys.load(std::memory_order_relaxed); }
+	uint64_t hits(command_type command) const { return _commands[command].hits.load(std::memory_order_relaxed); }
+	uint64_t misses(command_type command) const { return _commands[command].misses.load(std::memory_order_relaxed); }
+
+	/*
+	 * Writes the general stats as "STAT name value\r\n" lines, named as by
+	 * memcached, e.g. cmd_get, get_hits and curr_connections.
+	 */
+	void report(std::ostream & out) const;
+
+	/*
+	 * Writes the count and the 50th, 99th and 99.9th percentile latency in
+	 * microseconds of each command that has been served, e.g.
+	 * "STAT get:p99_us 120\r\n".
+	 */
+	void report_latency(std::ostream & out) const;
+};
+
+typedef std::shared_ptr<command_stats> command_stats_ptr;
+
+} } // tcp, quitsies
+
+#endif // QUITSIES_COMMAND_STATS_HPP
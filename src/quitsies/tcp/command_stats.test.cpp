@@ -0,0 +1,113 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <test/catch.hpp>
+
+#include <quitsies/tcp/command_stats.hpp>
+
+#include <chrono>
+#include <sstream>
+#include <string>
+
+using namespace quitsies::tcp;
+
+namespace {
+
+// Returns the value of a STAT line of a report, or an empty string.
+std::string
+stat_value(std::string const & report, std::string const & name) {
+	std::string prefix = "STAT " + name + " ";
+	auto pos = report.find(prefix);
+	if ( pos == std::string::npos ) {
+		return "";
+	}
+	pos += prefix.size();
+	return report.substr(pos, report.find("\r\n", pos) - pos);
+}
+
+} // namespace
+
+TEST_CASE("command stats report memcached general stats", "[command_stats]")
+{
+	command_stats stats;
+
+	stats.record(command_stats::GET, std::chrono::microseconds(10));
+	stats.record(command_stats::GET, std::chrono::microseconds(10));
+	stats.record(command_stats::GAT, std::chrono::microseconds(10));
+	stats.record(command_stats::SET, std::chrono::microseconds(10));
+	for ( auto command : {command_stats::GET, command_stats::GET, command_stats::GET, command_stats::GAT} ) {
+		stats.key(command);
+	}
+	stats.hit(command_stats::GET, true);
+	stats.hit(command_stats::GET, false);
+	stats.hit(command_stats::GAT, true);
+	stats.hit(command_stats::DELETE, false);
+	stats.add_bytes_read(100);
+	stats.add_bytes_written(250);
+	stats.connection_opened();
+	stats.connection_opened();
+	stats.connection_closed();
+
+	std::stringstream ss;
+	stats.report(ss);
+	std::string report = ss.str();
+
+	// Gets are counted per key rather than per command.
+	CHECK(stat_value(report, "cmd_get") == "4");
+	CHECK(stat_value(report, "cmd_set") == "1");
+	CHECK(stat_value(report, "cmd_touch") == "1");
+	CHECK(stat_value(report, "get_hits") == "2");
+	CHECK(stat_value(report, "get_misses") == "1");
+	CHECK(stat_value(report, "touch_hits") == "1");
+	CHECK(stat_value(report, "delete_misses") == "1");
+	CHECK(stat_value(report, "bytes_read") == "100");
+	CHECK(stat_value(report, "bytes_written") == "250");
+	CHECK(stat_value(report, "curr_connections") == "1");
+	CHECK(stat_value(report, "total_connections") == "2");
+	CHECK(stat_value(report, "uptime") == "0");
+}
+
+TEST_CASE("command stats report latency percentiles", "[command_stats]")
+{
+	command_stats stats;
+
+	for ( int i = 0; i < 1999; i++ ) {
+		stats.record(command_stats::GET, std::chrono::microseconds(100));
+	}
+	stats.record(command_stats::GET, std::chrono::milliseconds(50));
+
+	std::stringstream ss;
+	stats.report_latency(ss);
+	std::string report = ss.str();
+
+	CHECK(stat_value(report, "get:count") == "2000");
+	CHECK(stat_value(report, "get:p50_us") == stat_value(report, "get:p99_us"));
+	CHECK(std::stoull(stat_value(report, "get:p50_us")) >= 100);
+	CHECK(std::stoull(stat_value(report, "get:p50_us")) < 120);
+	CHECK(std::stoull(stat_value(report, "get:p999_us")) < 120);
+
+	// Commands that were never served are left out.
+	CHECK(report.find("STAT set:") == std::string::npos);
+}
@@ -24,6 +24,8 @@ SOFTWARE.
 
 #include <quitsies/tcp/connection.hpp>
 #include <quitsies/tcp/connection_manager.hpp>
+#include <quitsies/tcp/request.hpp>
+#include <quitsies/tcp/binary_request.hpp>
 
 #include <utility>
 #include <vector>
@@ -31,111 +33,335 @@ SOFTWARE.
 using namespace quitsies::tcp;
 
 connection::connection( boost::asio::io_service &    io_service
-                      , boost::asio::ip::tcp::socket socket
+                      , stream_socket                socket
                       , connection_manager &         manager
+                      , timer_wheel &                wheel
                       , db::store_ptr                db
                       , log::logger                  log
                       , stats::aggregator_ptr        stats
+                      , buffer_pool_ptr              buffers
+                      , db::executor_ptr             executor
+                      , db::admission_ptr            admission
+                      , command_stats_ptr            command_stats
+                      , connection_limiter::slot     slot
                       , size_t                       max_req_size_bytes
                       , int                          read_timeout
                       , int                          write_timeout
+                      , int                          idle_timeout
                       )
 	: _io_service(io_service)
 	, _socket(std::move(socket))
+	, _strand(io_service)
 	, _connection_manager(manager)
+	, _registry_shard(0)
+	, _registry_slot(connection_manager::npos)
 	, _log(log)
 	, _stats(stats)
-	, _request(db, log, stats, max_req_size_bytes)
+	, _db(db)
+	, _executor(executor)
+	, _admission(admission)
+	, _command_stats(command_stats)
+	, _slot(std::move(slot))
+	, _max_request_bytes(max_req_size_bytes)
+	, _durability_flags(false)
+	, _request()
+	, _buffer(buffers, buffers->min_size())
+	, _last_read(0)
+	, _pending(nullptr)
+	, _pending_length(0)
+	, _response()
+	, _write_buffers()
+	, _quitting(false)
+	, _wheel(wheel)
+	, _timeout()
+	, _timeout_type(NO_TIMEOUT)
 	, _read_timeout(read_timeout)
 	, _write_timeout(write_timeout)
-	, _read_timer(_io_service, boost::posix_time::milliseconds(read_timeout))
-	, _write_timer(_io_service, boost::posix_time::milliseconds(write_timeout))
-{}
+	, _idle_timeout(idle_timeout)
+{
+	if ( _command_stats ) {
+		_command_stats->connection_opened();
+	}
+}
+
+connection::~connection()
+{
+	if ( _command_stats ) {
+		_command_stats->connection_closed();
+	}
+}
 
 void
 connection::start()
 {
+	// Without an idle timeout the read timeout covers the wait for a command,
+	// as it always has.
+	set_timeout(_idle_timeout > 0 ? IDLE_TIMEOUT : READ_TIMEOUT);
 	do_read();
+}
 
-	if ( _read_timeout > 0 ) {
-		auto self(shared_from_this());
+void
+connection::set_timeout(timeout_type type)
+{
+	int milliseconds = 0;
+	switch ( type ) {
+	case IDLE_TIMEOUT:  milliseconds = _idle_timeout; break;
+	case READ_TIMEOUT:  milliseconds = _read_timeout; break;
+	case WRITE_TIMEOUT: milliseconds = _write_timeout; break;
+	default: break;
+	}
 
-		_read_timer.async_wait([this, self](const boost::system::error_code& error) {
-			if ( error.value() != boost::system::errc::operation_canceled ) {
-				_connection_manager.stop(shared_from_this());
+	if ( milliseconds <= 0 ) {
+		_timeout_type = NO_TIMEOUT;
+		if ( _timeout ) {
+			_timeout->cancel();
+		}
+		return;
+	}
+
+	if ( !_timeout ) {
+		// The wheel may fire after the connection is gone, so the timer only
+		// holds a weak reference.
+		std::weak_ptr<connection> weak(shared_from_this());
+		_timeout.reset(new timer_wheel::timer(_wheel, [weak]() {
+			if ( auto self = weak.lock() ) {
+				self->_strand.post([self]() {
+					self->handle_timeout();
+				});
 			}
-		});
+		}));
 	}
+	_timeout_type = type;
+	_timeout->schedule(static_cast<size_t>(milliseconds));
+}
+
+void
+connection::handle_timeout()
+{
+	if ( _timeout_type == NO_TIMEOUT || _timeout->scheduled() ) {
+		return;
+	}
+
+	switch ( _timeout_type ) {
+	case IDLE_TIMEOUT:
+		_stats->counter("tcp.timeout.idle", 1);
+		break;
+	case READ_TIMEOUT:
+		_stats->counter("tcp.timeout.read", 1);
+		break;
+	default:
+		_stats->counter("tcp.timeout.write", 1);
+		break;
+	}
+	_timeout_type = NO_TIMEOUT;
+	_connection_manager.stop(shared_from_this());
 }
 
 void
 connection::stop()
 {
 	boost::system::error_code ignored_ec;
-	_socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both,
+	_socket.shutdown(boost::asio::socket_base::shutdown_both,
 		ignored_ec);
 	_socket.close();
+
+	// The socket is closed, so a new connection may take its place.
+	_slot.release();
 }
 
 void
 connection::do_read()
 {
+	if ( _request ) {
+		auto tail = _request->value_tail(_buffer.size());
+		if ( boost::asio::buffer_size(tail) > 0 ) {
+			do_read_value(tail);
+			return;
+		}
+	}
+
+	// Nothing points into the buffer once all pending data is processed, so
+	// it can be swapped for another size.
+	auto & pool = _buffer.pool();
+	if ( _last_read == _buffer.size() && _buffer.size() < pool.max_size() ) {
+		_buffer.resize(_buffer.size() * 2);
+	} else if ( _last_read < _buffer.size() / 8 && _buffer.size() > pool.min_size() ) {
+		_buffer.resize(_buffer.size() / 2);
+	}
+
 	auto self(shared_from_this());
 
 	_socket.async_read_some(boost::asio::buffer(_buffer.data(), _buffer.size()),
-		[this, self](boost::system::error_code ec, std::size_t bytes_transferred) {
+		_strand.wrap([this, self](boost::system::error_code ec, std::size_t bytes_transferred) {
 			if (!ec) {
-				_request.process(_buffer.data(), bytes_transferred);
-
-				switch ( _request.get_status() ) {
-				case request::status_type::FINISHED:
-					// Parsing is finished, stop reading and send response.
-					_read_timer.cancel();
-
-					if ( _write_timeout > 0 ) {
-						_write_timer.async_wait([this, self](const boost::system::error_code& error) {
-							if ( error.value() != boost::system::errc::operation_canceled ) {
-								_connection_manager.stop(shared_from_this());
-							}
-						});
-					}
-
-					if ( _request.get_no_reply() ) {
-						_write_timer.cancel();
-						_request.reset();
-						start();
-					} else {
-						do_write();
-					}
-					break;
-				case request::status_type::QUITTING:
-					_connection_manager.stop(shared_from_this());
-					break;
-				default:
-					// Not finished reading response, continue.
-					do_read();
+				handle_read(bytes_transferred);
+			} else if (ec != boost::asio::error::operation_aborted) {
+				_connection_manager.stop(shared_from_this());
+			}
+		})
+	);
+}
+
+void
+connection::do_read_value(boost::asio::mutable_buffer tail)
+{
+	auto self(shared_from_this());
+
+	boost::asio::async_read(_socket, boost::asio::buffer(tail),
+		_strand.wrap([this, self](boost::system::error_code ec, std::size_t bytes_transferred) {
+			if (!ec) {
+				if ( _command_stats ) {
+					_command_stats->add_bytes_read(bytes_transferred);
 				}
+				_request->fill_value(bytes_transferred);
+				_pending_length = 0;
+				process_pending();
 			} else if (ec != boost::asio::error::operation_aborted) {
 				_connection_manager.stop(shared_from_this());
 			}
-		}
+		})
 	);
 }
 
+void
+connection::handle_read(std::size_t length)
+{
+	_last_read = length;
+	if ( _command_stats ) {
+		_command_stats->add_bytes_read(length);
+	}
+
+	if ( !_request && length > 0 ) {
+		if ( static_cast<uint8_t>(_buffer.data()[0]) == binary_request::request_magic ) {
+			_request.reset(new binary_request(_db, _log, _stats, _max_request_bytes));
+		} else {
+			_request.reset(new request(_db, _log, _stats, _max_request_bytes));
+		}
+		_request->set_deferred(_executor != nullptr);
+		_request->set_admission(_admission);
+		_request->set_command_stats(_command_stats);
+		_request->set_durability_flags(_durability_flags);
+	}
+
+	_pending = _buffer.data();
+	_pending_length = length;
+
+	process_pending();
+}
+
+void
+connection::process_pending(bool executed /* = false */)
+{
+	bool finished = false;
+
+	while ( !_quitting && _response.size() < max_queued_response_bytes ) {
+		if ( executed ) {
+			// The executed command has a response waiting to be taken.
+			executed = false;
+		} else if ( _request->get_status() == protocol::status_type::RESPONDING ) {
+			_request->resume();
+		} else if ( _pending_length > 0 ) {
+			std::size_t consumed = _request->process(_pending, _pending_length);
+			_pending += consumed;
+			_pending_length -= consumed;
+		} else if ( _request->get_status() != protocol::status_type::FINISHED
+		         && _request->get_status() != protocol::status_type::QUITTING
+		         && _request->get_status() != protocol::status_type::EXECUTING ) {
+			break;
+		}
+		// Otherwise a command was completed by a direct value read, and its
+		// response is taken or its execution started below.
+
+		switch ( _request->get_status() ) {
+		case protocol::status_type::FINISHED:
+			finished = true;
+			if ( !_request->get_no_reply() ) {
+				_request->take_response(_response);
+			}
+			_request->reset();
+			break;
+		case protocol::status_type::RESPONDING:
+			_request->take_response(_response);
+			break;
+		case protocol::status_type::QUITTING:
+			_quitting = true;
+			if ( !_request->get_no_reply() ) {
+				_request->take_response(_response);
+			}
+			break;
+		case protocol::status_type::EXECUTING:
+			do_execute();
+			return;
+		default:
+			// The remaining bytes are part of an unfinished command.
+			break;
+		}
+	}
+
+	if ( !_response.empty() ) {
+		// Stop reading and send responses.
+		set_timeout(WRITE_TIMEOUT);
+		do_write();
+	} else if ( _quitting ) {
+		_connection_manager.stop(shared_from_this());
+	} else if ( finished && _request->idle() ) {
+		start();
+	} else {
+		// Not finished reading request, continue.
+		if ( _timeout_type != READ_TIMEOUT ) {
+			set_timeout(READ_TIMEOUT);
+		}
+		do_read();
+	}
+}
+
+void
+connection::do_execute()
+{
+	auto self(shared_from_this());
+
+	// The client is not waiting on anything while the command runs.
+	set_timeout(NO_TIMEOUT);
+
+	_executor->post([this, self]() {
+		_request->execute();
+		_strand.post([this, self]() {
+			process_pending(true);
+		});
+	});
+}
+
 void
 connection::do_write()
 {
 	auto self(shared_from_this());
 
-	boost::asio::async_write(_socket, boost::asio::buffer(_request.get_response()),
-		[this, self](boost::system::error_code ec, std::size_t) {
+	_write_buffers.clear();
+	_response.buffers(_write_buffers);
+
+	boost::asio::async_write(_socket, _write_buffers,
+		_strand.wrap([this, self](boost::system::error_code ec, std::size_t bytes_transferred) {
 			if ( !ec ) {
-				_write_timer.cancel();
-				_request.reset();
-				start();
+				if ( _command_stats ) {
+					_command_stats->add_bytes_written(bytes_transferred);
+				}
+				_response.clear();
+				if ( _quitting ) {
+					_connection_manager.stop(shared_from_this());
+				} else if ( _pending_length > 0
+				         || _request->get_status() == protocol::status_type::RESPONDING ) {
+					// Continue with the commands that were paused for this write.
+					process_pending();
+				} else if ( _request->idle() ) {
+					start();
+				} else {
+					// The client is part way through its next command.
+					set_timeout(READ_TIMEOUT);
+					do_read();
+				}
 			} else if ( ec != boost::asio::error::operation_aborted ) {
 				_connection_manager.stop(shared_from_this());
 			}
-		}
+		})
 	);
 }
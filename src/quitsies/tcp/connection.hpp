@@ -29,36 +29,82 @@ SOFTWARE.
 
 #include <rocksdb/db.h>
 
-#include <quitsies/tcp/request.hpp>
+#include <quitsies/tcp/protocol.hpp>
+#include <quitsies/tcp/buffer_pool.hpp>
+#include <quitsies/tcp/timer_wheel.hpp>
+#include <quitsies/tcp/connection_limiter.hpp>
+#include <quitsies/db/store.hpp>
+#include <quitsies/db/executor.hpp>
+#include <quitsies/db/admission.hpp>
+#include <quitsies/tcp/command_stats.hpp>
 #include <quitsies/log/logger.hpp>
 #include <quitsies/stats/aggregator.hpp>
 
-#include <array>
 #include <memory>
+#include <vector>
 
 namespace quitsies { namespace tcp {
 
 class connection_manager;
 
+/*
+ * The socket of a connection, which is accepted over either TCP or a Unix
+ * domain socket.
+ */
+typedef boost::asio::generic::stream_protocol::socket stream_socket;
+
 /*
  * Manages the lifecycle of a single TCP connection.
  *
- * A connection is created by the server each time a new client connects.
+ * A connection is created by the server each time a new client connects. All
+ * of its handlers run on its own strand, so that they never run concurrently
+ * when the io_service is shared by several threads.
  */
 class connection
 	: public std::enable_shared_from_this<connection>
 {
+	// The manager keeps the position of the connection in its registry.
+	friend class connection_manager;
+
 	boost::asio::io_service &    _io_service;
-	boost::asio::ip::tcp::socket _socket;
+	stream_socket                _socket;
+	boost::asio::io_service::strand _strand;
 	connection_manager &         _connection_manager;
+	std::size_t                  _registry_shard;
+	std::size_t                  _registry_slot;
 	log::logger                  _log;
 	stats::aggregator_ptr        _stats;
-	request                      _request;
-	std::array<char, 8192>       _buffer;
-	int                          _read_timeout;
-	int                          _write_timeout;
-	boost::asio::deadline_timer  _read_timer;
-	boost::asio::deadline_timer  _write_timer;
+	db::store_ptr                _db;
+	db::executor_ptr             _executor;
+	db::admission_ptr            _admission;
+	command_stats_ptr            _command_stats;
+	connection_limiter::slot     _slot;
+	size_t                       _max_request_bytes;
+	bool                         _durability_flags;
+	protocol_ptr                 _request;
+	pooled_buffer                _buffer;
+	std::size_t                  _last_read;
+	const char *                 _pending;
+	std::size_t                  _pending_length;
+	response                     _response;
+	std::vector<boost::asio::const_buffer> _write_buffers;
+	bool                         _quitting;
+
+	// A single timeout on the wheel of the io_service, which is scheduled for
+	// whichever stage the connection is in.
+	enum timeout_type {
+		NO_TIMEOUT = 0,
+		IDLE_TIMEOUT,
+		READ_TIMEOUT,
+		WRITE_TIMEOUT
+	};
+
+	timer_wheel &                         _wheel;
+	std::unique_ptr<timer_wheel::timer>   _timeout;
+	timeout_type                          _timeout_type;
+	int                                   _read_timeout;
+	int                                   _write_timeout;
+	int                                   _idle_timeout;
 
 public:
 	connection(connection&) = delete;
@@ -66,17 +112,34 @@ public:
 	connection& operator=(const connection&) = delete;
 
 	explicit connection( boost::asio::io_service &    io_service
-	                   , boost::asio::ip::tcp::socket socket
+	                   , stream_socket                socket
 	                   , connection_manager &         manager
+	                   , timer_wheel &                wheel
 	                   , db::store_ptr                db
 	                   , log::logger                  log
 	                   , stats::aggregator_ptr        stats
+	                   , buffer_pool_ptr              buffers
+	                   , db::executor_ptr             executor
+	                   , db::admission_ptr            admission
+	                   , command_stats_ptr            command_stats
+	                   , connection_limiter::slot     slot
 	                   , size_t                       max_request_size_bytes
 	                   , int                          read_timeout
-	                   , int                          write_timeout );
+	                   , int                          write_timeout
+	                   , int                          idle_timeout );
+
+	~connection();
+
+	// Lets the flags of stores select their durability, see protocol.
+	void set_durability_flags(bool enabled) { _durability_flags = enabled; }
 
 	/*
 	 * Prompts the connection to start reading from its TCP socket.
+	 *
+	 * This is also called each time the connection is waiting for a new
+	 * command, which restarts the idle timeout. A command that has begun to
+	 * arrive must be read within the read timeout instead, and responses must
+	 * be written within the write timeout.
 	 */
 	void start();
 
@@ -88,13 +151,66 @@ public:
 private:
 	/*
 	 * An asynchronous call that triggers a TCP read from the socket.
+	 *
+	 * Once the request knows the size of a value that is larger than the read
+	 * buffer the rest of the value is read straight into the request instead.
+	 * Otherwise the read buffer is grown after a read that fills it, and
+	 * shrunk after reads that use little of it.
 	 */
 	void do_read();
 
 	/*
-	 * An asynchronous call that triggers a TCP write to the socket.
+	 * An asynchronous call that reads the rest of a value payload directly
+	 * into the buffer given by the request.
+	 */
+	void do_read_value(boost::asio::mutable_buffer tail);
+
+	/*
+	 * Starts processing a chunk of read data.
+	 *
+	 * The protocol spoken by the client is chosen from the first byte it
+	 * sends, binary protocol requests always begin with a magic byte.
+	 */
+	void handle_read(std::size_t length);
+
+	/*
+	 * Runs the complete commands of the pending read data in order, queueing
+	 * their responses. Bytes of a trailing partial command are held by the
+	 * request until the next read.
+	 *
+	 * Processing pauses to write out the queued responses once they exceed a
+	 * limit, so that a large pipeline or multi-get is streamed to the client
+	 * rather than held in memory at once.
+	 *
+	 * When the connection has a storage executor, processing also pauses
+	 * while each command runs its store calls on a storage thread, and
+	 * resumes with executed set once they are done.
+	 */
+	void process_pending(bool executed = false);
+
+	/*
+	 * Runs the store calls of the current command on the storage executor,
+	 * and then continues processing on the strand of the connection.
+	 */
+	void do_execute();
+
+	/*
+	 * An asynchronous call that writes all queued responses to the socket as
+	 * a single gathered write.
 	 */
 	void do_write();
+
+	/*
+	 * Schedules the timeout of a stage, or cancels the timeout when the stage
+	 * has none.
+	 */
+	void set_timeout(timeout_type type);
+
+	// Closes the connection if its timeout has not been replaced since firing.
+	void handle_timeout();
+
+	// Queued responses beyond this size are written before parsing continues.
+	static const std::size_t max_queued_response_bytes = 1 << 20;
 };
 
 typedef std::shared_ptr<connection> connection_ptr;
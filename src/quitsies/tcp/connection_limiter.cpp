@@ -0,0 +1,76 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <quitsies/tcp/connection_limiter.hpp>
+
+using namespace quitsies::tcp;
+
+connection_limiter::connection_limiter(size_t max_connections, size_t max_per_source)
+	: _max_connections(max_connections)
+	, _max_per_source(max_per_source)
+	, _count(0)
+	, _sources_mutex()
+	, _sources()
+{}
+
+connection_limiter::slot
+connection_limiter::acquire(std::string const & source) {
+	size_t count = _count.fetch_add(1, std::memory_order_relaxed) + 1;
+	if ( _max_connections > 0 && count > _max_connections ) {
+		_count.fetch_sub(1, std::memory_order_relaxed);
+		return slot();
+	}
+
+	if ( _max_per_source > 0 && !source.empty() ) {
+		std::lock_guard<std::mutex> lock(_sources_mutex);
+		size_t & from_source = _sources[source];
+		if ( from_source >= _max_per_source ) {
+			_count.fetch_sub(1, std::memory_order_relaxed);
+			return slot();
+		}
+		from_source++;
+		return slot(this, source);
+	}
+	return slot(this, "");
+}
+
+void
+connection_limiter::release(std::string const & source) {
+	if ( !source.empty() ) {
+		std::lock_guard<std::mutex> lock(_sources_mutex);
+		auto search = _sources.find(source);
+		if ( search != _sources.end() && --search->second == 0 ) {
+			_sources.erase(search);
+		}
+	}
+	_count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void
+connection_limiter::slot::release() {
+	if ( _owner != nullptr ) {
+		_owner->release(_source);
+		_owner = nullptr;
+	}
+}
@@ -0,0 +1,128 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef QUITSIES_CONNECTION_LIMITER_HPP
+#define QUITSIES_CONNECTION_LIMITER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace quitsies { namespace tcp {
+
+/*
+ * Caps the number of open connections of a server, in total and from each
+ * source address.
+ *
+ * Every connection takes a slot when it is accepted and gives it back once
+ * its socket is closed. The total is kept in an atomic counter that the
+ * listening sockets check before each accept. The counts for each source
+ * address are only kept when a cap for them is set. A cap of 0 is not
+ * enforced.
+ */
+class connection_limiter {
+	size_t                                  _max_connections;
+	size_t                                  _max_per_source;
+	std::atomic<size_t>                     _count;
+	std::mutex                              _sources_mutex;
+	std::unordered_map<std::string, size_t> _sources;
+
+public:
+	/*
+	 * The place of an open connection, which is given back when it is
+	 * released or destroyed.
+	 */
+	class slot {
+		connection_limiter * _owner;
+		std::string          _source;
+
+	public:
+		slot()
+			: _owner(nullptr)
+			, _source()
+		{}
+
+		slot(connection_limiter * owner, std::string source)
+			: _owner(owner)
+			, _source(std::move(source))
+		{}
+
+		slot(const slot&) = delete;
+
+		slot& operator=(const slot&) = delete;
+
+		slot(slot && other)
+			: _owner(other._owner)
+			, _source(std::move(other._source))
+		{
+			other._owner = nullptr;
+		}
+
+		slot& operator=(slot && other) {
+			if ( this != &other ) {
+				release();
+				_owner = other._owner;
+				_source = std::move(other._source);
+				other._owner = nullptr;
+			}
+			return *this;
+		}
+
+		~slot() { release(); }
+
+		explicit operator bool() const { return _owner != nullptr; }
+
+		void release();
+	};
+
+	connection_limiter(const connection_limiter&) = delete;
+
+	connection_limiter& operator=(const connection_limiter&) = delete;
+
+	connection_limiter(size_t max_connections, size_t max_per_source);
+
+	/*
+	 * Takes a slot for a connection from a source address, which is empty
+	 * when the source has no address to cap, such as a Unix domain socket.
+	 * Returns an empty slot if either cap is reached.
+	 */
+	slot acquire(std::string const & source);
+
+	// Returns true once the total cap is reached.
+	bool full() const {
+		return _max_connections > 0 && count() >= _max_connections;
+	}
+
+	size_t count() const { return _count.load(std::memory_order_relaxed); }
+
+private:
+	void release(std::string const & source);
+};
+
+} } // tcp, quitsies
+
+#endif // QUITSIES_CONNECTION_LIMITER_HPP
@@ -0,0 +1,76 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <test/catch.hpp>
+
+#include <quitsies/tcp/connection_limiter.hpp>
+
+#include <utility>
+
+using namespace quitsies::tcp;
+
+TEST_CASE("connection limiter caps open connections", "[connection_limiter]")
+{
+	SECTION("the total cap is enforced until slots are released")
+	{
+		connection_limiter limiter(2, 0);
+
+		auto first = limiter.acquire("a");
+		auto second = limiter.acquire("a");
+		CHECK(static_cast<bool>(first));
+		CHECK(static_cast<bool>(second));
+		CHECK(limiter.full());
+		CHECK_FALSE(static_cast<bool>(limiter.acquire("b")));
+		CHECK(limiter.count() == 2);
+
+		first.release();
+		first.release();
+		CHECK_FALSE(limiter.full());
+		CHECK(limiter.count() == 1);
+	}
+
+	SECTION("each source is capped on its own")
+	{
+		connection_limiter limiter(0, 2);
+
+		auto a1 = limiter.acquire("a");
+		auto a2 = limiter.acquire("a");
+		CHECK_FALSE(static_cast<bool>(limiter.acquire("a")));
+		auto b1 = limiter.acquire("b");
+		CHECK(static_cast<bool>(b1));
+		CHECK(limiter.count() == 3);
+		CHECK_FALSE(limiter.full());
+
+		// Connections without a source address are not capped by source.
+		auto local1 = limiter.acquire("");
+		auto local2 = limiter.acquire("");
+		auto local3 = limiter.acquire("");
+		CHECK(static_cast<bool>(local3));
+
+		connection_limiter::slot moved(std::move(a1));
+		CHECK_FALSE(static_cast<bool>(a1));
+		moved = connection_limiter::slot();
+		CHECK(static_cast<bool>(limiter.acquire("a")));
+	}
+}
@@ -24,35 +24,96 @@ SOFTWARE.
 
 #include <quitsies/tcp/connection_manager.hpp>
 
+#include <algorithm>
+#include <utility>
+
 using namespace quitsies::tcp;
 
-connection_manager::connection_manager()
-{}
+const std::size_t connection_manager::npos;
+
+connection_manager::connection_manager(std::size_t n_shards /* = 1 */, bool concurrent /* = true */)
+	: _shards()
+	, _next_shard(0)
+	, _concurrent(concurrent)
+{
+	for ( std::size_t i = 0; i < std::max<std::size_t>(1, n_shards); i++ ) {
+		_shards.emplace_back(new shard());
+	}
+}
 
 void
 connection_manager::start(connection_ptr c) {
+	std::size_t index = _next_shard.fetch_add(1, std::memory_order_relaxed) % _shards.size();
+	shard & s = *_shards[index];
 	{
-		std::lock_guard<std::mutex> lock(_connections_mutex);
-		_connections.insert(c);
+		std::unique_lock<std::mutex> lock(s.mutex, std::defer_lock);
+		if ( _concurrent ) {
+			lock.lock();
+		}
+		c->_registry_shard = index;
+		c->_registry_slot = s.slots.size();
+		s.slots.push_back(c);
 	}
 	c->start();
 }
 
 void
 connection_manager::stop(connection_ptr c) {
-	{
-		std::lock_guard<std::mutex> lock(_connections_mutex);
-		_connections.erase(c);
-	}
+	remove(*c);
 	c->stop();
 }
 
+bool
+connection_manager::remove(connection & c) {
+	shard & s = *_shards[c._registry_shard];
+	std::unique_lock<std::mutex> lock(s.mutex, std::defer_lock);
+	if ( _concurrent ) {
+		lock.lock();
+	}
+	std::size_t slot = c._registry_slot;
+	if ( slot == npos ) {
+		return false;
+	}
+
+	// Fill the slot with the last connection of the shard.
+	if ( slot + 1 < s.slots.size() ) {
+		s.slots[slot] = std::move(s.slots.back());
+		s.slots[slot]->_registry_slot = slot;
+	}
+	c._registry_slot = npos;
+	s.slots.pop_back();
+	return true;
+}
+
 void
 connection_manager::stop_all() {
-	std::lock_guard<std::mutex> lock(_connections_mutex);
-	for (auto c: _connections)
-	{
-		c->stop();
+	for ( auto & s : _shards ) {
+		std::vector<connection_ptr> stopping;
+		{
+			std::unique_lock<std::mutex> lock(s->mutex, std::defer_lock);
+			if ( _concurrent ) {
+				lock.lock();
+			}
+			stopping.swap(s->slots);
+			for ( auto & c : stopping ) {
+				c->_registry_slot = npos;
+			}
+		}
+		for ( auto & c : stopping ) {
+			c->stop();
+		}
+	}
+}
+
+std::size_t
+connection_manager::size() {
+	std::size_t n = 0;
+	for ( auto & s : _shards ) {
+		std::unique_lock<std::mutex> lock(s->mutex, std::defer_lock);
+		if ( _concurrent ) {
+			lock.lock();
+		}
+		n += s->slots.size();
 	}
-	_connections.clear();
+	return n;
 }
@@ -25,8 +25,11 @@ SOFTWARE.
 #ifndef QUITSIES_CONNECTION_MANAGER_HPP
 #define QUITSIES_CONNECTION_MANAGER_HPP
 
-#include <set>
+#include <atomic>
+#include <limits>
+#include <memory>
 #include <mutex>
+#include <vector>
 
 #include <quitsies/tcp/connection.hpp>
 
@@ -38,18 +41,37 @@ namespace quitsies { namespace tcp {
  * The connection manager is used for easily tracking any remaining open TCP
  * connections, and shutting down those connections in order to gracefully
  * close.
+ *
+ * Connections are spread over shards, each a slot map that a connection is
+ * added to and removed from in constant time without allocating. A manager
+ * that is only ever used from one thread, such as that of a sharded worker,
+ * takes no locks at all. Otherwise every shard has a lock of its own, so
+ * that threads accepting and closing connections rarely meet.
  */
 class connection_manager
 {
-	std::set<connection_ptr> _connections;
-	std::mutex               _connections_mutex;
+	struct shard {
+		std::mutex                  mutex;
+		std::vector<connection_ptr> slots;
+	};
+
+	std::vector<std::unique_ptr<shard>> _shards;
+	std::atomic<std::size_t>            _next_shard;
+	bool                                _concurrent;
 
 public:
+	// The slot of a connection that is not registered.
+	static const std::size_t npos = std::numeric_limits<std::size_t>::max();
+
 	connection_manager(const connection_manager&) = delete;
 
 	connection_manager& operator=(const connection_manager&) = delete;
 
-	connection_manager();
+	/*
+	 * @param n_shards the number of shards to spread connections across
+	 * @param concurrent whether the manager is used from more than one thread
+	 */
+	explicit connection_manager(std::size_t n_shards = 1, bool concurrent = true);
 
 	/*
 	 * Adds a new connection to the stack and prompts it to begin.
@@ -66,9 +88,21 @@ public:
 	void stop(connection_ptr c);
 
 	/*
-	 * Stops all remaining open connections.
+	 * Stops all remaining open connections of every shard.
 	 */
 	void stop_all();
+
+	/*
+	 * Returns the number of open connections.
+	 */
+	std::size_t size();
+
+private:
+	/*
+	 * Removes a connection from its shard, returns false if it was already
+	 * removed.
+	 */
+	bool remove(connection & c);
 };
 
 } } // tcp, quitsies
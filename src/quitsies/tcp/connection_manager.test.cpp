@@ -0,0 +1,96 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <test/catch.hpp>
+
+#include <quitsies/tcp/connection_manager.hpp>
+#include <quitsies/stats/null_aggregator.hpp>
+
+#include <vector>
+
+using namespace quitsies::tcp;
+
+namespace {
+
+auto manager_stats = quitsies::stats::aggregator_ptr(new quitsies::stats::null_aggregator());
+auto manager_logger = quitsies::log::create("quitsies_manager_test", "off");
+
+void check_manager(bool concurrent)
+{
+	timer_wheel wheel(50, 8);
+	boost::asio::io_service io_service;
+	buffer_pool_ptr buffers(new buffer_pool(1024, 4096, 4));
+	connection_manager manager(3, concurrent);
+
+	std::vector<connection_ptr> connections;
+	for ( int i = 0; i < 10; i++ ) {
+		connections.push_back(std::make_shared<connection>( io_service
+		                                                  , stream_socket(io_service)
+		                                                  , manager
+		                                                  , wheel
+		                                                  , quitsies::db::store_ptr()
+		                                                  , manager_logger
+		                                                  , manager_stats
+		                                                  , buffers
+		                                                  , quitsies::db::executor_ptr()
+		                                                  , quitsies::db::admission_ptr()
+		                                                  , command_stats_ptr()
+		                                                  , connection_limiter::slot()
+		                                                  , 0, 0, 0, 0 ));
+		manager.start(connections.back());
+	}
+	CHECK(manager.size() == 10);
+
+	// Stopping a connection twice removes it once.
+	manager.stop(connections[0]);
+	manager.stop(connections[4]);
+	manager.stop(connections[9]);
+	manager.stop(connections[4]);
+	CHECK(manager.size() == 7);
+
+	for ( int i = 1; i < 9; i += 2 ) {
+		manager.stop(connections[i]);
+	}
+	CHECK(manager.size() == 3);
+
+	manager.stop_all();
+	CHECK(manager.size() == 0);
+	manager.stop(connections[2]);
+	CHECK(manager.size() == 0);
+}
+
+} // namespace
+
+TEST_CASE("connection manager tracks connections across shards", "[connection_manager]")
+{
+	SECTION("with locks")
+	{
+		check_manager(true);
+	}
+
+	SECTION("without locks")
+	{
+		check_manager(false);
+	}
+}
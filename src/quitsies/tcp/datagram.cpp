@@ -0,0 +1,175 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <quitsies/tcp/datagram.hpp>
+#include <quitsies/tcp/request.hpp>
+#include <quitsies/tcp/response.hpp>
+
+#include <algorithm>
+
+using namespace quitsies::tcp;
+
+const size_t datagram_handler::header_bytes;
+const size_t datagram_handler::max_datagram_bytes;
+
+namespace {
+
+uint16_t
+read_uint16(const char * data) {
+	return static_cast<uint16_t>( (static_cast<uint8_t>(data[0]) << 8)
+	                            | static_cast<uint8_t>(data[1]) );
+}
+
+void
+write_uint16(std::string & out, uint16_t value) {
+	out.push_back(static_cast<char>(value >> 8));
+	out.push_back(static_cast<char>(value & 0xff));
+}
+
+} // namespace
+
+datagram_handler::datagram_handler( db::store_ptr         db
+                                  , log::logger           log
+                                  , stats::aggregator_ptr stats
+                                  , size_t                max_request_bytes
+                                  , db::admission_ptr     admission
+                                  , command_stats_ptr     command_stats )
+	: _db(db)
+	, _log(log)
+	, _stats(stats)
+	, _max_request_bytes(max_request_bytes)
+	, _admission(admission)
+	, _command_stats(command_stats)
+{}
+
+bool
+datagram_handler::read_header(const char * data, size_t length, header & out) {
+	if ( length < header_bytes ) {
+		return false;
+	}
+	out.request_id = read_uint16(data);
+	out.sequence = read_uint16(data + 2);
+	out.total = read_uint16(data + 4);
+	return true;
+}
+
+bool
+datagram_handler::frame( uint16_t                   request_id
+                       , std::string const &        payload
+                       , std::vector<std::string> & out ) {
+	const size_t chunk = max_datagram_bytes - header_bytes;
+	size_t total = (payload.size() + chunk - 1) / chunk;
+	if ( total > UINT16_MAX ) {
+		return false;
+	}
+
+	for ( size_t i = 0; i < total; i++ ) {
+		size_t offset = i * chunk;
+		size_t length = std::min(chunk, payload.size() - offset);
+
+		std::string datagram;
+		datagram.reserve(header_bytes + length);
+		write_uint16(datagram, request_id);
+		write_uint16(datagram, static_cast<uint16_t>(i));
+		write_uint16(datagram, static_cast<uint16_t>(total));
+		write_uint16(datagram, 0);
+		datagram.append(payload, offset, length);
+		out.push_back(std::move(datagram));
+	}
+	return true;
+}
+
+void
+datagram_handler::handle(const char * data, size_t length, std::vector<std::string> & out) {
+	header h;
+	if ( !read_header(data, length, h) || h.sequence != 0 || h.total != 1 ) {
+		// Requests spanning several datagrams are not supported, as in memcached.
+		_stats->counter("udp.dropped", 1);
+		return;
+	}
+	_stats->counter("udp.request", 1);
+	if ( _command_stats ) {
+		_command_stats->add_bytes_read(length);
+	}
+
+	// Commands are deferred so that only gets reach the store.
+	request req(_db, _log, _stats, _max_request_bytes);
+	req.set_deferred(true);
+	req.set_admission(_admission);
+	req.set_command_stats(_command_stats);
+
+	response res;
+	const char * pending = data + header_bytes;
+	size_t pending_length = length - header_bytes;
+
+	bool done = false;
+	while ( !done ) {
+		switch ( req.get_status() ) {
+		case protocol::status_type::EXECUTING:
+			if ( req.get_command() == request::command_type::GET
+			  || req.get_command() == request::command_type::GETS ) {
+				req.execute();
+			} else {
+				res.append("CLIENT_ERROR only get and gets are served over UDP\r\n");
+				req.reset();
+			}
+			break;
+		case protocol::status_type::RESPONDING:
+			req.take_response(res);
+			req.resume();
+			break;
+		case protocol::status_type::FINISHED:
+			if ( !req.get_no_reply() ) {
+				req.take_response(res);
+			}
+			req.reset();
+			break;
+		case protocol::status_type::QUITTING:
+			done = true;
+			break;
+		default:
+			if ( pending_length == 0 ) {
+				// Whatever is left of an unfinished command is dropped.
+				done = true;
+				break;
+			}
+			{
+				size_t consumed = req.process(pending, pending_length);
+				pending += consumed;
+				pending_length -= consumed;
+			}
+			break;
+		}
+	}
+
+	size_t n_datagrams = out.size();
+	if ( !frame(h.request_id, res.str(), out) ) {
+		_log->warn("dropped a UDP response of {} bytes", res.size());
+		_stats->counter("udp.dropped", 1);
+	} else if ( _command_stats ) {
+		for ( size_t i = n_datagrams; i < out.size(); i++ ) {
+			_command_stats->add_bytes_written(out[i].size());
+		}
+	}
+}
@@ -0,0 +1,109 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef QUITSIES_DATAGRAM_HPP
+#define QUITSIES_DATAGRAM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <quitsies/db/store.hpp>
+#include <quitsies/db/admission.hpp>
+#include <quitsies/tcp/command_stats.hpp>
+#include <quitsies/log/logger.hpp>
+#include <quitsies/stats/aggregator.hpp>
+
+namespace quitsies { namespace tcp {
+
+/*
+ * Serves memcached text commands carried over UDP.
+ *
+ * Every datagram starts with an 8 byte frame header holding a request ID, the
+ * sequence number of the datagram, the total number of datagrams in the
+ * message and two reserved bytes, all in network byte order. A request must
+ * fit in a single datagram. Its response is split across as many datagrams as
+ * it needs, each echoing the request ID, as memcached does.
+ *
+ * Only get and gets are served, as UDP gives no guarantee that a write was
+ * received or answered.
+ */
+class datagram_handler {
+	db::store_ptr         _db;
+	log::logger           _log;
+	stats::aggregator_ptr _stats;
+	size_t                _max_request_bytes;
+	db::admission_ptr     _admission;
+	command_stats_ptr     _command_stats;
+
+public:
+	static const size_t header_bytes = 8;
+
+	// The largest datagram sent, including its frame header.
+	static const size_t max_datagram_bytes = 1400;
+
+	struct header {
+		uint16_t request_id;
+		uint16_t sequence;
+		uint16_t total;
+	};
+
+	datagram_handler(const datagram_handler&) = delete;
+
+	datagram_handler& operator=(const datagram_handler&) = delete;
+
+	datagram_handler( db::store_ptr         db
+	                , log::logger           log
+	                , stats::aggregator_ptr stats
+	                , size_t                max_request_bytes
+	                , db::admission_ptr     admission = db::admission_ptr()
+	                , command_stats_ptr     command_stats = command_stats_ptr() );
+
+	/*
+	 * Reads the frame header at the start of a datagram, returns false if the
+	 * datagram is too short to hold one.
+	 */
+	static bool read_header(const char * data, size_t length, header & out);
+
+	/*
+	 * Splits a response into datagrams of at most max_datagram_bytes, each
+	 * starting with its frame header. Returns false if the response needs more
+	 * datagrams than a header can count.
+	 */
+	static bool frame( uint16_t                   request_id
+	                 , std::string const &        payload
+	                 , std::vector<std::string> & out );
+
+	/*
+	 * Runs the commands of a request datagram and frames their responses into
+	 * out. Nothing is written when the datagram is dropped, or when none of
+	 * its commands want a reply.
+	 */
+	void handle(const char * data, size_t length, std::vector<std::string> & out);
+};
+
+} } // tcp, quitsies
+
+#endif // QUITSIES_DATAGRAM_HPP
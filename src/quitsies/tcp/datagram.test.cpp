@@ -0,0 +1,135 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <test/catch.hpp>
+
+#include <quitsies/tcp/datagram.hpp>
+#include <quitsies/stats/null_aggregator.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace quitsies::tcp;
+
+namespace {
+
+auto datagram_stats = quitsies::stats::aggregator_ptr(new quitsies::stats::null_aggregator());
+auto datagram_logger = quitsies::log::create("quitsies_datagram_test", "off");
+
+std::string
+make_header(uint16_t request_id, uint16_t sequence, uint16_t total) {
+	std::string h;
+	h.push_back(static_cast<char>(request_id >> 8));
+	h.push_back(static_cast<char>(request_id & 0xff));
+	h.push_back(static_cast<char>(sequence >> 8));
+	h.push_back(static_cast<char>(sequence & 0xff));
+	h.push_back(static_cast<char>(total >> 8));
+	h.push_back(static_cast<char>(total & 0xff));
+	h.push_back(0);
+	h.push_back(0);
+	return h;
+}
+
+} // namespace
+
+TEST_CASE("datagram frame headers", "[datagram]")
+{
+	SECTION("headers are read in network byte order")
+	{
+		std::string data = make_header(0x1234, 2, 0x0103) + "get a\r\n";
+		datagram_handler::header h;
+		REQUIRE(datagram_handler::read_header(data.data(), data.size(), h));
+		CHECK(h.request_id == 0x1234);
+		CHECK(h.sequence == 2);
+		CHECK(h.total == 0x0103);
+	}
+
+	SECTION("short datagrams have no header")
+	{
+		datagram_handler::header h;
+		CHECK_FALSE(datagram_handler::read_header("\x00\x01\x00", 3, h));
+	}
+
+	SECTION("small responses fit in one datagram")
+	{
+		std::vector<std::string> out;
+		REQUIRE(datagram_handler::frame(7, "END\r\n", out));
+		REQUIRE(out.size() == 1);
+		CHECK(out[0] == make_header(7, 0, 1) + "END\r\n");
+	}
+
+	SECTION("large responses are split with sequence numbers")
+	{
+		size_t chunk = datagram_handler::max_datagram_bytes - datagram_handler::header_bytes;
+		std::string payload(chunk * 2 + 10, 'v');
+		std::vector<std::string> out;
+		REQUIRE(datagram_handler::frame(300, payload, out));
+		REQUIRE(out.size() == 3);
+		CHECK(out[0].size() == datagram_handler::max_datagram_bytes);
+		CHECK(out[0].substr(0, 8) == make_header(300, 0, 3));
+		CHECK(out[1].substr(0, 8) == make_header(300, 1, 3));
+		CHECK(out[2] == make_header(300, 2, 3) + std::string(10, 'v'));
+	}
+
+	SECTION("empty responses send nothing")
+	{
+		std::vector<std::string> out;
+		REQUIRE(datagram_handler::frame(1, "", out));
+		CHECK(out.empty());
+	}
+}
+
+TEST_CASE("datagram requests", "[datagram]")
+{
+	// Without a store every get is answered with an error.
+	datagram_handler handler(quitsies::db::store_ptr(), datagram_logger, datagram_stats, 0);
+	std::vector<std::string> out;
+
+	SECTION("gets are answered with the request id")
+	{
+		std::string data = make_header(42, 0, 1) + "get a\r\n";
+		handler.handle(data.data(), data.size(), out);
+		REQUIRE(out.size() == 1);
+		CHECK(out[0] == make_header(42, 0, 1) + "ERROR The server isn't configured with a database\r\n");
+	}
+
+	SECTION("other commands are refused without running")
+	{
+		std::string data = make_header(5, 0, 1) + "set a 0 0 1\r\nx\r\nmn\r\n";
+		handler.handle(data.data(), data.size(), out);
+		REQUIRE(out.size() == 1);
+		CHECK(out[0] == make_header(5, 0, 1) + "CLIENT_ERROR only get and gets are served over UDP\r\n"
+		                                      + "CLIENT_ERROR only get and gets are served over UDP\r\n");
+	}
+
+	SECTION("requests spanning several datagrams are dropped")
+	{
+		std::string data = make_header(5, 0, 2) + "get a\r\n";
+		handler.handle(data.data(), data.size(), out);
+		CHECK(out.empty());
+
+		handler.handle(data.data(), 4, out);
+		CHECK(out.empty());
+	}
+}
@@ -0,0 +1,146 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef QUITSIES_PROTOCOL_HPP
+#define QUITSIES_PROTOCOL_HPP
+
+#include <string>
+#include <memory>
+
+#include <quitsies/tcp/response.hpp>
+#include <quitsies/tcp/command_stats.hpp>
+#include <quitsies/db/admission.hpp>
+
+namespace quitsies { namespace tcp {
+
+/*
+ * The common interface of the memcached protocol parsers.
+ *
+ * A connection feeds the bytes it reads into a protocol, and each time a
+ * command is finished it collects the response and resets the protocol for
+ * the next command.
+ */
+class protocol {
+public:
+	enum status_type {
+		COMMAND = 0,
+		DATA,
+		DATA_END,
+		SWALLOW,
+		RESPONDING,
+		FINISHED,
+		QUITTING,
+		EXECUTING
+	};
+
+	virtual ~protocol() {}
+
+	/*
+	 * Feeds a chunk of bytes read from the client into the parser, returning
+	 * the number of bytes consumed. Parsing stops once a command is finished.
+	 */
+	virtual size_t process(const char * data, size_t length) = 0;
+
+	virtual status_type get_status() = 0;
+
+	// Returns true if the protocol waits for a new command and holds none of
+	// its bytes, so the client is idle rather than part way through sending.
+	virtual bool idle() = 0;
+
+	/*
+	 * Exposes the unread part of a value payload so that the caller can read
+	 * it from the socket straight into the value rather than through its read
+	 * buffer. Returns an empty buffer unless a value is being read and at
+	 * least min_bytes of it are outstanding.
+	 *
+	 * Each call exposes as much of the value as has arrived so far, and at
+	 * least min_bytes, so a value is read in a few steps that double in size
+	 * while it grows with the bytes that arrive rather than to the length
+	 * that the client declares.
+	 *
+	 * The number of bytes read into the returned buffer must be passed to
+	 * fill_value before the protocol is used again.
+	 */
+	virtual boost::asio::mutable_buffer value_tail(size_t min_bytes) = 0;
+	virtual void fill_value(size_t length) = 0;
+
+	// Returns true if the finished command should not be replied to.
+	virtual bool get_no_reply() = 0;
+
+	// Returns a copy of the response to the finished command.
+	virtual std::string get_response() = 0;
+
+	/*
+	 * Moves the response segments that are ready to be written onto the end of
+	 * an outgoing response.
+	 *
+	 * Commands with large responses are answered in parts, while the status is
+	 * RESPONDING the caller should write out what has been taken so far and
+	 * then call resume to prepare the next part.
+	 */
+	virtual void take_response(response & out) = 0;
+	virtual void resume() = 0;
+
+	// Prepares the protocol for parsing the next command.
+	virtual void reset() = 0;
+
+	/*
+	 * Defers the store calls of each command. Once a deferred command is
+	 * parsed, or a command answered in parts is resumed, the status becomes
+	 * EXECUTING and parsing stops until the caller runs execute. This lets the
+	 * caller run store calls on a storage thread rather than its own.
+	 */
+	virtual void set_deferred(bool deferred) = 0;
+	virtual void execute() = 0;
+
+	/*
+	 * Admits each command that reaches the store through admission control,
+	 * and answers the commands that are shed with a busy error. The ticket of
+	 * an admitted command is released once its store work is done, before its
+	 * response is written. A reset only releases a ticket left by a command
+	 * that never ran.
+	 */
+	virtual void set_admission(db::admission_ptr admission) = 0;
+
+	/*
+	 * Counts each command, the keys it found or missed and how long it took
+	 * to answer into the shared command stats, which the stats command of the
+	 * text protocol reports.
+	 */
+	virtual void set_command_stats(command_stats_ptr command_stats) = 0;
+
+	/*
+	 * Lets the two high bits of the flags of a store select its durability,
+	 * as read by db::durability_from_flags, which removes them from the flags
+	 * that are stored. If not set (default) flags are stored as given.
+	 */
+	virtual void set_durability_flags(bool enabled) = 0;
+};
+
+typedef std::unique_ptr<protocol> protocol_ptr;
+
+} } // tcp, quitsies
+
+#endif // QUITSIES_PROTOCOL_HPP
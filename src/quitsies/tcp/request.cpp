@@ -24,86 +24,252 @@ SOFTWARE.
 
 #include <quitsies/tcp/request.hpp>
 
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
 using namespace quitsies::tcp;
 
-bool
-is_white_space(char c) {
-	return c == ' '
-		|| c == '\t'
-		|| c == '\f'
-		|| c == '\r'
-		|| c == '\n'
-		|| c == '\v';
-}
+const size_t request::max_retained_bytes;
+const size_t request::get_batch_keys;
+const size_t request::response_chunk_bytes;
 
-request::command_type
-command_from_str(std::string const& cmd) {
-	if ( cmd == "set" ) {
-		return request::command_type::SET;
-	}
-	if ( cmd == "add" ) {
-		return request::command_type::ADD;
+namespace quitsies { namespace tcp {
+
+/*
+ * A view over a single space delimited token of a command line, the bytes are
+ * owned by whichever buffer the line was scanned from.
+ */
+struct token {
+	const char * data;
+	size_t       size;
+
+	bool equals(const char * str, size_t len) const {
+		return size == len && std::memcmp(data, str, len) == 0;
 	}
-	if ( cmd == "get" ) {
-		return request::command_type::GET;
+
+	std::string str() const { return std::string(data, size); }
+};
+
+/*
+ * Walks the tokens of a command line without copying them.
+ */
+class tokenizer {
+	const char * _pos;
+	const char * _end;
+
+public:
+	tokenizer(const char * line, size_t length)
+		: _pos(line)
+		, _end(line + length)
+	{}
+
+	bool next(token & tok) {
+		while ( _pos < _end && *_pos == ' ' ) {
+			_pos++;
+		}
+		if ( _pos == _end ) {
+			return false;
+		}
+		const char * delim = static_cast<const char *>(std::memchr(_pos, ' ', _end - _pos));
+		if ( delim == nullptr ) {
+			delim = _end;
+		}
+		tok.data = _pos;
+		tok.size = delim - _pos;
+		_pos = delim;
+		return true;
 	}
-	if ( cmd == "gets" ) {
-		return request::command_type::GETS;
+};
+
+} } // tcp, quitsies
+
+request::command_type
+command_from_token(token const& tok) {
+	switch ( tok.size ) {
+	case 2:
+		if ( tok.data[0] != 'm' ) {
+			break;
+		}
+		switch ( tok.data[1] ) {
+		case 'g':
+			return request::command_type::MG;
+		case 's':
+			return request::command_type::MS;
+		case 'd':
+			return request::command_type::MD;
+		case 'n':
+			return request::command_type::MN;
+		}
+		break;
+	case 3:
+		switch ( tok.data[0] ) {
+		case 'g':
+			if ( tok.equals("get", 3) ) {
+				return request::command_type::GET;
+			}
+			return tok.equals("gat", 3) ? request::command_type::GAT : request::command_type::NONE;
+		case 's':
+			return tok.equals("set", 3) ? request::command_type::SET : request::command_type::NONE;
+		case 'a':
+			return tok.equals("add", 3) ? request::command_type::ADD : request::command_type::NONE;
+		case 'c':
+			return tok.equals("cas", 3) ? request::command_type::CAS : request::command_type::NONE;
+		}
+		break;
+	case 4:
+		switch ( tok.data[0] ) {
+		case 'g':
+			if ( tok.equals("gets", 4) ) {
+				return request::command_type::GETS;
+			}
+			return tok.equals("gats", 4) ? request::command_type::GATS : request::command_type::NONE;
+		case 'q':
+			return tok.equals("quit", 4) ? request::command_type::QUIT : request::command_type::NONE;
+		case 'p':
+			return tok.equals("ping", 4) ? request::command_type::PING : request::command_type::NONE;
+		case 'i':
+			return tok.equals("incr", 4) ? request::command_type::INCR : request::command_type::NONE;
+		case 'd':
+			return tok.equals("decr", 4) ? request::command_type::DECR : request::command_type::NONE;
+		}
+		break;
+	case 5:
+		if ( tok.equals("touch", 5) ) {
+			return request::command_type::TOUCH;
+		}
+		return tok.equals("stats", 5) ? request::command_type::STATS : request::command_type::NONE;
+	case 6:
+		if ( tok.equals("delete", 6) ) {
+			return request::command_type::DELETE;
+		}
+		return tok.equals("append", 6) ? request::command_type::APPEND : request::command_type::NONE;
+	case 7:
+		return tok.equals("prepend", 7) ? request::command_type::PREPEND : request::command_type::NONE;
 	}
-	if ( cmd == "delete" ) {
-		return request::command_type::DELETE;
+	return request::command_type::NONE;
+}
+
+unsigned long long
+parse_uint(token const& tok, char const * field) {
+	if ( tok.size == 0 || tok.size > 20 ) {
+		throw std::runtime_error(std::string("invalid ") + field);
 	}
-	if ( cmd == "quit" ) {
-		return request::command_type::QUIT;
+	unsigned long long n = 0;
+	for ( size_t i = 0; i < tok.size; i++ ) {
+		unsigned char d = static_cast<unsigned char>(tok.data[i] - '0');
+		if ( d > 9 || n > (ULLONG_MAX - d) / 10 ) {
+			throw std::runtime_error(std::string("invalid ") + field);
+		}
+		n = n * 10 + d;
 	}
-	if ( cmd == "ping" ) {
-		return request::command_type::PING;
+	return n;
+}
+
+long long
+parse_int(token const& tok, char const * field) {
+	bool negative = tok.size > 0 && tok.data[0] == '-';
+	token digits = negative ? token{ tok.data + 1, tok.size - 1 } : tok;
+	unsigned long long n = parse_uint(digits, field);
+	if ( n > static_cast<unsigned long long>(LLONG_MAX) ) {
+		throw std::runtime_error(std::string("invalid ") + field);
 	}
-	return request::command_type::NONE;
+	return negative ? -static_cast<long long>(n) : static_cast<long long>(n);
 }
 
-request::status_type
-status_from_command(request::command_type const& cmd) {
-	switch (cmd) {
-	case request::command_type::SET:
-	case request::command_type::ADD:
-		return request::status_type::STORAGE_KEY;
-	case request::command_type::GET:
-	case request::command_type::GETS:
-		return request::status_type::RETRIEVAL_KEY;
-	case request::command_type::DELETE:
-		return request::status_type::DELETE_KEY;
-	case request::command_type::QUIT:
-		return request::status_type::QUITTING;
-	case request::command_type::PING:
-		return request::status_type::FINISHED;
-	case request::command_type::NONE:
-	default:
-		throw std::runtime_error("unsupported command");
+void
+request::prepare_get_response() {
+	try {
+		while ( _next_key < _keys.size() ) {
+			if ( _response.size() >= response_chunk_bytes ) {
+				// Hand over what we have so far before fetching more.
+				_status = status_type::RESPONDING;
+				return;
+			}
+
+			size_t n_keys = std::min(get_batch_keys, _keys.size() - _next_key);
+			std::vector<std::string> batch(_keys.begin() + _next_key, _keys.begin() + _next_key + n_keys);
+
+			std::vector<std::string> values;
+			std::vector<db::item_meta> metas;
+			std::vector<db::status> statuses;
+			if ( _command == command_type::GAT || _command == command_type::GATS ) {
+				// Each hit has its expiry replaced as it is read.
+				auto exp_time = db::exp_time_from_memcached(_exp_time, db::now_seconds());
+				values.resize(n_keys);
+				metas.resize(n_keys);
+				for ( size_t i = 0; i < batch.size(); i++ ) {
+					statuses.push_back(_db->touch(batch[i], exp_time, &values[i], &metas[i]));
+				}
+			} else {
+				statuses = _db->multi_get(batch, &values, &metas);
+			}
+			for ( size_t i = 0; i < batch.size(); i++ ) {
+				count_key(statuses[i]);
+				if ( statuses[i].ok() ) {
+					std::stringstream ss;
+					ss << "VALUE " << batch[i] << " " << metas[i].flags << " " << values[i].length();
+					if ( _command == command_type::GETS || _command == command_type::GATS ) {
+						ss << " " << metas[i].cas;
+					}
+					ss << "\r\n";
+					_response.append(ss.str());
+					_response.append_value(std::move(values[i]));
+					_response.append("\r\n", 2);
+				}
+			}
+			_next_key += n_keys;
+		}
+		_response.append("END\r\n", 5);
+	} catch (std::exception & e) {
+		std::stringstream ss;
+		ss << "ERROR " << e.what() << "\r\n";
+		_response.append(ss.str());
 	}
-	return request::status_type::FINISHED;
+	_status = status_type::FINISHED;
 }
 
-bool
-is_returned(std::stringstream & buffer) {
-	buffer.seekg(0, std::ios::end);
-	return buffer.get() == '\r';
+quitsies::db::item_meta
+request::meta_to_store(db::durability * level) {
+	uint32_t flags = static_cast<uint32_t>(_flags);
+	auto requested = db::durability::DEFAULT;
+	if ( _durability_flags ) {
+		requested = db::durability_from_flags(&flags);
+	}
+	if ( level != nullptr ) {
+		*level = requested;
+	}
+	return db::item_meta( flags
+	                    , db::exp_time_from_memcached(_exp_time, db::now_seconds())
+	                    , _cas_unique );
 }
 
 void
 request::prepare_response() {
 	if ( _command == command_type::PING ) {
-		_response = "PONG\r\n";
+		_response.assign("PONG\r\n");
 		_status = status_type::FINISHED;
 		return;
 	}
+	if ( _command == command_type::MN ) {
+		_response.assign("MN\r\n");
+		_status = status_type::FINISHED;
+		return;
+	}
+	if ( _command == command_type::STATS ) {
+		prepare_stats_response();
+		return;
+	}
 	if ( !_db ) {
-		_response = "ERROR The server isn't configured with a database\r\n";
+		_response.assign("ERROR The server isn't configured with a database\r\n");
 		_status = status_type::FINISHED;
 		return;
 	}
 	if ( _keys.size() == 0 ) {
-		_response = "ERROR No key was found in request\r\n";
+		_response.assign("ERROR No key was found in request\r\n");
 		_status = status_type::FINISHED;
 		return;
 	}
@@ -112,16 +278,12 @@ request::prepare_response() {
 		switch (_command) {
 		case command_type::DELETE:
 			{
-				std::string value;
-				auto status = _db->get(_keys[0], &value);
-				if ( !status.ok() ) {
-					ss << "NOT_FOUND\r\n";
-					break;
-				}
-
-				status = _db->del(_keys[0]);
+				auto status = _db->del(_keys[0], db::durability::DEFAULT, _no_reply);
+				count_key(status);
 				if ( status.ok() ) {
 					ss << "DELETED\r\n";
+				} else if ( status.is_not_found() ) {
+					ss << "NOT_FOUND\r\n";
 				} else {
 					ss << "ERROR ";
 					ss << status.to_string();
@@ -131,34 +293,45 @@ request::prepare_response() {
 			break;
 		case command_type::ADD:
 			{
-				_db->lock();
-				std::string value;
-				auto status = _db->get(_keys[0], &value);
-				if ( !status.ok() ) {
-					if ( status.is_not_found() ) {
-						status = _db->put(_keys[0], _buffer.str());
-						if ( status.ok() ) {
-							ss << "STORED\r\n";
-						} else {
-							ss << "ERROR ";
-							ss << status.to_string();
-							ss << "\r\n";
-						}
-					} else {
-						ss << "ERROR ";
-						ss << status.to_string();
-						ss << "\r\n";
-					}
-				} else {
+				db::durability level;
+				auto meta = meta_to_store(&level);
+				auto status = _db->add(_keys[0], _value, meta, nullptr, level, _no_reply);
+				if ( status.ok() ) {
+					ss << "STORED\r\n";
+				} else if ( status.is_exists() ) {
 					// Add is only applied if the key does not exist
 					ss << "NOT_STORED\r\n";
+				} else {
+					ss << "ERROR ";
+					ss << status.to_string();
+					ss << "\r\n";
+				}
+			}
+			break;
+		case command_type::CAS:
+			{
+				db::durability level;
+				auto meta = meta_to_store(&level);
+				auto status = _db->cas(_keys[0], _value, meta, nullptr, level, _no_reply);
+				count_key(status);
+				if ( status.ok() ) {
+					ss << "STORED\r\n";
+				} else if ( status.is_exists() ) {
+					ss << "EXISTS\r\n";
+				} else if ( status.is_not_found() ) {
+					ss << "NOT_FOUND\r\n";
+				} else {
+					ss << "ERROR ";
+					ss << status.to_string();
+					ss << "\r\n";
 				}
-				_db->unlock();
 			}
 			break;
 		case command_type::SET:
 			{
-				auto status = _db->put(_keys[0], _buffer.str());
+				db::durability level;
+				auto meta = meta_to_store(&level);
+				auto status = _db->put(_keys[0], _value, meta, nullptr, level, _no_reply);
 				if ( status.ok() ) {
 					ss << "STORED\r\n";
 				} else {
@@ -168,144 +341,718 @@ request::prepare_response() {
 				}
 			}
 			break;
-		case command_type::GET:
-		case command_type::GETS:
-			for ( auto key : _keys ) {
+		case command_type::INCR:
+		case command_type::DECR:
+			{
+				bool decr = _command == command_type::DECR;
+				if ( _no_reply ) {
+					// Nobody is waiting on the new value, so skip reading it.
+					auto status = _db->incr(_keys[0], _delta, decr);
+					count_key(status);
+					if ( !status.ok() ) {
+						ss << "ERROR " << status.to_string() << "\r\n";
+					}
+					break;
+				}
+
 				std::string value;
-				auto status = _db->get(key, &value);
+				uint64_t counter;
+				auto status = _db->incr(_keys[0], _delta, decr, &value);
+				count_key(status);
+				if ( status.ok() ) {
+					if ( db::parse_counter(value.data(), value.size(), &counter) ) {
+						ss << value << "\r\n";
+					} else {
+						ss << "CLIENT_ERROR cannot increment or decrement non-numeric value\r\n";
+					}
+				} else if ( status.is_not_found() ) {
+					ss << "NOT_FOUND\r\n";
+				} else {
+					ss << "ERROR ";
+					ss << status.to_string();
+					ss << "\r\n";
+				}
+			}
+			break;
+		case command_type::APPEND:
+		case command_type::PREPEND:
+			{
+				auto status = _db->append(_keys[0], _value, _command == command_type::PREPEND);
+				if ( status.ok() ) {
+					ss << "STORED\r\n";
+				} else if ( status.is_not_found() ) {
+					ss << "NOT_STORED\r\n";
+				} else {
+					ss << "ERROR ";
+					ss << status.to_string();
+					ss << "\r\n";
+				}
+			}
+			break;
+		case command_type::TOUCH:
+			{
+				auto status = _db->touch(_keys[0], meta_to_store().exp_time);
+				count_key(status);
 				if ( status.ok() ) {
-					ss << "VALUE " << key << " 0 " << value.length() << "\r\n";
-					ss << value << "\r\n";
+					ss << "TOUCHED\r\n";
+				} else if ( status.is_not_found() ) {
+					ss << "NOT_FOUND\r\n";
+				} else {
+					ss << "ERROR ";
+					ss << status.to_string();
+					ss << "\r\n";
 				}
 			}
-			ss << "END\r\n";
+			break;
+		case command_type::GET:
+		case command_type::GETS:
+		case command_type::GAT:
+		case command_type::GATS:
+			prepare_get_response();
+			return;
+		case command_type::MG:
+		case command_type::MS:
+		case command_type::MD:
+			prepare_meta_response(ss);
 			break;
 		case request::command_type::NONE:
 		default:
 			throw std::runtime_error("unsupported command");
 		}
-		_response = ss.str();
+		_response.append(ss.str());
 	} catch (std::exception & e) {
 		std::stringstream ss;
 		ss << "ERROR " << e.what() << "\r\n";
-		_response = ss.str();
+		_response.assign(ss.str());
 	}
 	_status = status_type::FINISHED;
 }
 
 void
-request::process(const char * data, size_t length) {
-	try {
-		if ( _max_bytes > 0 && (length + _buffer.tellp() >= _max_bytes) ) {
-			throw std::runtime_error("request size exceeded max bytes");
-		}
-		for ( size_t i = 0; i < length; i++ ) {
-			if ( _status == status_type::DATA ) {
-				if ( _remaining > 0 ) {
-					_remaining--;
-					_buffer << data[i];
-					continue;
-				} else {
-					prepare_response();
-					return;
-				}
+request::prepare_stats_response() {
+	std::string group = _keys.empty() ? std::string() : _keys[0];
+	std::stringstream ss;
+	if ( group.empty() ) {
+		if ( _command_stats ) {
+			_command_stats->report(ss);
+		}
+	} else if ( group == "latency" ) {
+		if ( _command_stats ) {
+			_command_stats->report_latency(ss);
+		}
+	} else if ( group == "rocksdb" && _db ) {
+		try {
+			for ( auto & property : _db->properties() ) {
+				ss << "STAT " << property.first << " " << property.second << "\r\n";
 			}
-			if ( is_white_space(data[i]) ) {
-				if ( _status == status_type::COMMAND )
-				{
-					_command = command_from_str(_buffer.str());
-					_buffer.str(std::string());
-					_status = status_from_command(_command);
-					if ( _status == status_type::FINISHED ) {
-						prepare_response();
-						return;
-					}
+		} catch (std::exception & e) {
+			ss.str(std::string());
+			ss << "SERVER_ERROR " << e.what() << "\r\n";
+			_response.assign(ss.str());
+			_status = status_type::FINISHED;
+			return;
+		}
+	} else {
+		_response.assign("CLIENT_ERROR unknown stats group\r\n");
+		_status = status_type::FINISHED;
+		return;
+	}
+	ss << "END\r\n";
+	_response.assign(ss.str());
+	_status = status_type::FINISHED;
+}
+
+command_stats::command_type
+request::stats_command() {
+	switch ( _command ) {
+	case command_type::GET:     return command_stats::GET;
+	case command_type::GETS:    return command_stats::GETS;
+	case command_type::GAT:     return command_stats::GAT;
+	case command_type::GATS:    return command_stats::GATS;
+	case command_type::TOUCH:   return command_stats::TOUCH;
+	case command_type::SET:     return command_stats::SET;
+	case command_type::ADD:     return command_stats::ADD;
+	case command_type::CAS:     return command_stats::CAS;
+	case command_type::APPEND:  return command_stats::APPEND;
+	case command_type::PREPEND: return command_stats::PREPEND;
+	case command_type::INCR:    return command_stats::INCR;
+	case command_type::DECR:    return command_stats::DECR;
+	case command_type::DELETE:  return command_stats::DELETE;
+	case command_type::MG:      return command_stats::MG;
+	case command_type::MS:      return command_stats::MS;
+	case command_type::MD:      return command_stats::MD;
+	default:                    return command_stats::N_COMMANDS;
+	}
+}
+
+void
+request::count_key(db::status & status) {
+	if ( !_command_stats ) {
+		return;
+	}
+	auto command = stats_command();
+	if ( command == command_stats::N_COMMANDS ) {
+		return;
+	}
+	_command_stats->key(command);
+	if ( status.ok() || status.is_not_found() ) {
+		_command_stats->hit(command, status.ok());
+	}
+}
+
+void
+request::record_latency() {
+	if ( _started == std::chrono::steady_clock::time_point() ) {
+		return;
+	}
+	if ( _status == status_type::EXECUTING ) {
+		// A deferred command that was dropped without being run.
+		_started = std::chrono::steady_clock::time_point();
+		return;
+	}
+	_command_stats->record(stats_command(), std::chrono::steady_clock::now() - _started);
+	_started = std::chrono::steady_clock::time_point();
+}
+
+void
+request::append_meta_flags(std::ostream & ss, std::string const & value, db::item_meta const & meta) {
+	for ( auto flag : _meta_flags ) {
+		switch ( flag ) {
+		case 'c':
+			ss << " c" << meta.cas;
+			break;
+		case 'f':
+			ss << " f" << meta.flags;
+			break;
+		case 'k':
+			ss << " k" << _keys[0];
+			break;
+		case 'O':
+			ss << " O" << _opaque;
+			break;
+		case 's':
+			ss << " s" << value.length();
+			break;
+		case 't':
+			ss << " t" << db::ttl_remaining(meta, db::now_seconds());
+			break;
+		}
+	}
+}
+
+void
+request::prepare_meta_response(std::stringstream & ss) {
+	switch ( _command ) {
+	case command_type::MG:
+		{
+			std::string value;
+			db::item_meta meta;
+			// A new TTL given to mg touches the item as it is read.
+			auto status = _meta_flags.find('T') == std::string::npos
+				? _db->get(_keys[0], &value, &meta)
+				: _db->touch(_keys[0], meta_to_store().exp_time, &value, &meta);
+			count_key(status);
+			if ( status.ok() ) {
+				bool with_value = _meta_flags.find('v') != std::string::npos;
+				ss << (with_value ? "VA " : "HD");
+				if ( with_value ) {
+					ss << value.length();
 				}
-				else if ( _status == status_type::DELETE_KEY )
-				{
-					std::string key = _buffer.str();
-					if ( key.length() == 0 ) {
-						throw std::runtime_error("invalid key");
-					}
-					_keys.push_back(key);
-					_buffer.str(std::string());
-					_status = status_type::NOREP;
+				append_meta_flags(ss, value, meta);
+				ss << "\r\n";
+				if ( with_value ) {
+					_response.append(ss.str());
+					_response.append_value(std::move(value));
+					ss.str(std::string());
+					ss << "\r\n";
 				}
-				else if ( _status == status_type::STORAGE_KEY )
-				{
-					std::string key = _buffer.str();
-					if ( key.length() == 0 ) {
-						throw std::runtime_error("invalid key");
-					}
-					_keys.push_back(key);
-					_buffer.str(std::string());
-					_status = status_type::FLAGS;
+			} else if ( status.is_not_found() ) {
+				// Quiet mode hides misses.
+				_no_reply = _quiet;
+				ss << "EN\r\n";
+			} else {
+				ss << "ERROR " << status.to_string() << "\r\n";
+			}
+		}
+		break;
+	case command_type::MS:
+		{
+			db::durability level;
+			auto meta = meta_to_store(&level);
+			db::status status(false);
+			if ( _meta_mode == 'E' ) {
+				status = _db->add(_keys[0], _value, meta, &meta.cas, level);
+			} else if ( _meta_flags.find('C') != std::string::npos ) {
+				status = _db->cas(_keys[0], _value, meta, &meta.cas, level);
+			} else {
+				status = _db->put(_keys[0], _value, meta, &meta.cas, level);
+			}
+			if ( status.is_exists() ) {
+				// Add or compare and swap was not applied.
+				ss << (_meta_mode == 'E' ? "NS" : "EX");
+				append_meta_flags(ss, _value, meta);
+				ss << "\r\n";
+			} else if ( status.is_not_found() ) {
+				ss << "NF";
+				append_meta_flags(ss, _value, meta);
+				ss << "\r\n";
+			} else if ( status.ok() ) {
+				// Quiet mode hides successful stores.
+				_no_reply = _quiet;
+				ss << "HD";
+				append_meta_flags(ss, _value, meta);
+				ss << "\r\n";
+			} else {
+				ss << "ERROR " << status.to_string() << "\r\n";
+			}
+		}
+		break;
+	case command_type::MD:
+		{
+			// Deletes never read the item, so only the flags that echo the
+			// request are returned.
+			std::string value;
+			db::item_meta meta;
+			auto status = _db->del(_keys[0]);
+			count_key(status);
+			if ( status.ok() || status.is_not_found() ) {
+				_no_reply = _quiet;
+				ss << (status.ok() ? "HD" : "NF");
+				append_meta_flags(ss, value, meta);
+				ss << "\r\n";
+			} else {
+				ss << "ERROR " << status.to_string() << "\r\n";
+			}
+		}
+		break;
+	default:
+		throw std::runtime_error("unsupported command");
+	}
+}
+
+void
+request::swallow_data(const char * error) {
+	// Skip over the data block so the stream stays in sync.
+	_remaining += 2;
+	_status = status_type::SWALLOW;
+	_response.assign(std::string("CLIENT_ERROR ") + error + "\r\n");
+}
+
+void
+request::expect_data() {
+	if ( _max_bytes > 0 && _remaining > _max_bytes ) {
+		swallow_data("object too large for cache");
+		_response.assign("SERVER_ERROR object too large for cache\r\n");
+		return;
+	}
+	// Only reserve a bounded amount up front, the value grows as it arrives.
+	_value.reserve(std::min(_remaining, max_retained_bytes));
+	_status = _remaining > 0 ? status_type::DATA : status_type::DATA_END;
+}
+
+void
+request::parse_meta_flags(tokenizer & tokens) {
+	token tok;
+	while ( tokens.next(tok) ) {
+		token arg = { tok.data + 1, tok.size - 1 };
+		switch ( tok.data[0] ) {
+		case 'q':
+			_quiet = true;
+			break;
+		case 'c':
+		case 'f':
+		case 'k':
+		case 's':
+		case 't':
+		case 'v':
+			_meta_flags.push_back(tok.data[0]);
+			break;
+		case 'O':
+			_opaque = arg.str();
+			_meta_flags.push_back(tok.data[0]);
+			break;
+		case 'F':
+			_flags = static_cast<int>(parse_uint(arg, "flags"));
+			break;
+		case 'T':
+			_exp_time = static_cast<int>(parse_int(arg, "exptime"));
+			_meta_flags.push_back(tok.data[0]);
+			break;
+		case 'C':
+			_cas_unique = parse_uint(arg, "cas unique");
+			_meta_flags.push_back(tok.data[0]);
+			break;
+		case 'M':
+			if ( arg.size != 1 ) {
+				throw std::runtime_error("invalid mode switch");
+			}
+			switch ( arg.data[0] ) {
+			case 'S':
+			case 's':
+			case 'E':
+			case 'e':
+				_meta_mode = static_cast<char>(std::toupper(arg.data[0]));
+				break;
+			default:
+				throw std::runtime_error("invalid mode switch");
+			}
+			break;
+		default:
+			throw std::runtime_error("invalid flag");
+		}
+	}
+}
+
+void
+request::parse_command(const char * line, size_t length) {
+	if ( length > 0 && line[length - 1] == '\r' ) {
+		length--;
+	}
+
+	tokenizer tokens(line, length);
+	token tok;
+	if ( !tokens.next(tok) ) {
+		throw std::runtime_error("unsupported command");
+	}
+
+	_command = command_from_token(tok);
+	switch ( _command ) {
+	case command_type::SET:
+	case command_type::ADD:
+	case command_type::CAS:
+	case command_type::APPEND:
+	case command_type::PREPEND:
+		{
+			token key, flags, exp_time, n_bytes, cas_unique;
+			if ( !tokens.next(key) || !tokens.next(flags)
+			  || !tokens.next(exp_time) || !tokens.next(n_bytes)
+			  || (_command == command_type::CAS && !tokens.next(cas_unique)) ) {
+				throw std::runtime_error("bad command line format");
+			}
+			_keys.push_back(key.str());
+			_remaining = parse_uint(n_bytes, "bytes");
+			try {
+				_flags = static_cast<int>(parse_uint(flags, "flags"));
+				_exp_time = static_cast<int>(parse_int(exp_time, "exptime"));
+				if ( _command == command_type::CAS ) {
+					_cas_unique = parse_uint(cas_unique, "cas unique");
 				}
-				else if ( _status == status_type::FLAGS )
-				{
-					_flags = std::stoi(_buffer.str());
-					_buffer.str(std::string());
-					_status = status_type::EXPTIME;
+			} catch (std::exception & e) {
+				swallow_data(e.what());
+				break;
+			}
+			while ( tokens.next(tok) ) {
+				if ( tok.equals("noreply", 7) ) {
+					_no_reply = true;
 				}
-				else if ( _status == status_type::EXPTIME )
-				{
-					_exp_time = std::stoi(_buffer.str());
-					_buffer.str(std::string());
-					_status = status_type::NBYTES;
+			}
+			expect_data();
+		}
+		break;
+	case command_type::MS:
+		{
+			token key, n_bytes;
+			if ( !tokens.next(key) || !tokens.next(n_bytes) ) {
+				throw std::runtime_error("bad command line format");
+			}
+			_keys.push_back(key.str());
+			_remaining = parse_uint(n_bytes, "bytes");
+			try {
+				parse_meta_flags(tokens);
+			} catch (std::exception & e) {
+				swallow_data(e.what());
+				break;
+			}
+			expect_data();
+		}
+		break;
+	case command_type::MG:
+	case command_type::MD:
+		if ( !tokens.next(tok) ) {
+			throw std::runtime_error("bad command line format");
+		}
+		_keys.push_back(tok.str());
+		parse_meta_flags(tokens);
+		command_ready();
+		break;
+	case command_type::MN:
+		command_ready();
+		break;
+	case command_type::GET:
+	case command_type::GETS:
+		while ( tokens.next(tok) ) {
+			_keys.push_back(tok.str());
+		}
+		command_ready();
+		break;
+	case command_type::GAT:
+	case command_type::GATS:
+		if ( !tokens.next(tok) ) {
+			throw std::runtime_error("bad command line format");
+		}
+		_exp_time = static_cast<int>(parse_int(tok, "exptime"));
+		while ( tokens.next(tok) ) {
+			_keys.push_back(tok.str());
+		}
+		command_ready();
+		break;
+	case command_type::INCR:
+	case command_type::DECR:
+		{
+			token key, delta;
+			if ( !tokens.next(key) || !tokens.next(delta) ) {
+				throw std::runtime_error("bad command line format");
+			}
+			_keys.push_back(key.str());
+			_delta = parse_uint(delta, "numeric delta argument");
+			while ( tokens.next(tok) ) {
+				if ( tok.equals("noreply", 7) ) {
+					_no_reply = true;
 				}
-				else if ( _status == status_type::NBYTES )
-				{
-					_remaining = std::stoi(_buffer.str());
-					_buffer.str(std::string());
-					_status = status_type::NOREP;
+			}
+			command_ready();
+		}
+		break;
+	case command_type::TOUCH:
+		{
+			token key, exp_time;
+			if ( !tokens.next(key) || !tokens.next(exp_time) ) {
+				throw std::runtime_error("bad command line format");
+			}
+			_keys.push_back(key.str());
+			_exp_time = static_cast<int>(parse_int(exp_time, "exptime"));
+			while ( tokens.next(tok) ) {
+				if ( tok.equals("noreply", 7) ) {
+					_no_reply = true;
 				}
-				else if ( _status == status_type::NOREP )
+			}
+			command_ready();
+		}
+		break;
+	case command_type::DELETE:
+		if ( !tokens.next(tok) ) {
+			throw std::runtime_error("invalid key");
+		}
+		_keys.push_back(tok.str());
+		while ( tokens.next(tok) ) {
+			if ( tok.equals("noreply", 7) ) {
+				_no_reply = true;
+			}
+		}
+		command_ready();
+		break;
+	case command_type::PING:
+		command_ready();
+		break;
+	case command_type::STATS:
+		// An optional group selects which stats are reported.
+		if ( tokens.next(tok) ) {
+			_keys.push_back(tok.str());
+		}
+		command_ready();
+		break;
+	case command_type::QUIT:
+		_no_reply = true;
+		_status = status_type::QUITTING;
+		break;
+	case command_type::NONE:
+	default:
+		throw std::runtime_error("unsupported command");
+	}
+}
+
+size_t
+request::process(const char * data, size_t length) {
+	const char * pos = data;
+	const char * end = data + length;
+	try {
+		while ( pos < end ) {
+			switch ( _status ) {
+			case status_type::COMMAND:
 				{
-					if ( _buffer.str() == "noreply" ) {
-						_buffer.str(std::string());
-						_no_reply = true;
-						_status = status_type::NOREP;
-						continue;
+					const char * eol = static_cast<const char *>(std::memchr(pos, '\n', end - pos));
+					if ( eol == nullptr ) {
+						if ( _max_bytes > 0 && (_line.size() + (end - pos) >= _max_bytes) ) {
+							throw std::runtime_error("request size exceeded max bytes");
+						}
+						_line.append(pos, end - pos);
+						return length;
 					}
-					if ( _remaining > 0 ) {
-						_status = status_type::DATA;
+					const char * line = pos;
+					pos = eol + 1;
+					if ( _line.empty() ) {
+						// The whole line is in this read, tokenise it in place.
+						parse_command(line, eol - line);
 					} else {
-						prepare_response();
-						return;
+						std::string joined;
+						joined.swap(_line);
+						joined.append(line, eol - line);
+						parse_command(joined.data(), joined.size());
 					}
 				}
-				else if ( _status == status_type::RETRIEVAL_KEY
-				       || _status == status_type::RETRIEVAL_KEYS )
+				break;
+			case status_type::DATA:
 				{
-					if ( _buffer.tellp() == 0 ) {
-						prepare_response();
-						return;
-					} else {
-						std::string key = _buffer.str();
-						if ( key.length() == 0 ) {
-							throw std::runtime_error("invalid key");
-						}
-						_keys.push_back(key);
-						_buffer.str(std::string());
+					size_t n = std::min(_remaining, static_cast<size_t>(end - pos));
+					_value.append(pos, n);
+					_remaining -= n;
+					pos += n;
+					if ( _remaining == 0 ) {
+						_status = status_type::DATA_END;
 					}
 				}
-				continue;
+				break;
+			case status_type::DATA_END:
+				if ( *pos == '\r' ) {
+					pos++;
+				} else if ( *pos == '\n' ) {
+					pos++;
+					command_ready();
+				} else {
+					_status = status_type::FINISHED;
+					throw std::runtime_error("bad data chunk");
+				}
+				break;
+			case status_type::SWALLOW:
+				{
+					size_t n = std::min(_remaining, static_cast<size_t>(end - pos));
+					_remaining -= n;
+					pos += n;
+					if ( _remaining == 0 ) {
+						_status = status_type::FINISHED;
+					}
+				}
+				break;
+			case status_type::FINISHED:
+			case status_type::QUITTING:
+			default:
+				// Anything following a complete command is left for the next
+				// request.
+				return pos - data;
 			}
-			_buffer << data[i];
 		}
 	} catch (std::exception & e) {
 		_status = status_type::FINISHED;
 
 		std::stringstream ss;
 		ss << "CLIENT_ERROR " << e.what() << "\r\n";
-		_response = ss.str();
+		_response.assign(ss.str());
+	}
+	return pos - data;
+}
+
+boost::asio::mutable_buffer
+request::value_tail(size_t min_bytes) {
+	if ( _status != status_type::DATA || _remaining == 0 || _remaining < min_bytes ) {
+		return boost::asio::mutable_buffer();
+	}
+	size_t filled = _value.size();
+	_tail = std::min(_remaining, std::max(min_bytes, filled));
+	_value.resize(filled + _tail);
+	return boost::asio::buffer(&_value[filled], _tail);
+}
+
+void
+request::fill_value(size_t length) {
+	// Drop the part of the tail that was not read.
+	_value.resize(_value.size() - (_tail - length));
+	_tail = 0;
+	_remaining -= length;
+	if ( _remaining == 0 ) {
+		// The trailing line terminator is parsed from the next read.
+		_status = status_type::DATA_END;
 	}
 }
 
 std::string
 request::get_response() {
-	if ( _status != status_type::FINISHED ) {
+	if ( _status != status_type::FINISHED && _status != status_type::QUITTING ) {
 		throw std::runtime_error("request not fully parsed");
 	}
-	return _response;
+	return _response.str();
+}
+
+void
+request::take_response(response & out) {
+	out.splice(_response);
+}
+
+void
+request::resume() {
+	if ( _status == status_type::RESPONDING ) {
+		if ( _deferred ) {
+			_status = status_type::EXECUTING;
+		} else {
+			prepare_get_response();
+		}
+	}
+}
+
+bool
+request::admit() {
+	if ( !_admission ) {
+		return true;
+	}
+
+	switch ( _command ) {
+	case command_type::MG:
+		if ( _meta_flags.find('T') != std::string::npos ) {
+			// Touching the item rewrites it.
+			_ticket = _admission->admit_write(0);
+			break;
+		}
+		// fall through
+	case command_type::GET:
+	case command_type::GETS:
+		_ticket = _admission->admit_read();
+		break;
+	case command_type::GAT:
+	case command_type::GATS:
+		_ticket = _admission->admit_write(0);
+		break;
+	case command_type::PING:
+	case command_type::MN:
+	case command_type::STATS:
+		// Commands that never write to the store are always answered, so
+		// that a busy server can still be inspected.
+		return true;
+	default:
+		_ticket = _admission->admit_write(_value.size());
+		break;
+	}
+
+	if ( !_ticket ) {
+		_response.assign("SERVER_ERROR busy\r\n");
+		_status = status_type::FINISHED;
+		return false;
+	}
+	return true;
+}
+
+void
+request::command_ready() {
+	if ( !admit() ) {
+		return;
+	}
+	if ( _command_stats && stats_command() != command_stats::N_COMMANDS ) {
+		_started = std::chrono::steady_clock::now();
+	}
+	if ( _deferred ) {
+		_status = status_type::EXECUTING;
+	} else {
+		prepare_response();
+		// The store is done with the command, whatever is left to write.
+		_ticket.release();
+	}
+}
+
+void
+request::execute() {
+	if ( _next_key > 0 ) {
+		// Carry on with a get that is being answered in parts.
+		prepare_get_response();
+	} else {
+		prepare_response();
+	}
+	_ticket.release();
 }
@@ -25,33 +25,26 @@ SOFTWARE.
 #ifndef REQUEST_HPP
 #define REQUEST_HPP
 
-#include <string>
+#include <chrono>
 #include <sstream>
+#include <string>
 #include <vector>
 
+#include <quitsies/tcp/protocol.hpp>
+#include <quitsies/tcp/command_stats.hpp>
 #include <quitsies/db/store.hpp>
 #include <quitsies/log/logger.hpp>
 #include <quitsies/stats/aggregator.hpp>
 
 namespace quitsies { namespace tcp {
 
-class request {
-public:
-	enum status_type {
-		COMMAND = 0,
-		DELETE_KEY,
-		STORAGE_KEY,
-		FLAGS,
-		EXPTIME,
-		NBYTES,
-		NOREP,
-		DATA,
-		RETRIEVAL_KEY,
-		RETRIEVAL_KEYS,
-		FINISHED,
-		QUITTING
-	};
+class tokenizer;
 
+/*
+ * Parses and responds to commands of the memcached text protocol.
+ */
+class request : public protocol {
+public:
 	enum command_type {
 		NONE = 0,
 		SET,
@@ -60,7 +53,20 @@ public:
 		GETS,
 		DELETE,
 		QUIT,
-		PING
+		PING,
+		MG,
+		MS,
+		MD,
+		MN,
+		TOUCH,
+		GAT,
+		GATS,
+		CAS,
+		INCR,
+		DECR,
+		APPEND,
+		PREPEND,
+		STATS
 	};
 
 private:
@@ -69,16 +75,37 @@ private:
 	stats::aggregator_ptr _stats;
 	size_t                _max_bytes;
 	status_type           _status;
-	std::stringstream     _buffer;
-	std::string           _response;
+	bool                  _deferred;
+	bool                  _durability_flags;
+	db::admission_ptr     _admission;
+	db::admission::ticket _ticket;
+	command_stats_ptr     _command_stats;
+	std::string           _line;
+	std::string           _value;
+	response              _response;
 
 	command_type             _command;
 	std::vector<std::string> _keys;
 	int                      _flags;
 	int                      _exp_time;
+	uint64_t                 _cas_unique;
+	uint64_t                 _delta;
 	size_t                   _remaining;
+	size_t                   _tail;
 	bool                     _no_reply;
 
+	// Meta commands select the fields they want returned with flags.
+	std::string              _meta_flags;
+	std::string              _opaque;
+	bool                     _quiet;
+	char                     _meta_mode;
+
+	// Progress through the keys of a get that is being answered in parts.
+	size_t                   _next_key;
+
+	// When the command was ready, while its latency is being timed.
+	std::chrono::steady_clock::time_point _started;
+
 public:
 	request(const request&) = delete;
 
@@ -93,39 +120,140 @@ public:
 		, _stats(stats)
 		, _max_bytes(max_bytes)
 		, _status(status_type::COMMAND)
-		, _buffer()
+		, _deferred(false)
+		, _durability_flags(false)
+		, _admission()
+		, _ticket()
+		, _command_stats()
+		, _line()
+		, _value()
 		, _response()
+		, _command(command_type::NONE)
 		, _flags(0)
 		, _exp_time(0)
+		, _cas_unique(0)
+		, _delta(0)
 		, _remaining(0)
+		, _tail(0)
 		, _no_reply(false)
+		, _meta_flags()
+		, _opaque()
+		, _quiet(false)
+		, _meta_mode('S')
+		, _next_key(0)
+		, _started()
 	{}
 
-	status_type              get_status()   { return _status; }
-	command_type             get_command()  { return _command; }
-	std::vector<std::string> get_keys()     { return _keys; }
-	int                      get_flags()    { return _flags; }
-	int                      get_exp_time() { return _exp_time; }
-	bool                     get_no_reply() { return _no_reply; }
-	std::string              copy_buffer()  { return _buffer.str(); }
+	status_type              get_status()     { return _status; }
+	command_type             get_command()    { return _command; }
+	std::vector<std::string> get_keys()       { return _keys; }
+	int                      get_flags()      { return _flags; }
+	int                      get_exp_time()   { return _exp_time; }
+	uint64_t                 get_cas_unique() { return _cas_unique; }
+	uint64_t                 get_delta()      { return _delta; }
+	bool                     get_no_reply()   { return _no_reply; }
+	std::string              get_meta_flags() { return _meta_flags; }
+	std::string              get_opaque()     { return _opaque; }
+	bool                     get_quiet()      { return _quiet; }
+	char                     get_meta_mode()  { return _meta_mode; }
+	std::string              copy_buffer()    { return _value; }
+
+	/*
+	 * Feeds a chunk of bytes read from the client into the parser.
+	 *
+	 * Command lines are located with a bulk scan for the line terminator and
+	 * tokenised in place, only a command line that is split across reads is
+	 * copied aside. Value payloads are appended directly into the string that
+	 * is handed to the store.
+	 *
+	 * Parsing stops once a command is complete, the return value is the number
+	 * of bytes consumed so that the caller can feed any remaining pipelined
+	 * commands into the next request.
+	 */
+	size_t process(const char * data, size_t length);
+
+	boost::asio::mutable_buffer value_tail(size_t min_bytes);
+	void fill_value(size_t length);
+
+	bool idle() { return _status == COMMAND && _line.empty(); }
+
+	void set_deferred(bool deferred) { _deferred = deferred; }
+	void execute();
+
+	void set_admission(db::admission_ptr admission) { _admission = admission; }
+
+	void set_command_stats(command_stats_ptr command_stats) { _command_stats = command_stats; }
+
+	void set_durability_flags(bool enabled) { _durability_flags = enabled; }
 
-	void process(const char * data, size_t length);
 	void reset() {
+		record_latency();
 		_status = COMMAND;
+		// Commands that ran have already released their place.
+		_ticket.release();
 		_command = command_type::NONE;
 		_keys.clear();
 		_flags = 0;
 		_exp_time = 0;
+		_cas_unique = 0;
+		_delta = 0;
 		_remaining = 0;
+		_tail = 0;
 		_no_reply = false;
-		_buffer.str(std::string());
+		_meta_flags.clear();
+		_opaque.clear();
+		_quiet = false;
+		_meta_mode = 'S';
+		_next_key = 0;
+		_line.clear();
+		if ( _value.capacity() > max_retained_bytes ) {
+			std::string().swap(_value);
+		} else {
+			_value.clear();
+		}
 		_response.clear();
 	}
 
 	std::string get_response();
+	void take_response(response & out);
+	void resume();
 
 private:
+	// Value buffers larger than this are released between requests.
+	static const size_t max_retained_bytes = 1 << 16;
+
+	// Multi-gets fetch this many keys per batch from the store, and hand over
+	// their response in parts once it grows beyond the chunk size.
+	static const size_t get_batch_keys = 16;
+	static const size_t response_chunk_bytes = 1 << 20;
+
+	void parse_command(const char * line, size_t length);
+	void parse_meta_flags(tokenizer & tokens);
+	void expect_data();
+	void swallow_data(const char * error);
+	// Prepares the response now, or leaves it to execute when deferred.
+	void command_ready();
+	// Takes a place for the command, or answers it as busy when shed.
+	bool admit();
 	void prepare_response();
+	void prepare_get_response();
+	void prepare_stats_response();
+	void prepare_meta_response(std::stringstream & ss);
+	void append_meta_flags(std::ostream & ss, std::string const & value, db::item_meta const & meta);
+
+	// The kind of the command as counted by the command stats, or N_COMMANDS
+	// for commands that are not counted.
+	command_stats::command_type stats_command();
+	// Counts a key looked up by the command, and whether it was a hit or a
+	// miss unless the lookup failed.
+	void count_key(db::status & status);
+	// Records the latency of a timed command once it is answered.
+	void record_latency();
+
+	// The metadata to store with the value of a set. When durability flags are
+	// enabled their bits are removed and the level they select is written to
+	// level when given.
+	db::item_meta meta_to_store(db::durability * level = nullptr);
 };
 
 } } // tcp, quitsies
@@ -28,12 +28,157 @@ SOFTWARE.
 #include <quitsies/stats/aggregator.hpp>
 #include <quitsies/stats/null_aggregator.hpp>
 
+#include <cstring>
+#include <map>
+
 using namespace quitsies::tcp;
 using namespace quitsies::stats;
 
 auto mock_stats = aggregator_ptr(new null_aggregator());
 auto mock_logger = quitsies::log::create("quitsies_test", "off");
 
+// An in memory store for testing responses.
+class mock_store : public quitsies::db::store {
+	std::map<std::string, std::pair<std::string, quitsies::db::item_meta>> _data;
+	uint64_t _next_cas = 0;
+
+public:
+	quitsies::db::durability last_level = quitsies::db::durability::DEFAULT;
+	bool last_no_reply = false;
+
+	void register_options(quitsies::option_list & options) {}
+	void register_endpoints(served::multiplexer & mux) {}
+	void open(quitsies::log::logger, aggregator_ptr) {}
+
+	quitsies::db::status get(std::string const & key, std::string * value, quitsies::db::item_meta * meta = nullptr) {
+		auto search = _data.find(key);
+		if ( search == _data.end() || search->second.second.expired(quitsies::db::now_seconds()) ) {
+			return quitsies::db::status(false, true);
+		}
+		*value = search->second.first;
+		if ( meta != nullptr ) {
+			*meta = search->second.second;
+		}
+		return quitsies::db::status(true);
+	}
+
+	std::vector<quitsies::db::status> multi_get( std::vector<std::string> const & keys
+	                                           , std::vector<std::string> * values
+	                                           , std::vector<quitsies::db::item_meta> * metas = nullptr ) {
+		std::vector<quitsies::db::status> statuses;
+		values->resize(keys.size());
+		if ( metas != nullptr ) {
+			metas->resize(keys.size());
+		}
+		for ( size_t i = 0; i < keys.size(); i++ ) {
+			statuses.push_back(get(keys[i], &(*values)[i], metas != nullptr ? &(*metas)[i] : nullptr));
+		}
+		return statuses;
+	}
+
+	quitsies::db::status del( std::string const & key
+	                        , quitsies::db::durability level = quitsies::db::durability::DEFAULT
+	                        , bool no_reply = false ) {
+		last_level = level;
+		last_no_reply = no_reply;
+		bool found = _data.erase(key) > 0;
+		return quitsies::db::status(found, !found);
+	}
+
+	quitsies::db::status put( std::string const & key
+	                        , std::string const & value
+	                        , quitsies::db::item_meta const & meta = quitsies::db::item_meta()
+	                        , uint64_t * new_cas = nullptr
+	                        , quitsies::db::durability level = quitsies::db::durability::DEFAULT
+	                        , bool no_reply = false ) {
+		last_level = level;
+		last_no_reply = no_reply;
+		_data[key] = std::make_pair(value, meta);
+		_data[key].second.cas = ++_next_cas;
+		if ( new_cas != nullptr ) {
+			*new_cas = _next_cas;
+		}
+		return quitsies::db::status(true);
+	}
+
+	quitsies::db::status add( std::string const & key
+	                        , std::string const & value
+	                        , quitsies::db::item_meta const & meta
+	                        , uint64_t * new_cas = nullptr
+	                        , quitsies::db::durability level = quitsies::db::durability::DEFAULT
+	                        , bool no_reply = false ) {
+		std::string existing;
+		if ( get(key, &existing).ok() ) {
+			return quitsies::db::status(false, false, "", true);
+		}
+		return put(key, value, meta, new_cas, level, no_reply);
+	}
+
+	quitsies::db::status cas( std::string const & key
+	                        , std::string const & value
+	                        , quitsies::db::item_meta const & meta
+	                        , uint64_t * new_cas = nullptr
+	                        , quitsies::db::durability level = quitsies::db::durability::DEFAULT
+	                        , bool no_reply = false ) {
+		std::string existing;
+		quitsies::db::item_meta stored;
+		auto status = get(key, &existing, &stored);
+		if ( !status.ok() ) {
+			return status;
+		}
+		if ( stored.cas != meta.cas ) {
+			return quitsies::db::status(false, false, "", true);
+		}
+		return put(key, value, meta, new_cas, level, no_reply);
+	}
+
+	quitsies::db::status incr( std::string const & key
+	                         , uint64_t delta
+	                         , bool decr
+	                         , std::string * value = nullptr ) {
+		std::string existing;
+		uint64_t counter;
+		if ( !get(key, &existing).ok() ) {
+			return quitsies::db::status(false, true);
+		}
+		if ( quitsies::db::parse_counter(existing.data(), existing.size(), &counter) ) {
+			counter = decr ? (delta > counter ? 0 : counter - delta) : counter + delta;
+			_data[key].first = std::to_string(counter);
+		}
+		if ( value != nullptr ) {
+			*value = _data[key].first;
+		}
+		return quitsies::db::status(true);
+	}
+
+	quitsies::db::status append( std::string const & key
+	                           , std::string const & data
+	                           , bool prepend ) {
+		std::string existing;
+		if ( !get(key, &existing).ok() ) {
+			return quitsies::db::status(false, true);
+		}
+		_data[key].first = prepend ? data + existing : existing + data;
+		return quitsies::db::status(true);
+	}
+
+	quitsies::db::status touch( std::string const & key
+	                          , uint32_t exp_time
+	                          , std::string * value = nullptr
+	                          , quitsies::db::item_meta * meta = nullptr ) {
+		std::string existing;
+		auto status = get(key, value != nullptr ? value : &existing);
+		if ( !status.ok() ) {
+			return status;
+		}
+		_data[key].second.exp_time = exp_time;
+		if ( meta != nullptr ) {
+			*meta = _data[key].second;
+		}
+		return status;
+	}
+};
+
 TEST_CASE("request parser can parse memcached requests", "[request_parser]")
 {
 	SECTION("command is parsed correctly")
@@ -45,7 +190,8 @@ TEST_CASE("request parser can parse memcached requests", "[request_parser]")
 				"add key2 20 0 11\r\nhello world\r\n",
 				"add key3 20 0 11 [noreply]\r\nhello world\r\n",
 				"gets key4 key5 key6\r\n",
-				"set key4 0 0 5\r\nhello\r\n"
+				"set key4 0 0 5\r\nhello\r\n",
+				"cas key4 0 0 5 12\r\nhello\r\n"
 			}};
 
 			for ( auto test_case : test_cases ) {
@@ -91,12 +237,17 @@ TEST_CASE("request parser can parse memcached requests", "[request_parser]")
 
 			for ( auto test_case : test_cases ) {
 				request req(NULL, mock_logger, mock_stats, 0);
+				CHECK(req.idle());
 				for ( auto part : test_case ) {
 					INFO("Part: " << part);
 					CHECK(req.get_status() != request::status_type::FINISHED);
 					req.process(part.c_str(), part.length());
+					CHECK_FALSE(req.idle());
 				}
 				CHECK(req.get_status() == request::status_type::FINISHED);
+
+				req.reset();
+				CHECK(req.idle());
 			}
 		}
 
@@ -227,5 +378,666 @@ TEST_CASE("request parser can parse memcached requests", "[request_parser]")
 			auto res = req.get_response();
 			CHECK(res == "PONG\r\n");
 		}
+
+		SECTION("check value containing line terminators")
+		{
+			std::string cmd = "set key4 0 0 12\r\nhello\r\nworld\r\n";
+
+			request req(NULL, mock_logger, mock_stats, 0);
+			req.process(cmd.c_str(), cmd.length());
+
+			CHECK(req.get_status() == request::status_type::FINISHED);
+			CHECK(req.copy_buffer() == "hello\r\nworld");
+		}
+
+		SECTION("check command split at every byte")
+		{
+			std::string cmd = "set key4 3 0 11 noreply\r\nhello world\r\n";
+
+			request req(NULL, mock_logger, mock_stats, 0);
+			for ( size_t i = 0; i < cmd.length(); i++ ) {
+				INFO("Offset: " << i);
+				CHECK(req.get_status() != request::status_type::FINISHED);
+				req.process(cmd.c_str() + i, 1);
+			}
+
+			CHECK(req.get_status() == request::status_type::FINISHED);
+			CHECK(req.get_command() == request::command_type::SET);
+			REQUIRE(req.get_keys().size() == 1);
+			CHECK(req.get_keys()[0] == "key4");
+			CHECK(req.get_flags() == 3);
+			CHECK(req.get_no_reply() == true);
+			CHECK(req.copy_buffer() == "hello world");
+		}
+
+		SECTION("check value read directly into the request")
+		{
+			std::string value(1000, 'x');
+			std::string line = "set key4 0 0 1000\r\n";
+			std::string cmd = line + value + "\r\n";
+
+			request req(NULL, mock_logger, mock_stats, 0);
+			req.process(cmd.c_str(), line.length() + 10);
+			CHECK(boost::asio::buffer_size(req.value_tail(1000)) == 0);
+
+			// A short read keeps only the bytes that arrived.
+			auto tail = req.value_tail(100);
+			REQUIRE(boost::asio::buffer_size(tail) == 100);
+			std::memcpy(boost::asio::buffer_cast<char *>(tail), value.c_str() + 10, 40);
+			req.fill_value(40);
+			CHECK(req.get_status() == request::status_type::DATA);
+
+			// The rest is read in steps that double with the value received.
+			std::vector<size_t> steps = {{ 100, 150, 300, 400 }};
+			size_t filled = 50;
+			for ( auto step : steps ) {
+				tail = req.value_tail(100);
+				REQUIRE(boost::asio::buffer_size(tail) == step);
+				std::memcpy(boost::asio::buffer_cast<char *>(tail), value.c_str() + filled, step);
+				req.fill_value(step);
+				filled += step;
+			}
+			CHECK(boost::asio::buffer_size(req.value_tail(100)) == 0);
+
+			req.process("\r\n", 2);
+			CHECK(req.get_status() == request::status_type::FINISHED);
+			CHECK(req.copy_buffer() == value);
+		}
+
+		SECTION("check oversized value is skipped")
+		{
+			std::string cmd = "set key4 0 0 11\r\nhello world\r\n";
+
+			request req(NULL, mock_logger, mock_stats, 10);
+			req.process(cmd.c_str(), 20);
+			CHECK(req.get_status() != request::status_type::FINISHED);
+			req.process(cmd.c_str() + 20, cmd.length() - 20);
+
+			CHECK(req.get_status() == request::status_type::FINISHED);
+			CHECK(req.get_response().find("SERVER_ERROR") == 0);
+		}
+
+		SECTION("check declared value length is not allocated up front")
+		{
+			std::string cmd = "set key4 0 0 4000000000\r\n";
+
+			request req(NULL, mock_logger, mock_stats, 0);
+			req.process(cmd.c_str(), cmd.length());
+			CHECK(req.get_status() == request::status_type::DATA);
+
+			auto tail = req.value_tail(1024);
+			CHECK(boost::asio::buffer_size(tail) == 1024);
+			req.fill_value(0);
+			CHECK(req.copy_buffer().empty());
+		}
+
+		SECTION("check oversized value header is rejected")
+		{
+			std::string cmd = "set key4 0 0 4000000000\r\n";
+
+			request req(NULL, mock_logger, mock_stats, 1 << 20);
+			req.process(cmd.c_str(), cmd.length());
+			CHECK(req.get_status() != request::status_type::DATA);
+			CHECK(boost::asio::buffer_size(req.value_tail(1024)) == 0);
+		}
+
+		SECTION("check malformed commands are rejected")
+		{
+			std::vector<std::string> test_cases = {{
+				"foo key1\r\n",
+				"set key1 0 0\r\n",
+				"set key1 a 0 5\r\nhello\r\n",
+				"ms key1 5 MZ\r\nhello\r\n",
+				"set key1 0 0 5\r\nhello world\r\n"
+			}};
+
+			for ( auto test_case : test_cases ) {
+				request req(NULL, mock_logger, mock_stats, 0);
+				req.process(test_case.c_str(), test_case.length());
+
+				INFO("Test case: " << test_case);
+				CHECK(req.get_status() == request::status_type::FINISHED);
+				CHECK(req.get_response().find("CLIENT_ERROR") == 0);
+			}
+		}
+
+		SECTION("check pipelined commands")
+		{
+			std::string cmd = "set key4 0 0 5 noreply\r\nhello\r\nget key4\r\nping\r\n";
+			std::vector<request::command_type> expected = {{
+				request::command_type::SET,
+				request::command_type::GET,
+				request::command_type::PING
+			}};
+
+			request req(NULL, mock_logger, mock_stats, 0);
+			const char * data = cmd.c_str();
+			size_t length = cmd.length();
+			for ( auto command : expected ) {
+				size_t consumed = req.process(data, length);
+				data += consumed;
+				length -= consumed;
+
+				CHECK(req.get_status() == request::status_type::FINISHED);
+				CHECK(req.get_command() == command);
+				req.reset();
+			}
+			CHECK(length == 0);
+		}
+
+		SECTION("check partial pipelined command is held")
+		{
+			std::string first = "ping\r\nget ke";
+			std::string second = "y1\r\n";
+
+			request req(NULL, mock_logger, mock_stats, 0);
+			size_t consumed = req.process(first.c_str(), first.length());
+			CHECK(consumed == 6);
+			CHECK(req.get_status() == request::status_type::FINISHED);
+			req.reset();
+
+			consumed = req.process(first.c_str() + 6, first.length() - 6);
+			CHECK(consumed == first.length() - 6);
+			CHECK(req.get_status() != request::status_type::FINISHED);
+
+			req.process(second.c_str(), second.length());
+			CHECK(req.get_status() == request::status_type::FINISHED);
+			REQUIRE(req.get_keys().size() == 1);
+			CHECK(req.get_keys()[0] == "key1");
+		}
+
+		SECTION("check parse meta get command")
+		{
+			std::string cmd = "mg key1 s v k Oabc q\r\n";
+
+			request req(NULL, mock_logger, mock_stats, 0);
+			req.process(cmd.c_str(), cmd.length());
+
+			CHECK(req.get_status() == request::status_type::FINISHED);
+			CHECK(req.get_command() == request::command_type::MG);
+			REQUIRE(req.get_keys().size() == 1);
+			CHECK(req.get_keys()[0] == "key1");
+			CHECK(req.get_meta_flags() == "svkO");
+			CHECK(req.get_opaque() == "abc");
+			CHECK(req.get_quiet() == true);
+		}
+
+		SECTION("check parse meta set command")
+		{
+			std::string cmd = "ms key1 5 T30 F3 ME\r\nhello\r\n";
+
+			request req(NULL, mock_logger, mock_stats, 0);
+			req.process(cmd.c_str(), cmd.length());
+
+			CHECK(req.get_status() == request::status_type::FINISHED);
+			CHECK(req.get_command() == request::command_type::MS);
+			REQUIRE(req.get_keys().size() == 1);
+			CHECK(req.get_keys()[0] == "key1");
+			CHECK(req.get_flags() == 3);
+			CHECK(req.get_exp_time() == 30);
+			CHECK(req.get_meta_mode() == 'E');
+			CHECK(req.get_quiet() == false);
+			CHECK(req.copy_buffer() == "hello");
+		}
+
+		SECTION("check parse meta delete command")
+		{
+			std::string cmd = "md key1 q\r\n";
+
+			request req(NULL, mock_logger, mock_stats, 0);
+			req.process(cmd.c_str(), cmd.length());
+
+			CHECK(req.get_status() == request::status_type::FINISHED);
+			CHECK(req.get_command() == request::command_type::MD);
+			REQUIRE(req.get_keys().size() == 1);
+			CHECK(req.get_keys()[0] == "key1");
+			CHECK(req.get_quiet() == true);
+		}
+
+		SECTION("check meta noop command")
+		{
+			std::string cmd = "mn\r\n";
+
+			request req(NULL, mock_logger, mock_stats, 0);
+			req.process(cmd.c_str(), cmd.length());
+
+			CHECK(req.get_status() == request::status_type::FINISHED);
+			CHECK(req.get_command() == request::command_type::MN);
+			CHECK(req.get_response() == "MN\r\n");
+		}
+
+		SECTION("check invalid meta flags are rejected")
+		{
+			std::vector<std::string> test_cases = {{
+				"mg key1 x\r\n",
+				"mg key1 b\r\n",
+				"mg\r\n"
+			}};
+
+			for ( auto test_case : test_cases ) {
+				request req(NULL, mock_logger, mock_stats, 0);
+				req.process(test_case.c_str(), test_case.length());
+
+				INFO("Test case: " << test_case);
+				CHECK(req.get_status() == request::status_type::FINISHED);
+				CHECK(req.get_response().find("CLIENT_ERROR") == 0);
+			}
+		}
+	}
+
+	SECTION("responses are prepared correctly")
+	{
+		auto db = quitsies::db::store_ptr(new mock_store());
+		db->put("key1", "hello");
+		db->put("key2", "world");
+
+		SECTION("check get response")
+		{
+			std::string cmd = "get key1 key3 key2\r\n";
+
+			request req(db, mock_logger, mock_stats, 0);
+			req.process(cmd.c_str(), cmd.length());
+
+			CHECK(req.get_status() == request::status_type::FINISHED);
+			CHECK(req.get_response() == "VALUE key1 0 5\r\nhello\r\nVALUE key2 0 5\r\nworld\r\nEND\r\n");
+		}
+
+		SECTION("check large multi-get is answered in parts")
+		{
+			std::string value(64 << 10, 'x');
+			std::string cmd = "get";
+			for ( int i = 0; i < 40; i++ ) {
+				std::string key = "big" + std::to_string(i);
+				db->put(key, value);
+				cmd += " " + key;
+			}
+			cmd += "\r\n";
+
+			request req(db, mock_logger, mock_stats, 0);
+			req.process(cmd.c_str(), cmd.length());
+
+			int n_parts = 1;
+			response res;
+			while ( req.get_status() == request::status_type::RESPONDING ) {
+				req.take_response(res);
+				req.resume();
+				n_parts++;
+			}
+			CHECK(req.get_status() == request::status_type::FINISHED);
+			req.take_response(res);
+
+			CHECK(n_parts > 1);
+			CHECK(res.size() == 40 * (value.length() + 23) - 10 + 5);
+
+			std::string body = res.str();
+			CHECK(body.find("VALUE big0 0 65536\r\n") == 0);
+			CHECK(body.rfind("END\r\n") == body.length() - 5);
+		}
+
+		SECTION("check deferred commands wait to be executed")
+		{
+			std::string cmds = "set key4 0 0 2\r\nhi\r\nget key4\r\n";
+
+			request req(db, mock_logger, mock_stats, 0);
+			req.set_deferred(true);
+			size_t n = req.process(cmds.c_str(), cmds.length());
+			CHECK(req.get_status() == request::status_type::EXECUTING);
+
+			std::string value;
+			CHECK(db->get("key4", &value).is_not_found());
+
+			req.execute();
+			CHECK(req.get_status() == request::status_type::FINISHED);
+			CHECK(req.get_response() == "STORED\r\n");
+			req.reset();
+
+			req.process(cmds.c_str() + n, cmds.length() - n);
+			CHECK(req.get_status() == request::status_type::EXECUTING);
+			req.execute();
+			CHECK(req.get_response() == "VALUE key4 0 2\r\nhi\r\nEND\r\n");
+		}
+
+		SECTION("check commands over the admission limits are shed")
+		{
+			auto admission = std::make_shared<quitsies::db::admission>(2, 1, 0, mock_stats);
+			auto held = admission->admit_write(0);
+
+			request req(db, mock_logger, mock_stats, 0);
+			req.set_admission(admission);
+
+			std::string set = "set key5 0 0 2\r\nhi\r\n";
+			req.process(set.c_str(), set.length());
+			CHECK(req.get_status() == request::status_type::FINISHED);
+			CHECK(req.get_response() == "SERVER_ERROR busy\r\n");
+			std::string value;
+			CHECK(db->get("key5", &value).is_not_found());
+			req.reset();
+
+			// Touching gets rewrite the item and are shed with the writes.
+			std::string touch = "mg key1 v T30\r\n";
+			req.process(touch.c_str(), touch.length());
+			CHECK(req.get_response() == "SERVER_ERROR busy\r\n");
+			req.reset();
+
+			std::string gat = "gat 30 key1\r\n";
+			req.process(gat.c_str(), gat.length());
+			CHECK(req.get_response() == "SERVER_ERROR busy\r\n");
+			req.reset();
+
+			// Reads have room for one more command, released once the store
+			// is done with it rather than once the response is written.
+			std::string get = "get key1\r\n";
+			req.process(get.c_str(), get.length());
+			CHECK(req.get_response() == "VALUE key1 0 5\r\nhello\r\nEND\r\n");
+			CHECK(admission->depth() == 1);
+			req.reset();
+
+			// Deferred commands hold their place until they are executed.
+			req.set_deferred(true);
+			req.process(get.c_str(), get.length());
+			CHECK(req.get_status() == request::status_type::EXECUTING);
+			CHECK(admission->depth() == 2);
+			req.execute();
+			CHECK(admission->depth() == 1);
+			req.reset();
+			req.set_deferred(false);
+
+			held.release();
+			req.process(set.c_str(), set.length());
+			CHECK(req.get_response() == "STORED\r\n");
+		}
+
+		SECTION("check deferred multi-get is resumed through execute")
+		{
+			std::string value(64 << 10, 'x');
+			std::string cmd = "get";
+			for ( int i = 0; i < 40; i++ ) {
+				std::string key = "big" + std::to_string(i);
+				db->put(key, value);
+				cmd += " " + key;
+			}
+			cmd += "\r\n";
+
+			request req(db, mock_logger, mock_stats, 0);
+			req.set_deferred(true);
+			req.process(cmd.c_str(), cmd.length());
+			CHECK(req.get_status() == request::status_type::EXECUTING);
+			req.execute();
+
+			response res;
+			while ( req.get_status() == request::status_type::RESPONDING ) {
+				req.take_response(res);
+				req.resume();
+				REQUIRE(req.get_status() == request::status_type::EXECUTING);
+				req.execute();
+			}
+			CHECK(req.get_status() == request::status_type::FINISHED);
+			req.take_response(res);
+			CHECK(res.size() == 40 * (value.length() + 23) - 10 + 5);
+		}
+
+		SECTION("check meta get response")
+		{
+			std::vector<std::tuple<std::string, std::string>> test_cases = {{
+				std::make_tuple("mg key1 v\r\n", "VA 5\r\nhello\r\n"),
+				std::make_tuple("mg key1 s k Oabc\r\n", "HD s5 kkey1 Oabc\r\n"),
+				std::make_tuple("mg key3 v\r\n", "EN\r\n"),
+				std::make_tuple("mn\r\n", "MN\r\n")
+			}};
+
+			for ( auto test_case : test_cases ) {
+				request req(db, mock_logger, mock_stats, 0);
+				req.process(std::get<0>(test_case).c_str(), std::get<0>(test_case).length());
+
+				INFO("Test case: " << std::get<0>(test_case));
+				CHECK(req.get_status() == request::status_type::FINISHED);
+				CHECK(req.get_response() == std::get<1>(test_case));
+			}
+		}
+
+		SECTION("check item flags and expiry are stored")
+		{
+			std::vector<std::tuple<std::string, std::string>> test_cases = {{
+				std::make_tuple("set key4 42 0 2\r\nhi\r\nget key4\r\n", "VALUE key4 42 2\r\nhi\r\nEND\r\n"),
+				std::make_tuple("set key4 0 -1 2\r\nhi\r\nget key4\r\n", "END\r\n"),
+				std::make_tuple("set key4 7 100 2\r\nhi\r\nmg key4 f\r\n", "HD f7\r\n"),
+				std::make_tuple("set key4 7 0 2\r\nhi\r\nmg key4 t\r\n", "HD t-1\r\n")
+			}};
+
+			for ( auto test_case : test_cases ) {
+				std::string cmds = std::get<0>(test_case);
+				const char * pos = cmds.c_str();
+				size_t remaining = cmds.length();
+
+				request set(db, mock_logger, mock_stats, 0);
+				size_t n = set.process(pos, remaining);
+				CHECK(set.get_response() == "STORED\r\n");
+
+				request get(db, mock_logger, mock_stats, 0);
+				get.process(pos + n, remaining - n);
+
+				INFO("Test case: " << cmds);
+				CHECK(get.get_status() == request::status_type::FINISHED);
+				CHECK(get.get_response() == std::get<1>(test_case));
+			}
+		}
+
+		SECTION("check durability flag bits select the write level")
+		{
+			std::vector<std::tuple<std::string, std::string, quitsies::db::durability>> test_cases = {{
+				std::make_tuple("set key4 5 0 2\r\nhi\r\nget key4\r\n", "VALUE key4 5 2\r\nhi\r\nEND\r\n", quitsies::db::durability::DEFAULT),
+				std::make_tuple("set key4 2147483653 0 2\r\nhi\r\nget key4\r\n", "VALUE key4 5 2\r\nhi\r\nEND\r\n", quitsies::db::durability::SYNCED),
+				std::make_tuple("set key4 1073741829 0 2\r\nhi\r\nget key4\r\n", "VALUE key4 5 2\r\nhi\r\nEND\r\n", quitsies::db::durability::NO_WAL),
+				std::make_tuple("ms key4 2 F2147483648\r\nhi\r\nmg key4 f\r\n", "HD f0\r\n", quitsies::db::durability::SYNCED)
+			}};
+
+			auto mock = std::static_pointer_cast<mock_store>(db);
+			for ( auto test_case : test_cases ) {
+				std::string cmds = std::get<0>(test_case);
+				const char * pos = cmds.c_str();
+				size_t remaining = cmds.length();
+
+				request set(db, mock_logger, mock_stats, 0);
+				set.set_durability_flags(true);
+				size_t n = set.process(pos, remaining);
+				INFO("Test case: " << cmds);
+				CHECK(mock->last_level == std::get<2>(test_case));
+
+				request get(db, mock_logger, mock_stats, 0);
+				get.process(pos + n, remaining - n);
+				CHECK(get.get_response() == std::get<1>(test_case));
+			}
+		}
+
+		SECTION("check flags pass through unchanged without durability flags")
+		{
+			std::vector<std::tuple<std::string, std::string>> test_cases = {{
+				std::make_tuple("set key4 2147483653 0 2\r\nhi\r\nget key4\r\n", "VALUE key4 2147483653 2\r\nhi\r\nEND\r\n"),
+				std::make_tuple("set key4 1073741829 0 2\r\nhi\r\nget key4\r\n", "VALUE key4 1073741829 2\r\nhi\r\nEND\r\n"),
+				std::make_tuple("ms key4 2 F2147483648\r\nhi\r\nmg key4 f\r\n", "HD f2147483648\r\n")
+			}};
+
+			auto mock = std::static_pointer_cast<mock_store>(db);
+			for ( auto test_case : test_cases ) {
+				std::string cmds = std::get<0>(test_case);
+				const char * pos = cmds.c_str();
+				size_t remaining = cmds.length();
+
+				request set(db, mock_logger, mock_stats, 0);
+				size_t n = set.process(pos, remaining);
+				INFO("Test case: " << cmds);
+				CHECK(mock->last_level == quitsies::db::durability::DEFAULT);
+
+				request get(db, mock_logger, mock_stats, 0);
+				get.process(pos + n, remaining - n);
+				CHECK(get.get_response() == std::get<1>(test_case));
+			}
+		}
+
+		SECTION("check noreply writes are not waited on")
+		{
+			std::vector<std::tuple<std::string, bool>> test_cases = {{
+				std::make_tuple("set key4 0 0 2\r\nhi\r\n", false),
+				std::make_tuple("set key4 0 0 2 noreply\r\nhi\r\n", true),
+				std::make_tuple("delete key4 noreply\r\n", true),
+				std::make_tuple("ms key4 2 q\r\nhi\r\n", false)
+			}};
+
+			auto mock = std::static_pointer_cast<mock_store>(db);
+			for ( auto test_case : test_cases ) {
+				std::string cmd = std::get<0>(test_case);
+				request req(db, mock_logger, mock_stats, 0);
+				req.process(cmd.c_str(), cmd.length());
+
+				INFO("Test case: " << cmd);
+				CHECK(mock->last_no_reply == std::get<1>(test_case));
+			}
+		}
+
+		SECTION("check touch and gat responses")
+		{
+			std::vector<std::tuple<std::string, std::string>> test_cases = {{
+				std::make_tuple("touch key1 100\r\n", "TOUCHED\r\n"),
+				std::make_tuple("touch key3 100\r\n", "NOT_FOUND\r\n"),
+				std::make_tuple("gat 100 key1 key3\r\n", "VALUE key1 0 5\r\nhello\r\nEND\r\n"),
+				std::make_tuple("gats 100 key2\r\n", "VALUE key2 0 5 2\r\nworld\r\nEND\r\n"),
+				std::make_tuple("mg key1 T50 v\r\n", "VA 5\r\nhello\r\n"),
+				std::make_tuple("gat -1 key1\r\n", "VALUE key1 0 5\r\nhello\r\nEND\r\n"),
+				std::make_tuple("get key1\r\n", "END\r\n")
+			}};
+
+			for ( auto test_case : test_cases ) {
+				request req(db, mock_logger, mock_stats, 0);
+				req.process(std::get<0>(test_case).c_str(), std::get<0>(test_case).length());
+
+				INFO("Test case: " << std::get<0>(test_case));
+				CHECK(req.get_status() == request::status_type::FINISHED);
+				CHECK(req.get_response() == std::get<1>(test_case));
+			}
+		}
+
+		SECTION("check cas responses")
+		{
+			std::vector<std::tuple<std::string, std::string>> test_cases = {{
+				std::make_tuple("gets key1\r\n", "VALUE key1 0 5 1\r\nhello\r\nEND\r\n"),
+				std::make_tuple("cas key1 0 0 3 2\r\nbye\r\n", "EXISTS\r\n"),
+				std::make_tuple("cas key1 0 0 3 1\r\nbye\r\n", "STORED\r\n"),
+				std::make_tuple("cas key1 0 0 3 1\r\nbye\r\n", "EXISTS\r\n"),
+				std::make_tuple("cas key3 0 0 3 1\r\nbye\r\n", "NOT_FOUND\r\n"),
+				std::make_tuple("mg key1 c v\r\n", "VA 3 c3\r\nbye\r\n"),
+				std::make_tuple("ms key1 2 C1 c\r\nhi\r\n", "EX c1\r\n"),
+				std::make_tuple("ms key1 2 C3 c\r\nhi\r\n", "HD c4\r\n"),
+				std::make_tuple("ms key1 2 ME\r\nhi\r\n", "NS\r\n"),
+				std::make_tuple("add key1 0 0 2\r\nhi\r\n", "NOT_STORED\r\n")
+			}};
+
+			for ( auto test_case : test_cases ) {
+				request req(db, mock_logger, mock_stats, 0);
+				req.process(std::get<0>(test_case).c_str(), std::get<0>(test_case).length());
+
+				INFO("Test case: " << std::get<0>(test_case));
+				CHECK(req.get_status() == request::status_type::FINISHED);
+				CHECK(req.get_response() == std::get<1>(test_case));
+			}
+		}
+
+		SECTION("check counter and append responses")
+		{
+			db->put("counter", "10");
+
+			std::vector<std::tuple<std::string, std::string>> test_cases = {{
+				std::make_tuple("incr counter 5\r\n", "15\r\n"),
+				std::make_tuple("decr counter 20\r\n", "0\r\n"),
+				std::make_tuple("incr missing 1\r\n", "NOT_FOUND\r\n"),
+				std::make_tuple("incr key1 1\r\n", "CLIENT_ERROR cannot increment or decrement non-numeric value\r\n"),
+				std::make_tuple("incr counter x\r\n", "CLIENT_ERROR invalid numeric delta argument\r\n"),
+				std::make_tuple("incr counter 99999999999999999999\r\n", "CLIENT_ERROR invalid numeric delta argument\r\n"),
+				std::make_tuple("incr counter 18446744073709551616\r\n", "CLIENT_ERROR invalid numeric delta argument\r\n"),
+				std::make_tuple("set key1 0 0 99999999999999999999\r\n", "CLIENT_ERROR invalid bytes\r\n"),
+				std::make_tuple("cas key1 0 0 1 99999999999999999999\r\n", "CLIENT_ERROR invalid cas unique\r\n"),
+				std::make_tuple("touch key1 -9223372036854775808\r\n", "CLIENT_ERROR invalid exptime\r\n"),
+				std::make_tuple("append key1 0 0 3\r\n!!!\r\n", "STORED\r\n"),
+				std::make_tuple("prepend key1 0 0 2\r\n<<\r\n", "STORED\r\n"),
+				std::make_tuple("append missing 0 0 1\r\n!\r\n", "NOT_STORED\r\n"),
+				std::make_tuple("get key1\r\n", "VALUE key1 0 10\r\n<<hello!!!\r\nEND\r\n")
+			}};
+
+			for ( auto test_case : test_cases ) {
+				request req(db, mock_logger, mock_stats, 0);
+				req.process(std::get<0>(test_case).c_str(), std::get<0>(test_case).length());
+
+				INFO("Test case: " << std::get<0>(test_case));
+				CHECK(req.get_status() == request::status_type::FINISHED);
+				CHECK(req.get_response() == std::get<1>(test_case));
+			}
+		}
+
+		SECTION("check delete responses")
+		{
+			std::vector<std::tuple<std::string, std::string>> test_cases = {{
+				std::make_tuple("delete key1\r\n", "DELETED\r\n"),
+				std::make_tuple("delete key1\r\n", "NOT_FOUND\r\n"),
+				std::make_tuple("md key2 k\r\n", "HD kkey2\r\n"),
+				std::make_tuple("md key2 k\r\n", "NF kkey2\r\n")
+			}};
+
+			for ( auto test_case : test_cases ) {
+				request req(db, mock_logger, mock_stats, 0);
+				req.process(std::get<0>(test_case).c_str(), std::get<0>(test_case).length());
+
+				INFO("Test case: " << std::get<0>(test_case));
+				CHECK(req.get_status() == request::status_type::FINISHED);
+				CHECK(req.get_response() == std::get<1>(test_case));
+			}
+		}
+
+		SECTION("check stats responses")
+		{
+			auto counters = command_stats_ptr(new command_stats());
+			request req(db, mock_logger, mock_stats, 0);
+			req.set_command_stats(counters);
+
+			auto run = [&req](std::string const & cmd) {
+				req.process(cmd.c_str(), cmd.length());
+				std::string response = req.get_response();
+				req.reset();
+				return response;
+			};
+
+			CHECK(run("get key1 key3\r\n") == "VALUE key1 0 5\r\nhello\r\nEND\r\n");
+			CHECK(run("delete key2\r\n") == "DELETED\r\n");
+			CHECK(counters->count(command_stats::GET) == 1);
+			CHECK(counters->keys(command_stats::GET) == 2);
+			CHECK(counters->hits(command_stats::GET) == 1);
+			CHECK(counters->misses(command_stats::GET) == 1);
+			CHECK(counters->hits(command_stats::DELETE) == 1);
+
+			std::string general = run("stats\r\n");
+			// Like memcached, a multi-key get counts each of its keys.
+			CHECK(general.find("STAT cmd_get 2\r\n") != std::string::npos);
+			CHECK(general.find("STAT get_misses 1\r\n") != std::string::npos);
+			CHECK(general.find("STAT delete_hits 1\r\n") != std::string::npos);
+			CHECK(general.substr(general.size() - 5) == "END\r\n");
+
+			std::string latency = run("stats latency\r\n");
+			CHECK(latency.find("STAT get:count 1\r\n") != std::string::npos);
+			CHECK(latency.find("STAT delete:p99_us ") != std::string::npos);
+
+			// The mock store has no engine properties.
+			CHECK(run("stats rocksdb\r\n") == "END\r\n");
+			CHECK(run("stats slabs\r\n") == "CLIENT_ERROR unknown stats group\r\n");
+			CHECK(counters->count(command_stats::GET) == 1);
+		}
+
+		SECTION("check quiet meta get miss has no reply")
+		{
+			std::string cmd = "mg key3 v q\r\n";
+
+			request req(db, mock_logger, mock_stats, 0);
+			req.process(cmd.c_str(), cmd.length());
+
+			CHECK(req.get_status() == request::status_type::FINISHED);
+			CHECK(req.get_no_reply() == true);
+		}
 	}
 }
@@ -0,0 +1,86 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#include <quitsies/tcp/response.hpp>
+
+using namespace quitsies::tcp;
+
+const size_t response::min_value_segment;
+
+void
+response::append(const char * data, size_t length) {
+	if ( length == 0 ) {
+		return;
+	}
+	if ( !_last_is_text ) {
+		_segments.emplace_back();
+		_last_is_text = true;
+	}
+	_segments.back().append(data, length);
+	_size += length;
+}
+
+void
+response::append_value(std::string && value) {
+	if ( value.length() < min_value_segment ) {
+		append(value.data(), value.length());
+		return;
+	}
+	_size += value.length();
+	_segments.emplace_back(std::move(value));
+	_last_is_text = false;
+}
+
+void
+response::splice(response & other) {
+	if ( other.empty() ) {
+		return;
+	}
+	for ( auto & segment : other._segments ) {
+		_segments.emplace_back(std::move(segment));
+	}
+	_last_is_text = other._last_is_text;
+	_size += other._size;
+	other.clear();
+}
+
+void
+response::buffers(std::vector<boost::asio::const_buffer> & out) const {
+	for ( auto & segment : _segments ) {
+		if ( !segment.empty() ) {
+			out.push_back(boost::asio::buffer(segment));
+		}
+	}
+}
+
+std::string
+response::str() const {
+	std::string out;
+	out.reserve(_size);
+	for ( auto & segment : _segments ) {
+		out.append(segment);
+	}
+	return out;
+}
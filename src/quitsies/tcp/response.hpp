@@ -0,0 +1,107 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef QUITSIES_RESPONSE_HPP
+#define QUITSIES_RESPONSE_HPP
+
+#include <boost/asio.hpp>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace quitsies { namespace tcp {
+
+/*
+ * A response to a client held as a list of buffer segments.
+ *
+ * Protocol text such as value headers and trailers is coalesced into shared
+ * segments, whereas large values are moved into segments of their own so that
+ * they are written to the socket without being copied again.
+ */
+class response {
+	std::deque<std::string> _segments;
+	bool                    _last_is_text;
+	size_t                  _size;
+
+public:
+	// Values smaller than this are copied into the surrounding text segment.
+	static const size_t min_value_segment = 512;
+
+	response()
+		: _segments()
+		, _last_is_text(false)
+		, _size(0)
+	{}
+
+	response(response&&) = default;
+	response& operator=(response&&) = default;
+
+	/*
+	 * Appends protocol text to the response.
+	 */
+	void append(const char * data, size_t length);
+	void append(std::string const & text) { append(text.data(), text.length()); }
+
+	/*
+	 * Appends a value to the response, taking ownership of its bytes.
+	 */
+	void append_value(std::string && value);
+
+	/*
+	 * Replaces the contents of the response with protocol text.
+	 */
+	void assign(std::string const & text) {
+		clear();
+		append(text);
+	}
+
+	/*
+	 * Moves all segments of another response onto the end of this one.
+	 */
+	void splice(response & other);
+
+	/*
+	 * Adds a buffer for each segment to a list of buffers for a gathered write.
+	 * The buffers remain valid until the response is modified.
+	 */
+	void buffers(std::vector<boost::asio::const_buffer> & out) const;
+
+	// Copies the response into a single contiguous string.
+	std::string str() const;
+
+	size_t size() const  { return _size; }
+	bool   empty() const { return _size == 0; }
+
+	void clear() {
+		_segments.clear();
+		_last_is_text = false;
+		_size = 0;
+	}
+};
+
+} } // tcp, quitsies
+
+#endif // QUITSIES_RESPONSE_HPP
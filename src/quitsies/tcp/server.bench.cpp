@@ -0,0 +1,205 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+ * Measures memcached protocol throughput and latency against a real server as
+ * the number of TCP threads grows. Clients alternate sets and gets over their
+ * own connections, each waiting for its reply before the next request. Run
+ * with --bench_sharded to compare a worker per thread against threads sharing
+ * one io_service.
+ *
+ * Each round is run over loopback TCP and then over a Unix domain socket,
+ * unless --bench_local_socket is empty. Run with --bench_get_percent 100 to
+ * compare the two for small gets alone.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include <quitsies/options.hpp>
+#include <quitsies/tcp/server.hpp>
+#include <quitsies/db/rocks.hpp>
+#include <quitsies/stats/null_aggregator.hpp>
+#include <quitsies/log/logger.hpp>
+
+using namespace quitsies;
+namespace ip = boost::asio::ip;
+namespace generic = boost::asio::generic;
+
+// Connects to the server, retrying while it starts listening.
+void
+connect_client(generic::stream_protocol::socket & socket, generic::stream_protocol::endpoint const & endpoint)
+{
+	for ( int attempt = 0; ; attempt++ ) {
+		boost::system::error_code ec;
+		socket.connect(endpoint, ec);
+		if ( !ec ) {
+			return;
+		}
+		socket.close();
+		if ( attempt > 100 ) {
+			throw boost::system::system_error(ec);
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+}
+
+// Sends a request and reads its reply up to the given terminator.
+void
+round_trip( generic::stream_protocol::socket & socket
+          , boost::asio::streambuf &          reply
+          , std::string const &               request
+          , std::string const &               terminator )
+{
+	boost::asio::write(socket, boost::asio::buffer(request));
+	size_t n = boost::asio::read_until(socket, reply, terminator);
+	reply.consume(n);
+}
+
+int main(int argc, char* argv[]) {
+	long long max_threads = 16, n_connections = 64, n_requests = 2000, value_bytes = 100, get_percent = 50;
+	std::string port = "21211", local_path = "/tmp/quitsies_bench.sock";
+	bool sharded = false, pin_threads = false;
+
+	db::store_ptr db(new db::rocks());
+
+	{
+		option_list options = {{
+			std::make_tuple("BENCH", option_array({
+				option_ptr(new int_option('?', "bench_threads", "Maximum number of TCP threads.", &max_threads)),
+				option_ptr(new int_option('?', "bench_connections", "Number of client connections.", &n_connections)),
+				option_ptr(new int_option('?', "bench_requests", "Number of requests per connection per round.", &n_requests)),
+				option_ptr(new int_option('?', "bench_value_bytes", "Size of each set value.", &value_bytes)),
+				option_ptr(new int_option('?', "bench_get_percent", "Percentage of requests that are gets rather than sets.", &get_percent)),
+				option_ptr(new str_option('?', "bench_port", "Port for the benchmark server.", &port)),
+				option_ptr(new str_option('?', "bench_local_socket", "Path of the Unix domain socket to also benchmark, empty disables.", &local_path)),
+				option_ptr(new bool_option('?', "bench_sharded", "Give each TCP thread its own io_service and listening socket.", &sharded)),
+				option_ptr(new bool_option('?', "bench_pin_threads", "Pin each sharded TCP thread to a CPU.", &pin_threads))
+			}))
+		}};
+
+		db->register_options(options);
+
+		// Keep benchmark keys out of the default DB path.
+		std::vector<char *> args(argv, argv + argc);
+		bool has_path = false;
+		for ( auto arg : args ) {
+			has_path = has_path || std::string(arg) == "--db_path";
+		}
+		std::string path_flag = "--db_path", path = "/tmp/quitsies_bench";
+		if ( !has_path ) {
+			args.push_back(&path_flag[0]);
+			args.push_back(&path[0]);
+		}
+
+		if ( !parse_arg_options(static_cast<int>(args.size()), args.data(), options) ) {
+			return 1;
+		}
+	}
+
+	auto logger = log::create("quitsies_bench", "warn");
+	stats::aggregator_ptr stats(new stats::null_aggregator());
+	db->open(logger, stats);
+
+	std::string value(static_cast<size_t>(value_bytes), 'x');
+
+	std::vector<std::pair<std::string, generic::stream_protocol::endpoint>> transports;
+	transports.emplace_back("tcp", ip::tcp::endpoint(ip::address::from_string("127.0.0.1"), static_cast<unsigned short>(std::stoi(port))));
+	if ( !local_path.empty() ) {
+		transports.emplace_back("unix", boost::asio::local::stream_protocol::endpoint(local_path));
+	}
+
+	std::cout << "transport\tthreads\trequests/s\tp50 us\tp99 us" << std::endl;
+	for ( auto & transport : transports ) {
+		for ( long long n_threads = 1; n_threads <= max_threads; n_threads *= 2 ) {
+			tcp::server memcached_server("127.0.0.1", port, db, logger, stats);
+			memcached_server.set_sharded(sharded, pin_threads);
+			memcached_server.set_local_socket(local_path);
+			std::thread server_thread([&memcached_server, n_threads]() {
+				memcached_server.run(static_cast<int>(n_threads));
+			});
+
+			std::vector<std::vector<double>> latencies(static_cast<size_t>(n_connections));
+			std::vector<std::thread> clients;
+
+			auto start = std::chrono::steady_clock::now();
+			for ( long long c = 0; c < n_connections; c++ ) {
+				clients.emplace_back([&, c]() {
+					boost::asio::io_service io_service;
+					generic::stream_protocol::socket socket(io_service);
+					boost::asio::streambuf reply;
+					connect_client(socket, transport.second);
+
+					std::string key = "bench:" + std::to_string(c);
+					std::string set = "set " + key + " 0 0 " + std::to_string(value.size()) + "\r\n" + value + "\r\n";
+					std::string get = "get " + key + "\r\n";
+
+					// Gets always find the key, even when no sets are measured.
+					round_trip(socket, reply, set, "\r\n");
+
+					auto & samples = latencies[c];
+					samples.reserve(static_cast<size_t>(n_requests));
+					for ( long long i = 0; i < n_requests; i++ ) {
+						auto sent = std::chrono::steady_clock::now();
+						// Spreads the gets evenly between the sets.
+						if ( (i + 1) * get_percent / 100 == i * get_percent / 100 ) {
+							round_trip(socket, reply, set, "\r\n");
+						} else {
+							round_trip(socket, reply, get, "END\r\n");
+						}
+						std::chrono::duration<double, std::micro> taken = std::chrono::steady_clock::now() - sent;
+						samples.push_back(taken.count());
+					}
+				});
+			}
+			for ( auto & client : clients ) {
+				client.join();
+			}
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+			memcached_server.stop();
+			server_thread.join();
+
+			std::vector<double> all;
+			for ( auto & samples : latencies ) {
+				all.insert(all.end(), samples.begin(), samples.end());
+			}
+			std::sort(all.begin(), all.end());
+
+			std::cout << transport.first << "\t" << n_threads << "\t"
+				<< static_cast<long long>(all.size() / elapsed.count()) << "\t"
+				<< static_cast<long long>(all[all.size() / 2]) << "\t"
+				<< static_cast<long long>(all[all.size() * 99 / 100]) << std::endl;
+		}
+	}
+
+	return 0;
+}
@@ -23,59 +23,139 @@ SOFTWARE.
 */
 
 #include <signal.h>
+#include <unistd.h>
+#include <algorithm>
 #include <utility>
 #include <thread>
 
+#if defined(__linux__)
+#include <pthread.h>
+#endif
+
 #include <quitsies/tcp/server.hpp>
 
 using namespace quitsies::tcp;
 
+const size_t server::min_read_buffer_bytes;
+const size_t server::max_read_buffer_bytes;
+const size_t server::max_free_read_buffers;
+const size_t server::wheel_tick_milliseconds;
+const size_t server::wheel_slots;
+const size_t server::accept_pause_milliseconds;
+
+namespace {
+
+// The address of the peer of a socket as raw bytes, or empty when it has no
+// IP address.
+std::string
+source_address(stream_socket & socket)
+{
+	boost::system::error_code ec;
+	auto endpoint = socket.remote_endpoint(ec);
+	if ( ec )
+	{
+		return std::string();
+	}
+
+	auto address = endpoint.data();
+	if ( address->sa_family == AF_INET )
+	{
+		auto in = reinterpret_cast<const sockaddr_in *>(address);
+		return std::string(reinterpret_cast<const char *>(&in->sin_addr), sizeof(in->sin_addr));
+	}
+	if ( address->sa_family == AF_INET6 )
+	{
+		auto in6 = reinterpret_cast<const sockaddr_in6 *>(address);
+		return std::string(reinterpret_cast<const char *>(&in6->sin6_addr), sizeof(in6->sin6_addr));
+	}
+	return std::string();
+}
+
+} // namespace
+
+#if defined(SO_REUSEPORT)
+typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port_option;
+#endif
+
 server::server( const std::string &   address
               , const std::string &   port
               , db::store_ptr         db
               , log::logger           log
               , stats::aggregator_ptr stats
               )
-	: _io_service()
-	, _signals(_io_service)
-	, _acceptor(_io_service)
-	, _connection_manager()
-	, _socket(_io_service)
+	: _endpoint()
+	, _local_path()
+	, _udp_port()
+	, _datagrams()
+	, _workers()
+	, _signals()
+	, _workers_mutex()
 	, _db(db)
+	, _executor()
+	, _admission()
+	, _command_stats(new command_stats())
 	, _read_timeout(0)
 	, _write_timeout(0)
+	, _idle_timeout(0)
 	, _req_max_bytes(0)
+	, _max_connections(0)
+	, _max_connections_per_ip(0)
+	, _limiter()
+	, _sharded(false)
+	, _pin_threads(false)
+	, _durability_flags(false)
+	, _buffers(new buffer_pool(min_read_buffer_bytes, max_read_buffer_bytes, max_free_read_buffers))
 	, _log(log)
 	, _stats(stats)
 {
-	/*
-	 * Register to handle the signals that indicate when the server should exit.
-	 * It is safe to register for the same signal multiple times in a program,
-	 * provided all registration for the specified signal is made through Asio.
-	 */
-	_signals.add(SIGINT);
-	_signals.add(SIGTERM);
-#if defined(SIGQUIT)
-	_signals.add(SIGQUIT);
-#endif // defined(SIGQUIT)
-
-	do_await_stop();
-
-	// Open the acceptor with the option to reuse the address (i.e. SO_REUSEADDR).
-	boost::asio::ip::tcp::resolver resolver(_io_service);
-	boost::asio::ip::tcp::endpoint endpoint = *resolver.resolve({address, port});
-
-	_acceptor.open(endpoint.protocol());
-	_acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
-	_acceptor.bind(endpoint);
-	_acceptor.listen();
-
-	do_accept();
+	// The listening sockets are opened by run, once the number of workers is
+	// known.
+	boost::asio::io_service resolver_service;
+	boost::asio::ip::tcp::resolver resolver(resolver_service);
+	_endpoint = *resolver.resolve({address, port});
 }
 
 void
 server::run(int n_threads /* = 1 */)
 {
+	if ( n_threads < 1 ) {
+		n_threads = 1;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_workers_mutex);
+
+		_limiter.reset(new connection_limiter(_max_connections, _max_connections_per_ip));
+		_stats->on_epoch([this]() {
+			_stats->gauge("tcp.connections", _limiter->count());
+		});
+
+		size_t n_workers = _sharded ? static_cast<size_t>(n_threads) : 1;
+		for ( size_t i = 0; i < n_workers; i++ ) {
+			_workers.push_back(make_worker(_sharded, _sharded ? 1 : static_cast<size_t>(n_threads)));
+		}
+		if ( !_local_path.empty() ) {
+			listen_local();
+		}
+		if ( !_udp_port.empty() ) {
+			listen_udp();
+		}
+
+		/*
+		 * Register to handle the signals that indicate when the server should exit.
+		 * It is safe to register for the same signal multiple times in a program,
+		 * provided all registration for the specified signal is made through Asio.
+		 */
+		_signals.reset(new boost::asio::signal_set(_workers[0]->io_service));
+		_signals->add(SIGINT);
+		_signals->add(SIGTERM);
+#if defined(SIGQUIT)
+		_signals->add(SIGQUIT);
+#endif // defined(SIGQUIT)
+
+		do_await_stop();
+	}
+
 	/*
 	 * The io_service::run() call will block until all asynchronous operations
 	 * have finished. While the server is running, there is always at least one
@@ -87,9 +167,25 @@ server::run(int n_threads /* = 1 */)
 		std::vector<std::thread> v_threads;
 		for ( int i = 0; i < n_threads; i++ )
 		{
-			v_threads.push_back(std::thread([this](){
-				_io_service.run();
+			worker & w = *_workers[_sharded ? i : 0];
+			v_threads.push_back(std::thread([&w](){
+				w.io_service.run();
 			}));
+
+			if ( _pin_threads )
+			{
+#if defined(__linux__)
+				cpu_set_t cpus;
+				CPU_ZERO(&cpus);
+				CPU_SET(i % std::max(1u, std::thread::hardware_concurrency()), &cpus);
+				if ( pthread_setaffinity_np(v_threads.back().native_handle(), sizeof(cpu_set_t), &cpus) != 0 )
+				{
+					_log->warn("failed to pin TCP thread {} to a CPU", i);
+				}
+#else
+				_log->warn("pinning TCP threads is not supported on this platform");
+#endif
+			}
 		}
 		for ( auto & thread : v_threads )
 		{
@@ -101,7 +197,12 @@ server::run(int n_threads /* = 1 */)
 	}
 	else
 	{
-		_io_service.run();
+		_workers[0]->io_service.run();
+	}
+
+	if ( !_local_path.empty() )
+	{
+		::unlink(_local_path.c_str());
 	}
 }
 
@@ -117,61 +218,321 @@ server::set_write_timeout(int time_milliseconds)
 	_write_timeout = time_milliseconds;
 }
 
+void
+server::set_idle_timeout(int time_milliseconds)
+{
+	_idle_timeout = time_milliseconds;
+}
+
 void
 server::set_max_request_bytes(size_t num_bytes)
 {
 	_req_max_bytes = num_bytes;
 }
 
+void
+server::set_max_connections(size_t max_connections)
+{
+	_max_connections = max_connections;
+}
+
+void
+server::set_max_connections_per_ip(size_t max_connections)
+{
+	_max_connections_per_ip = max_connections;
+}
+
+void
+server::set_sharded(bool sharded, bool pin_threads /* = false */)
+{
+	_sharded = sharded;
+	_pin_threads = pin_threads;
+}
+
+void
+server::set_storage_executor(db::executor_ptr executor)
+{
+	_executor = executor;
+}
+
+void
+server::set_local_socket(std::string const & path)
+{
+	_local_path = path;
+}
+
+void
+server::set_admission(db::admission_ptr admission)
+{
+	_admission = admission;
+}
+
+void
+server::set_durability_flags(bool enabled)
+{
+	_durability_flags = enabled;
+}
+
+void
+server::set_udp_port(std::string const & port)
+{
+	_udp_port = port;
+}
+
 void
 server::stop()
 {
-	if ( ! _io_service.stopped() )
+	std::lock_guard<std::mutex> lock(_workers_mutex);
+	for ( auto & w : _workers )
+	{
+		if ( ! w->io_service.stopped() )
+		{
+			w->io_service.stop();
+		}
+	}
+}
+
+server::worker_ptr
+server::make_worker(bool reuse_port, size_t n_threads)
+{
+	worker_ptr w(new worker(n_threads));
+
+	// Open the acceptor with the option to reuse the address (i.e. SO_REUSEADDR).
+	boost::asio::generic::stream_protocol::endpoint endpoint(_endpoint);
+	w->acceptor.open(endpoint.protocol());
+	w->acceptor.set_option(boost::asio::socket_base::reuse_address(true));
+	if ( reuse_port )
+	{
+#if defined(SO_REUSEPORT)
+		// Every worker binds the same port, and the kernel balances new
+		// connections between them.
+		w->acceptor.set_option(reuse_port_option(true));
+#else
+		throw std::runtime_error("sharded TCP workers require SO_REUSEPORT");
+#endif
+	}
+	w->acceptor.bind(endpoint);
+	w->acceptor.listen();
+
+	do_accept(*w, w->acceptor, w->socket);
+	do_tick(*w);
+	return w;
+}
+
+void
+server::listen_local()
+{
+	// A socket file left behind by an earlier process would fail the bind.
+	::unlink(_local_path.c_str());
+
+	boost::asio::local::stream_protocol::endpoint local_endpoint(_local_path);
+	boost::asio::generic::stream_protocol::endpoint endpoint(local_endpoint);
+
+	worker & first = *_workers[0];
+	first.local_acceptor.open(endpoint.protocol());
+	first.local_acceptor.bind(endpoint);
+	first.local_acceptor.listen();
+
+	/* Unix domain sockets cannot share a path with SO_REUSEPORT, so every
+	 * other worker accepts from a duplicate of the one listening socket.
+	 */
+	for ( auto & w : _workers )
+	{
+		if ( w.get() != &first )
+		{
+			int fd = ::dup(first.local_acceptor.native_handle());
+			if ( fd < 0 )
+			{
+				throw std::runtime_error("failed to share the local socket between workers");
+			}
+			w->local_acceptor.assign(endpoint.protocol(), fd);
+		}
+		do_accept(*w, w->local_acceptor, w->local_socket);
+	}
+}
+
+void
+server::listen_udp()
+{
+	_datagrams.reset(new datagram_handler(_db, _log, _stats, _req_max_bytes, _admission, _command_stats));
+	boost::asio::ip::udp::endpoint endpoint(_endpoint.address(), static_cast<unsigned short>(std::stoi(_udp_port)));
+
+	for ( auto & w : _workers )
+	{
+		w->udp_socket.open(endpoint.protocol());
+		if ( _sharded )
+		{
+#if defined(SO_REUSEPORT)
+			w->udp_socket.set_option(reuse_port_option(true));
+#endif
+		}
+		w->udp_socket.bind(endpoint);
+
+		// Room for the largest datagram that can arrive.
+		w->udp_buffer.resize(64 << 10);
+		do_receive(*w);
+	}
+}
+
+void
+server::do_receive(worker & w)
+{
+	w.udp_socket.async_receive_from(boost::asio::buffer(w.udp_buffer), w.udp_sender, w.strand.wrap(
+		[this, &w](boost::system::error_code ec, std::size_t length) {
+			if (!w.udp_socket.is_open())
+			{
+				return;
+			}
+			if (!ec)
+			{
+				auto client = w.udp_sender;
+				auto datagrams = std::make_shared<std::vector<std::string>>();
+				if ( _executor )
+				{
+					// The datagram is copied as the buffer takes the next one.
+					auto request = std::make_shared<std::string>(w.udp_buffer.data(), length);
+					_executor->post([this, &w, client, datagrams, request]() {
+						_datagrams->handle(request->data(), request->size(), *datagrams);
+						w.strand.post([this, &w, client, datagrams]() {
+							do_send(w, client, datagrams);
+						});
+					});
+				}
+				else
+				{
+					_datagrams->handle(w.udp_buffer.data(), length, *datagrams);
+					do_send(w, client, datagrams);
+				}
+			}
+			do_receive(w);
+		}
+	));
+}
+
+void
+server::do_send( worker &                                  w
+               , boost::asio::ip::udp::endpoint const &    client
+               , std::shared_ptr<std::vector<std::string>> datagrams )
+{
+	if ( !w.udp_socket.is_open() )
+	{
+		return;
+	}
+	for ( auto & datagram : *datagrams )
 	{
-		_io_service.stop();
+		// Datagrams that cannot be sent are lost, as UDP allows.
+		w.udp_socket.async_send_to(boost::asio::buffer(datagram), client, w.strand.wrap(
+			[datagrams](boost::system::error_code, std::size_t) {}));
 	}
 }
 
 void
-server::do_accept()
+server::do_accept(worker & w, stream_acceptor & acceptor, stream_socket & socket)
 {
-	_acceptor.async_accept(_socket,
-		[this](boost::system::error_code ec) {
+	if ( _limiter->full() )
+	{
+		/* Leave new clients in the listen backlog rather than accepting
+		 * sockets that would have to be closed again, and check once more
+		 * after a pause.
+		 */
+		auto pause = std::make_shared<boost::asio::deadline_timer>(w.io_service,
+			boost::posix_time::milliseconds(accept_pause_milliseconds));
+		pause->async_wait(
+			[this, &w, &acceptor, &socket, pause](boost::system::error_code /*ec*/) {
+				if (acceptor.is_open())
+				{
+					do_accept(w, acceptor, socket);
+				}
+			});
+		return;
+	}
+
+	acceptor.async_accept(socket,
+		[this, &w, &acceptor, &socket](boost::system::error_code ec) {
 			// Check whether the server was stopped by a signal before this
 			// completion handler had a chance to run.
-			if (!_acceptor.is_open())
+			if (!acceptor.is_open())
 			{
 				return;
 			}
 			if (!ec)
 			{
-				_connection_manager.start(
-					std::make_shared<connection>( _io_service
-					                            , std::move(_socket)
-					                            , _connection_manager
-					                            , _db
-					                            , _log
-					                            , _stats
-					                            , _read_timeout
-					                            , _write_timeout
-					                            , _req_max_bytes
-					                            ));
+				auto slot = _limiter->acquire(_max_connections_per_ip > 0 ? source_address(socket) : std::string());
+				if ( slot )
+				{
+					auto conn = std::make_shared<connection>( w.io_service
+					                                        , std::move(socket)
+					                                        , w.connections
+					                                        , *w.wheels[w.next_wheel++ % w.wheels.size()]
+					                                        , _db
+					                                        , _log
+					                                        , _stats
+					                                        , _buffers
+					                                        , _executor
+					                                        , _admission
+					                                        , _command_stats
+					                                        , std::move(slot)
+					                                        , _req_max_bytes
+					                                        , _read_timeout
+					                                        , _write_timeout
+					                                        , _idle_timeout
+					                                        );
+					conn->set_durability_flags(_durability_flags);
+					w.connections.start(conn);
+				}
+				else
+				{
+					_stats->counter("tcp.connections.rejected", 1);
+					boost::system::error_code ignored_ec;
+					socket.close(ignored_ec);
+				}
 			}
-			do_accept();
+			do_accept(w, acceptor, socket);
 		}
 	);
 }
 
+void
+server::do_tick(worker & w)
+{
+	w.ticker.expires_from_now(boost::posix_time::milliseconds(wheel_tick_milliseconds));
+	w.ticker.async_wait(w.strand.wrap(
+		[this, &w](boost::system::error_code ec) {
+			if (ec || w.stopping)
+			{
+				return;
+			}
+			for ( auto & wheel : w.wheels )
+			{
+				wheel->tick();
+			}
+			do_tick(w);
+		}
+	));
+}
+
 void
 server::do_await_stop()
 {
-	_signals.async_wait(
+	_signals->async_wait(
 		[this](boost::system::error_code /*ec*/, int /*signo*/) {
 			/* The server is stopped by cancelling all outstanding asynchronous
 			 * operations. Once all operations have finished the io_service::run()
-			 * call will exit.
+			 * call will exit. Each worker closes its own acceptor and
+			 * connections on its own thread.
 			 */
-			_acceptor.close();
-			_connection_manager.stop_all();
+			std::lock_guard<std::mutex> lock(_workers_mutex);
+			for ( auto & w : _workers )
+			{
+				worker * target = w.get();
+				target->strand.post([target]() {
+					target->stopping = true;
+					target->ticker.cancel();
+					target->acceptor.close();
+					target->local_acceptor.close();
+					target->udp_socket.close();
+					target->connections.stop_all();
+				});
+			}
 		});
 }
@@ -26,10 +26,22 @@ SOFTWARE.
 #define TCP_SERVER_HPP
 
 #include <boost/asio.hpp>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include <quitsies/tcp/connection_manager.hpp>
+#include <quitsies/tcp/connection_limiter.hpp>
+#include <quitsies/tcp/buffer_pool.hpp>
+#include <quitsies/tcp/timer_wheel.hpp>
+#include <quitsies/tcp/datagram.hpp>
 #include <quitsies/db/store.hpp>
+#include <quitsies/db/executor.hpp>
+#include <quitsies/db/admission.hpp>
+#include <quitsies/tcp/command_stats.hpp>
 #include <quitsies/log/logger.hpp>
 #include <quitsies/stats/aggregator.hpp>
 
@@ -43,19 +55,93 @@ namespace quitsies { namespace tcp {
  * to interact with.
  *
  * When run is called the server will begin to accept and respond to incoming
- * TCP requests.
+ * TCP requests. By default every thread runs the same io_service and accepts
+ * from one listening socket. In sharded mode each thread instead runs a worker
+ * of its own, with its own io_service, its own SO_REUSEPORT listening socket
+ * and its own connections, so that threads never contend on a shared reactor.
+ *
+ * The server may also accept connections on a Unix domain socket, for clients
+ * on the same host. These are served just as the TCP connections are.
+ *
+ * Optionally gets are also served over UDP, which spares clients making many
+ * small lookups the cost of holding connections open.
  */
 class server
 {
-	boost::asio::io_service        _io_service;
-	boost::asio::signal_set        _signals;
-	boost::asio::ip::tcp::acceptor _acceptor;
-	connection_manager             _connection_manager;
-	boost::asio::ip::tcp::socket   _socket;
+	typedef boost::asio::basic_socket_acceptor<boost::asio::generic::stream_protocol> stream_acceptor;
+
+	/*
+	 * An io_service together with the listening socket and the connections
+	 * that it serves, and a timer wheel per thread for their timeouts.
+	 * Connections are spread over the wheels as they are accepted, so the
+	 * threads of a shared io_service do not all contend on one wheel.
+	 *
+	 * The wheels are declared first as connections still held by handlers of
+	 * the io_service cancel their timers when it is destroyed.
+	 */
+	struct worker {
+		std::vector<std::unique_ptr<timer_wheel>> wheels;
+		std::atomic<size_t>             next_wheel;
+		boost::asio::io_service         io_service;
+		boost::asio::io_service::strand strand;
+		boost::asio::deadline_timer     ticker;
+		stream_acceptor                 acceptor;
+		stream_socket                   socket;
+		stream_acceptor                 local_acceptor;
+		stream_socket                   local_socket;
+		boost::asio::ip::udp::socket    udp_socket;
+		boost::asio::ip::udp::endpoint  udp_sender;
+		std::vector<char>               udp_buffer;
+		connection_manager              connections;
+		bool                            stopping;
+
+		// A worker run by a single thread keeps its connections without locks.
+		explicit worker(size_t n_threads)
+			: wheels()
+			, next_wheel(0)
+			, io_service()
+			, strand(io_service)
+			, ticker(io_service)
+			, acceptor(io_service)
+			, socket(io_service)
+			, local_acceptor(io_service)
+			, local_socket(io_service)
+			, udp_socket(io_service)
+			, udp_sender()
+			, udp_buffer()
+			, connections(n_threads, n_threads > 1)
+			, stopping(false)
+		{
+			for ( size_t i = 0; i < n_threads; i++ ) {
+				wheels.emplace_back(new timer_wheel(wheel_tick_milliseconds, wheel_slots));
+			}
+		}
+	};
+
+	typedef std::unique_ptr<worker> worker_ptr;
+
+	boost::asio::ip::tcp::endpoint _endpoint;
+	std::string                    _local_path;
+	std::string                    _udp_port;
+	std::unique_ptr<datagram_handler> _datagrams;
+	std::vector<worker_ptr>        _workers;
+	std::unique_ptr<boost::asio::signal_set> _signals;
+	std::mutex                     _workers_mutex;
 	db::store_ptr                  _db;
+	db::executor_ptr               _executor;
+	db::admission_ptr              _admission;
+	command_stats_ptr              _command_stats;
 	int                            _read_timeout;
 	int                            _write_timeout;
+	int                            _idle_timeout;
 	size_t                         _req_max_bytes;
+	size_t                         _max_connections;
+	size_t                         _max_connections_per_ip;
+	std::unique_ptr<connection_limiter> _limiter;
+	bool                           _sharded;
+	bool                           _pin_threads;
+	bool                           _durability_flags;
+	buffer_pool_ptr                _buffers;
 
 	log::logger                    _log;
 	stats::aggregator_ptr          _stats;
@@ -114,6 +200,14 @@ public:
 	 */
 	void set_write_timeout(int time_milliseconds);
 
+	/*
+	 * Sets the maximum length of time in milliseconds that a connection may sit idle between
+	 * requests before it is closed. If set to 0 (default) the read timeout is used instead.
+	 *
+	 * @param time_milliseconds the time in milliseconds to wait, 0 is ignored
+	 */
+	void set_idle_timeout(int time_milliseconds);
+
 	/*
 	 * Sets the maximum size in bytes that a request is permitted to be before a client is rejected.
 	 * If set to 0 (default) the limit is ignored.
@@ -122,11 +216,135 @@ public:
 	 */
 	void set_max_request_bytes(size_t num_bytes);
 
+	/*
+	 * Sets the maximum number of open connections. Once it is reached the server
+	 * stops accepting, and new clients wait in the listen backlog until others
+	 * close. If set to 0 (default) the number of connections is not limited.
+	 *
+	 * @param max_connections the number of connections permitted, 0 is ignored
+	 */
+	void set_max_connections(size_t max_connections);
+
+	/*
+	 * Sets the maximum number of open connections from each source IP address,
+	 * further connections from the address are closed as soon as they are
+	 * accepted. If set to 0 (default) the limit is ignored.
+	 *
+	 * @param max_connections the number of connections permitted, 0 is ignored
+	 */
+	void set_max_connections_per_ip(size_t max_connections);
+
+	/*
+	 * Gives each thread its own io_service and SO_REUSEPORT listening socket,
+	 * the kernel then balances new connections across the threads. Optionally
+	 * pins each thread to a CPU. Must be called before run.
+	 *
+	 * @param sharded whether each thread runs a worker of its own
+	 * @param pin_threads whether worker threads are pinned to a CPU each
+	 */
+	void set_sharded(bool sharded, bool pin_threads = false);
+
+	/*
+	 * Runs the store calls of every command on a pool of storage threads, so
+	 * that a slow disk operation does not hold up the other connections of a
+	 * TCP thread. If not set (default) commands run on the TCP threads.
+	 *
+	 * @param executor the storage thread pool to run commands on
+	 */
+	void set_storage_executor(db::executor_ptr executor);
+
+	/*
+	 * Sheds the commands that admission control turns away with a busy error,
+	 * rather than queueing them. If not set (default) every command is run.
+	 *
+	 * @param admission the admission control shared with the other APIs
+	 */
+	void set_admission(db::admission_ptr admission);
+
+	/*
+	 * Lets the two high bits of the flags of a store select its durability,
+	 * 0x80000000 syncs the write and 0x40000000 skips the write ahead log.
+	 * The bits are then removed from the flags that are stored. If not set
+	 * (default) flags are stored as the client gives them.
+	 *
+	 * @param enabled whether the flags of stores select their durability
+	 */
+	void set_durability_flags(bool enabled);
+
+	/*
+	 * Also accepts connections on a Unix domain socket at the given path, which
+	 * saves co-located clients the cost of the TCP loopback. A stale socket
+	 * file at the path is replaced. If empty (default) only TCP is served.
+	 * Must be called before run.
+	 *
+	 * @param path the file system path of the socket
+	 */
+	void set_local_socket(std::string const & path);
+
+	/*
+	 * Also serves get and gets over the memcached UDP protocol on the given
+	 * port of the server address. In sharded mode every worker receives from
+	 * its own SO_REUSEPORT socket. If empty (default) UDP is not served. Must
+	 * be called before run.
+	 *
+	 * @param port the UDP port to bind to
+	 */
+	void set_udp_port(std::string const & port);
+
 private:
+	// Connection read buffers grow from the minimum up to the maximum size.
+	static const size_t min_read_buffer_bytes = 8 << 10;  // 8KB
+	static const size_t max_read_buffer_bytes = 256 << 10; // 256KB
+	static const size_t max_free_read_buffers = 64;
+
+	// How long accepting is paused for before the connection limit is checked
+	// again.
+	static const size_t accept_pause_milliseconds = 10;
+
+	// Timeouts are rounded up to ticks of the wheel, one turn covers 25.6s.
+	static const size_t wheel_tick_milliseconds = 50;
+	static const size_t wheel_slots = 512;
+
+	/*
+	 * Creates a worker, run by n_threads threads, with a listening socket bound
+	 * to the server endpoint.
+	 */
+	worker_ptr make_worker(bool reuse_port, size_t n_threads);
+
+	/*
+	 * Binds the Unix domain socket, which every worker then accepts from.
+	 */
+	void listen_local();
+
+	/*
+	 * Binds a UDP socket for each worker.
+	 */
+	void listen_udp();
+
+	/*
+	 * An asynchronous call that receives the next request datagram of a
+	 * worker, and replies to it once its commands have run.
+	 */
+	void do_receive(worker & w);
+
+	/*
+	 * Sends the datagrams of a response to the client of a request.
+	 */
+	void do_send( worker &                                  w
+	            , boost::asio::ip::udp::endpoint const &    client
+	            , std::shared_ptr<std::vector<std::string>> datagrams );
+
+	/*
+	 * An asynchronous call that triggers listening for a connection on one of
+	 * the listening sockets of a worker.
+	 */
+	void do_accept(worker & w, stream_acceptor & acceptor, stream_socket & socket);
+
 	/*
-	 * An asynchronous call that triggers listening for a TCP connection or signal.
+	 * An asynchronous call that advances the timer wheels of a worker once per
+	 * tick until the worker is stopped.
 	 */
-	void do_accept();
+	void do_tick(worker & w);
 
 	/*
 	 * Stops the server from listening for new connections and closes all open connections.
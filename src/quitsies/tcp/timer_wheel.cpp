@@ -0,0 +1,133 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <quitsies/tcp/timer_wheel.hpp>
+
+using namespace quitsies::tcp;
+
+timer_wheel::timer_wheel(size_t tick_milliseconds, size_t n_slots)
+	: _tick_milliseconds(tick_milliseconds > 0 ? tick_milliseconds : 1)
+	, _slots(n_slots > 0 ? n_slots : 1, nullptr)
+	, _cursor(0)
+	, _size(0)
+	, _mutex()
+{}
+
+size_t
+timer_wheel::size()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _size;
+}
+
+void
+timer_wheel::tick()
+{
+	std::vector<std::function<void()>> expired;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_cursor = (_cursor + 1) % _slots.size();
+
+		timer * t = _slots[_cursor];
+		while ( t != nullptr ) {
+			timer * next = t->_next;
+			if ( t->_rounds == 0 ) {
+				unlink(*t);
+				expired.push_back(t->_callback);
+			} else {
+				t->_rounds--;
+			}
+			t = next;
+		}
+	}
+
+	// Callbacks are copied out so that their owners may be destroyed while
+	// they run.
+	for ( auto & callback : expired ) {
+		callback();
+	}
+}
+
+void
+timer_wheel::schedule(timer & t, size_t timeout_milliseconds)
+{
+	size_t ticks = (timeout_milliseconds + _tick_milliseconds - 1) / _tick_milliseconds;
+	if ( ticks == 0 ) {
+		ticks = 1;
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	if ( t._linked ) {
+		unlink(t);
+	}
+	t._rounds = (ticks - 1) / _slots.size();
+	link(t, (_cursor + ticks) % _slots.size());
+}
+
+void
+timer_wheel::cancel(timer & t)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if ( t._linked ) {
+		unlink(t);
+	}
+}
+
+bool
+timer_wheel::is_scheduled(timer & t)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return t._linked;
+}
+
+void
+timer_wheel::link(timer & t, size_t slot)
+{
+	t._slot = slot;
+	t._prev = nullptr;
+	t._next = _slots[slot];
+	if ( t._next != nullptr ) {
+		t._next->_prev = &t;
+	}
+	_slots[slot] = &t;
+	t._linked = true;
+	_size++;
+}
+
+void
+timer_wheel::unlink(timer & t)
+{
+	if ( t._prev != nullptr ) {
+		t._prev->_next = t._next;
+	} else {
+		_slots[t._slot] = t._next;
+	}
+	if ( t._next != nullptr ) {
+		t._next->_prev = t._prev;
+	}
+	t._prev = nullptr;
+	t._next = nullptr;
+	t._linked = false;
+	_size--;
+}
@@ -0,0 +1,125 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef QUITSIES_TIMER_WHEEL_HPP
+#define QUITSIES_TIMER_WHEEL_HPP
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace quitsies { namespace tcp {
+
+/*
+ * A hashed timing wheel for the timeouts of many connections.
+ *
+ * Time is divided into ticks, and each timer is linked into the slot of the
+ * tick it expires on along with the number of whole turns of the wheel still
+ * to wait. Scheduling and cancelling a timer are O(1) list operations with no
+ * allocation. The owner of the wheel calls tick once per tick, typically from
+ * a single asio timer, and timeouts are rounded up to whole ticks.
+ *
+ * The wheel must outlive its timers.
+ */
+class timer_wheel {
+public:
+	/*
+	 * A timeout that can be scheduled on a wheel, usually held by the object
+	 * it times out. The callback is run on the thread that ticks the wheel,
+	 * once the timer is no longer scheduled.
+	 */
+	class timer {
+		friend class timer_wheel;
+
+		timer_wheel &         _wheel;
+		std::function<void()> _callback;
+		timer *               _prev;
+		timer *               _next;
+		size_t                _slot;
+		size_t                _rounds;
+		bool                  _linked;
+
+	public:
+		timer(const timer&) = delete;
+
+		timer& operator=(const timer&) = delete;
+
+		timer(timer_wheel & wheel, std::function<void()> callback)
+			: _wheel(wheel)
+			, _callback(callback)
+			, _prev(nullptr)
+			, _next(nullptr)
+			, _slot(0)
+			, _rounds(0)
+			, _linked(false)
+		{}
+
+		~timer() { cancel(); }
+
+		// Schedules the timer to fire once after the timeout, replacing any
+		// earlier schedule.
+		void schedule(size_t timeout_milliseconds) { _wheel.schedule(*this, timeout_milliseconds); }
+		void cancel()                              { _wheel.cancel(*this); }
+		bool scheduled()                           { return _wheel.is_scheduled(*this); }
+	};
+
+	timer_wheel(const timer_wheel&) = delete;
+
+	timer_wheel& operator=(const timer_wheel&) = delete;
+
+	/*
+	 * Constructs a wheel of n_slots slots that advances one slot per tick.
+	 */
+	timer_wheel(size_t tick_milliseconds, size_t n_slots);
+
+	size_t tick_milliseconds() const { return _tick_milliseconds; }
+
+	// Returns the number of scheduled timers.
+	size_t size();
+
+	/*
+	 * Advances the wheel by one tick and fires the timers that expire on it.
+	 */
+	void tick();
+
+private:
+	size_t               _tick_milliseconds;
+	std::vector<timer *> _slots;
+	size_t               _cursor;
+	size_t               _size;
+	std::mutex           _mutex;
+
+	void schedule(timer & t, size_t timeout_milliseconds);
+	void cancel(timer & t);
+	bool is_scheduled(timer & t);
+
+	// Both require the mutex to be held.
+	void link(timer & t, size_t slot);
+	void unlink(timer & t);
+};
+
+} } // tcp, quitsies
+
+#endif // QUITSIES_TIMER_WHEEL_HPP
@@ -0,0 +1,105 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2017 MediaSift Ltd.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <test/catch.hpp>
+
+#include <quitsies/tcp/timer_wheel.hpp>
+
+#include <memory>
+#include <vector>
+
+using namespace quitsies::tcp;
+
+TEST_CASE("timer wheel fires timers on the tick they expire", "[timer_wheel]")
+{
+	timer_wheel wheel(10, 8);
+	int fired = 0;
+	timer_wheel::timer t(wheel, [&fired]() { fired++; });
+
+	SECTION("timeouts are rounded up to whole ticks")
+	{
+		t.schedule(25);
+		CHECK(wheel.size() == 1);
+		wheel.tick();
+		wheel.tick();
+		CHECK(fired == 0);
+		wheel.tick();
+		CHECK(fired == 1);
+		CHECK_FALSE(t.scheduled());
+		CHECK(wheel.size() == 0);
+	}
+
+	SECTION("timeouts beyond one turn wait for later turns")
+	{
+		t.schedule(200);
+		for ( int i = 0; i < 19; i++ ) {
+			wheel.tick();
+		}
+		CHECK(fired == 0);
+		wheel.tick();
+		CHECK(fired == 1);
+	}
+
+	SECTION("rescheduling replaces the earlier expiry")
+	{
+		t.schedule(10);
+		t.schedule(50);
+		CHECK(wheel.size() == 1);
+		for ( int i = 0; i < 4; i++ ) {
+			wheel.tick();
+		}
+		CHECK(fired == 0);
+		wheel.tick();
+		CHECK(fired == 1);
+	}
+
+	SECTION("cancelled and destroyed timers never fire")
+	{
+		t.schedule(10);
+		t.cancel();
+		{
+			timer_wheel::timer other(wheel, [&fired]() { fired++; });
+			other.schedule(10);
+		}
+		CHECK(wheel.size() == 0);
+		wheel.tick();
+		CHECK(fired == 0);
+	}
+
+	SECTION("many timers share a slot")
+	{
+		std::vector<std::unique_ptr<timer_wheel::timer>> timers;
+		for ( int i = 0; i < 10; i++ ) {
+			timers.emplace_back(new timer_wheel::timer(wheel, [&fired]() { fired++; }));
+			timers.back()->schedule(i % 2 == 0 ? 10 : 90);
+		}
+		timers[4]->cancel();
+		wheel.tick();
+		CHECK(fired == 4);
+		for ( int i = 0; i < 8; i++ ) {
+			wheel.tick();
+		}
+		CHECK(fired == 9);
+	}
+}
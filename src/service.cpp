@@ -41,8 +41,16 @@ int main(int argc, char* argv[]) {
 	            http_prefix     = "/quitsies", tcp_address    = "localhost",
 	            tcp_port        = "11211",     statsd_address = "",
 	            statsd_port     = "8125",      statsd_prefix  = "quitsies",
-	            log_level       = "info";
-	long long   n_http_threads  = 1,           n_tcp_threads  = 10;
+	            log_level       = "info",      tcp_socket     = "",
+	            udp_port        = "";
+	long long   n_http_threads  = 1,           n_tcp_threads  = 10,
+	            n_storage_threads = 0,         tcp_read_timeout = 0,
+	            tcp_write_timeout = 0,         tcp_idle_timeout = 0,
+	            max_inflight_reads = 0,        max_inflight_writes = 0,
+	            max_inflight_bytes = 0,        tcp_max_connections = 0,
+	            tcp_max_connections_per_ip = 0, tcp_max_item_bytes = 1 << 20;
+	bool        tcp_sharded     = false,       tcp_pin_threads = false,
+	            tcp_durability_flags = false;
 
 	// Create our DB.
 	db::store_ptr db(new db::rocks());
@@ -57,7 +65,22 @@ int main(int argc, char* argv[]) {
 				option_ptr(new int_option('?', "http_threads", "Number of HTTP threads.", &n_http_threads)),
 				option_ptr(new str_option('?', "tcp_address", "Address to bind to for TCP.", &tcp_address)),
 				option_ptr(new str_option('?', "tcp_port", "Port to bind to for TCP.", &tcp_port)),
+				option_ptr(new str_option('?', "tcp_socket", "Path of a Unix domain socket to also serve the memcached API on, empty disables.", &tcp_socket)),
+				option_ptr(new str_option('?', "udp_port", "Port to serve memcached gets over UDP on, empty disables.", &udp_port)),
 				option_ptr(new int_option('?', "tcp_threads", "Number of TCP threads.", &n_tcp_threads)),
+				option_ptr(new int_option('?', "tcp_max_connections", "Stop accepting TCP connections while this many are open, 0 disables.", &tcp_max_connections)),
+				option_ptr(new int_option('?', "tcp_max_connections_per_ip", "Close new TCP connections from an IP address with this many open, 0 disables.", &tcp_max_connections_per_ip)),
+				option_ptr(new int_option('?', "tcp_max_item_bytes", "Reject memcached values larger than this many bytes, 0 disables.", &tcp_max_item_bytes)),
+				option_ptr(new int_option('?', "tcp_read_timeout_ms", "Close TCP connections that take longer to send a request, 0 disables.", &tcp_read_timeout)),
+				option_ptr(new int_option('?', "tcp_write_timeout_ms", "Close TCP connections that take longer to receive a response, 0 disables.", &tcp_write_timeout)),
+				option_ptr(new int_option('?', "tcp_idle_timeout_ms", "Close TCP connections that are idle between requests for longer, 0 disables.", &tcp_idle_timeout)),
+				option_ptr(new bool_option('?', "tcp_sharded", "Give each TCP thread its own io_service and SO_REUSEPORT listening socket.", &tcp_sharded)),
+				option_ptr(new int_option('?', "tcp_storage_threads", "Number of threads running store calls for TCP commands, 0 runs them on the TCP threads.", &n_storage_threads)),
+				option_ptr(new bool_option('?', "tcp_pin_threads", "Pin each sharded TCP thread to a CPU.", &tcp_pin_threads)),
+				option_ptr(new bool_option('?', "tcp_durability_flags", "Let the two high bits of memcached flags select the durability of a write.", &tcp_durability_flags)),
+				option_ptr(new int_option('?', "max_inflight_reads", "Shed reads with a busy error once this many commands are in flight, 0 disables.", &max_inflight_reads)),
+				option_ptr(new int_option('?', "max_inflight_writes", "Shed writes with a busy error once this many commands are in flight, 0 disables.", &max_inflight_writes)),
+				option_ptr(new int_option('?', "max_inflight_bytes", "Shed writes with a busy error once their values in flight would exceed this many bytes, 0 disables.", &max_inflight_bytes)),
 				option_ptr(new str_option('?', "statsd_address", "Address of the statsd server for sending metrics.", &statsd_address)),
 				option_ptr(new str_option('?', "statsd_port", "Port of the statsd server for sending metrics.", &statsd_port)),
 				option_ptr(new str_option('?', "statsd_prefix", "Prefix of statsd metrics.", &statsd_prefix)),
@@ -78,7 +101,7 @@ int main(int argc, char* argv[]) {
 
 	// Print general options.
 	logger->info("REST API listening at http://{}:{}{} with {} threads.", http_address, http_port, http_prefix, n_http_threads);
-	logger->info("Memcached API listening at tcp://{}:{} with {} threads.", tcp_address, tcp_port, n_tcp_threads);
+	logger->info("Memcached API listening at tcp://{}:{} with {} {}threads.", tcp_address, tcp_port, n_tcp_threads, tcp_sharded ? "sharded " : "");
 
 	// Create our metrics aggregator.
 	stats::aggregator_ptr stats(new stats::null_aggregator());
@@ -95,12 +118,44 @@ int main(int argc, char* argv[]) {
 		return 1;
 	}
 
+	// Shed commands of every API over the same budget.
+	db::admission_ptr admission;
+	if ( max_inflight_reads > 0 || max_inflight_writes > 0 || max_inflight_bytes > 0 ) {
+		logger->info("Shedding reads over {} and writes over {} commands or {} bytes in flight.", max_inflight_reads, max_inflight_writes, max_inflight_bytes);
+		admission.reset(new db::admission( static_cast<size_t>(max_inflight_reads)
+		                                 , static_cast<size_t>(max_inflight_writes)
+		                                 , static_cast<size_t>(max_inflight_bytes)
+		                                 , stats ));
+		db->set_admission(admission);
+	}
+
 	// Create our REST API mux.
 	served::multiplexer mux(http_prefix);
 	db->register_endpoints(mux);
 
 	// Create memcached API and start listening.
 	tcp::server memcached_server(tcp_address, tcp_port, db, logger, stats);
+	memcached_server.set_sharded(tcp_sharded, tcp_pin_threads);
+	memcached_server.set_admission(admission);
+	memcached_server.set_durability_flags(tcp_durability_flags);
+	memcached_server.set_max_connections(static_cast<size_t>(tcp_max_connections));
+	memcached_server.set_max_connections_per_ip(static_cast<size_t>(tcp_max_connections_per_ip));
+	memcached_server.set_max_request_bytes(static_cast<size_t>(tcp_max_item_bytes));
+	if ( tcp_socket.length() > 0 ) {
+		logger->info("Memcached API also listening at unix://{}", tcp_socket);
+		memcached_server.set_local_socket(tcp_socket);
+	}
+	memcached_server.set_read_timeout(static_cast<int>(tcp_read_timeout));
+	memcached_server.set_write_timeout(static_cast<int>(tcp_write_timeout));
+	memcached_server.set_idle_timeout(static_cast<int>(tcp_idle_timeout));
+	if ( udp_port.length() > 0 ) {
+		logger->info("Memcached API serving gets at udp://{}:{}", tcp_address, udp_port);
+		memcached_server.set_udp_port(udp_port);
+	}
+	if ( n_storage_threads > 0 ) {
+		logger->info("Running TCP store calls on {} storage threads.", n_storage_threads);
+		memcached_server.set_storage_executor(db::executor_ptr(new db::executor(static_cast<size_t>(n_storage_threads))));
+	}
 	std::thread mem_thread([&memcached_server, &n_tcp_threads]() {
 		memcached_server.run(n_tcp_threads);
 	});